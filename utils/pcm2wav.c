@@ -1,5 +1,6 @@
 #include "wav_file.h"
 #include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -18,7 +19,7 @@ static void print_help(const char* program) {
     printf("  -o WAV_FILE           wav file\n");
     printf("  -c NUM_CHANNELS       num channels of pcm file [1-256], default %d\n", num_channels);
     printf("  -s SAMPLE_RATE        sample rate of pcm file, default %d\n", sample_rate);
-    printf("  -f SAMPLE_FORMAT      sample format [i16|i32|f32], default %s\n",
+    printf("  -f SAMPLE_FORMAT      sample format [i16|i24|i32|f32], default %s\n",
            sample_format_get_str(sample_format));
 }
 
@@ -46,6 +47,8 @@ int main(int argc, const char* argv[]) {
             if (format != NULL) {
                 if (strcmp(format, "i16") == 0) {
                     sample_format = kSampleFormatI16;
+                } else if (strcmp(format, "i24") == 0) {
+                    sample_format = kSampleFormatI24;
                 } else if (strcmp(format, "i32") == 0) {
                     sample_format = kSampleFormatI32;
                 } else if (strcmp(format, "f32") == 0) {
@@ -82,9 +85,9 @@ int main(int argc, const char* argv[]) {
         return -1;
     }
 
-    FILE* fp_pcm = fopen(pcm_file, "rb");
+    int fd_pcm = open(pcm_file, O_RDONLY);
 
-    if (fp_pcm == NULL) {
+    if (fd_pcm < 0) {
         printf("read pcm file %s failed (%s)\n", pcm_file, strerror(errno));
         return -1;
     }
@@ -93,33 +96,18 @@ int main(int argc, const char* argv[]) {
 
     if (writer == NULL) {
         printf("open wav file %s failed\n", wav_file);
-        fclose(fp_pcm);
+        close(fd_pcm);
         return -1;
     }
 
-    int num_samples = sample_rate / 10;
-    int block_align = num_channels * sample_format_get_bytes_per_sample(sample_format);
-    char* sample_buf = (char*)malloc(num_samples * block_align);
+    // pcm samples are in the wav format, the payload is copied inside the kernel
+    int64_t ret = wav_writer_write_fd(writer, fd_pcm, sample_format, -1);
 
-    while (1) {
-        size_t ret = fread(sample_buf, block_align, num_samples, fp_pcm);
-
-        if (ret > 0) {
-            if (sample_format == kSampleFormatF32) {
-                wav_writer_write_f32(writer, (int)ret, (float*)sample_buf);
-            } else if (sample_format == kSampleFormatI16) {
-                wav_writer_write_i16(writer, (int)ret, (int16_t*)sample_buf);
-            } else {
-                wav_writer_write_i32(writer, (int)ret, (int32_t*)sample_buf);
-            }
-        }
-
-        if (ret < num_samples) {
-            break;
-        }
+    if (ret < 0) {
+        printf("convert pcm file %s failed\n", pcm_file);
     }
 
-    fclose(fp_pcm);
+    close(fd_pcm);
     wav_writer_close(writer);
-    return 0;
+    return ret < 0 ? -1 : 0;
 }
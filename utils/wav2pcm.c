@@ -1,6 +1,6 @@
 #include "wav_file.h"
 #include <errno.h>
-#include <stdlib.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -14,7 +14,7 @@ static void print_help(const char* program) {
     printf("  -h, --help            show this help message and exit\n");
     printf("  -i WAV_FILE           wav file\n");
     printf("  -o PCM_FILE           pcm file\n");
-    printf("  -f SAMPLE_FORMAT      sample format [i16|f32], default the same as wav file\n");
+    printf("  -f SAMPLE_FORMAT      sample format [i16|i24|i32|f32], default the same as wav file\n");
 }
 
 int main(int argc, const char* argv[]) {
@@ -37,6 +37,10 @@ int main(int argc, const char* argv[]) {
             if (format != NULL) {
                 if (strcmp(format, "i16") == 0) {
                     sample_format = kSampleFormatI16;
+                } else if (strcmp(format, "i24") == 0) {
+                    sample_format = kSampleFormatI24;
+                } else if (strcmp(format, "i32") == 0) {
+                    sample_format = kSampleFormatI32;
                 } else if (strcmp(format, "f32") == 0) {
                     sample_format = kSampleFormatF32;
                 } else {
@@ -67,44 +71,26 @@ int main(int argc, const char* argv[]) {
         return -1;
     }
 
-    FILE* fp_pcm = fopen(pcm_file, "wb");
+    int fd_pcm = open(pcm_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
 
-    if (fp_pcm == NULL) {
+    if (fd_pcm < 0) {
         printf("create pcm file %s failed (%s)\n", pcm_file, strerror(errno));
         wav_reader_close(reader);
         return -1;
     }
 
-    int num_channels = wav_reader_get_num_channels(reader);
-    int sample_rate = wav_reader_get_sample_rate(reader);
-
     if (sample_format == kSampleFormatInvalid) {
         sample_format = wav_reader_get_sample_format(reader);
     }
 
-    int num_samples = sample_rate / 10;
-    int block_align = num_channels * sample_format_get_bytes_per_sample(sample_format);
-    char* sample_buf = (char*)malloc(num_samples * block_align);
-
-    while (1) {
-        int ret = 0;
-
-        if (sample_format == kSampleFormatI16) {
-            ret = wav_reader_read_i16(reader, num_samples, (int16_t*)sample_buf);
-        } else {
-            ret = wav_reader_read_f32(reader, num_samples, (float*)sample_buf);
-        }
-
-        if (ret > 0) {
-            fwrite(sample_buf, block_align, ret, fp_pcm);
-        }
+    // samples in the wav format are copied inside the kernel, others convert in large blocks
+    int64_t ret = wav_reader_read_fd(reader, fd_pcm, sample_format, -1);
 
-        if (ret < num_samples) {
-            break;
-        }
+    if (ret < 0) {
+        printf("convert wav file %s failed\n", wav_file);
     }
 
-    fclose(fp_pcm);
+    close(fd_pcm);
     wav_reader_close(reader);
-    return 0;
+    return ret < 0 ? -1 : 0;
 }
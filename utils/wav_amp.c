@@ -1,20 +1,163 @@
 #include "wav_file.h"
+#include "wav_pipeline.h"
 #include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 static const char* in_file = NULL;
 static const char* out_file = NULL;
-static float amp_gain = 1.f;
+static float amp_gains[256] = {1.f};
+static int num_amp_gains = 1;
+static int num_jobs = 1;
+
+// samples of parallel jobs are processed in file format, packed 24 bit as int32
+static SampleFormat work_format = kSampleFormatF32;
 
 static void print_help(const char* program) {
     printf("Usage: %s [options]\n", program);
     printf("  -h, --help            show this help message and exit\n");
     printf("  -i WAV_FILE           wav file\n");
     printf("  -o WAV_FILE           pcm file\n");
-    printf("  -a amplifier_gain     amplifier gain between 0 and 1e6\n");
+    printf("  -a amplifier_gain     amplifier gain between 0 and 1e6, or comma separated\n");
+    printf("                        gains of each channel\n");
+    printf("  -j NUM_JOBS           process segments of file on NUM_JOBS threads, default 1\n");
+}
+
+// read num_samples frames at offset, or at read position if offset is negative
+static int amp_read(WavReader* reader, int64_t offset, int num_samples, void* samples) {
+    if (work_format == kSampleFormatF32) {
+        return offset < 0 ? wav_reader_read_f32(reader, num_samples, (float*)samples)
+               : wav_reader_read_at_f32(reader, offset, num_samples, (float*)samples);
+    } else if (work_format == kSampleFormatI16) {
+        return offset < 0 ? wav_reader_read_i16(reader, num_samples, (int16_t*)samples)
+               : wav_reader_read_at_i16(reader, offset, num_samples, (int16_t*)samples);
+    } else {
+        return offset < 0 ? wav_reader_read_i32(reader, num_samples, (int32_t*)samples)
+               : wav_reader_read_at_i32(reader, offset, num_samples, (int32_t*)samples);
+    }
+}
+
+// write num_samples frames at offset, or at write position if offset is negative
+static int amp_write(WavWriter* writer, int64_t offset, int num_samples, const void* samples) {
+    if (work_format == kSampleFormatF32) {
+        return offset < 0 ? wav_writer_write_f32(writer, num_samples, (const float*)samples)
+               : wav_writer_write_at_f32(writer, offset, num_samples, (const float*)samples);
+    } else if (work_format == kSampleFormatI16) {
+        return offset < 0 ? wav_writer_write_i16(writer, num_samples, (const int16_t*)samples)
+               : wav_writer_write_at_i16(writer, offset, num_samples, (const int16_t*)samples);
+    } else {
+        return offset < 0 ? wav_writer_write_i32(writer, num_samples, (const int32_t*)samples)
+               : wav_writer_write_at_i32(writer, offset, num_samples, (const int32_t*)samples);
+    }
+}
+
+// gain clipped at full scale, one pass over each tile of frames in format
+static WavPipeline* amp_pipeline_create(int num_channels, SampleFormat format) {
+    WavPipeline* pipeline = wav_pipeline_create(num_channels, format, format);
+
+    if (pipeline != NULL && (wav_pipeline_add_gain(pipeline, amp_gains) != 0
+                             || wav_pipeline_add_clip(pipeline, 1.f) != 0)) {
+        wav_pipeline_destroy(pipeline);
+        return NULL;
+    }
+
+    return pipeline;
+}
+
+// positional reads and writes need both files to be seekable regular files, not pipes or ttys
+static int amp_is_regular_file(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// frame range of the data chunk processed by one thread
+struct AmpJob {
+    WavReader* reader;
+    WavWriter* writer;
+    int64_t begin;
+    int64_t end;
+    int chunk_samples;
+    int started;
+    int ret;
+};
+
+static void* amp_job_run(void* arg) {
+    struct AmpJob* job = (struct AmpJob*)arg;
+    int num_channels = wav_reader_get_num_channels(job->reader);
+    int block_align = num_channels * sample_format_get_bytes_per_sample(work_format);
+    void* sample_buf = malloc((size_t)job->chunk_samples * block_align);
+    WavPipeline* pipeline = amp_pipeline_create(num_channels, work_format);
+
+    job->ret = sample_buf != NULL && pipeline != NULL ? 0 : -1;
+
+    for (int64_t offset = job->begin; job->ret == 0 && offset < job->end;
+            offset += job->chunk_samples) {
+        int request = job->end - offset < job->chunk_samples ? (int)(job->end - offset)
+                      : job->chunk_samples;
+        int ret = amp_read(job->reader, offset, request, sample_buf);
+
+        if (ret != request) {
+            job->ret = -1;
+            break;
+        }
+
+        wav_pipeline_process(pipeline, sample_buf, ret, sample_buf);
+
+        if (amp_write(job->writer, offset, ret, sample_buf) != ret) {
+            job->ret = -1;
+        }
+    }
+
+    wav_pipeline_destroy(pipeline);
+    free(sample_buf);
+    return NULL;
+}
+
+// split data chunk in num_jobs frame ranges, read and write them concurrently
+static int amp_parallel(WavReader* reader, WavWriter* writer, int chunk_samples) {
+    int64_t num_samples = wav_reader_get_num_samples(reader);
+    struct AmpJob* jobs = (struct AmpJob*)calloc(num_jobs, sizeof(struct AmpJob));
+    pthread_t* threads = (pthread_t*)calloc(num_jobs, sizeof(pthread_t));
+    int ret = 0;
+
+    if (jobs == NULL || threads == NULL) {
+        free(jobs);
+        free(threads);
+        return -1;
+    }
+
+    // reserve the whole output, threads fill their ranges in any order
+    wav_writer_preallocate(writer, num_samples);
+
+    for (int k = 0; k < num_jobs; k++) {
+        jobs[k].reader = reader;
+        jobs[k].writer = writer;
+        jobs[k].begin = num_samples * k / num_jobs;
+        jobs[k].end = num_samples * (k + 1) / num_jobs;
+        jobs[k].chunk_samples = chunk_samples;
+
+        jobs[k].started = pthread_create(&threads[k], NULL, amp_job_run, &jobs[k]) == 0;
+
+        if (!jobs[k].started) {
+            amp_job_run(&jobs[k]);
+        }
+    }
+
+    for (int k = 0; k < num_jobs; k++) {
+        if (jobs[k].started) {
+            pthread_join(threads[k], NULL);
+        }
+
+        ret = jobs[k].ret != 0 ? -1 : ret;
+    }
+
+    free(jobs);
+    free(threads);
+    return ret;
 }
 
 int main(int argc, const char* argv[]) {
@@ -32,7 +175,24 @@ int main(int argc, const char* argv[]) {
         } else if (strcmp(argv[i], "-o") == 0) {
             out_file = argv[++i];
         } else if (strcmp(argv[i], "-a") == 0) {
-            amp_gain = strtof(argv[++i], NULL);
+            char* str = (char*)argv[++i];
+            num_amp_gains = 0;
+
+            for (char* item = strtok(str, ","); item != NULL; item = strtok(NULL, ",")) {
+                if (num_amp_gains == 256) {
+                    printf("too many amplifier gains\n\n");
+                    return -1;
+                }
+
+                amp_gains[num_amp_gains++] = strtof(item, NULL);
+            }
+        } else if (strcmp(argv[i], "-j") == 0) {
+            num_jobs = atoi(argv[++i]);
+
+            if (num_jobs <= 0) {
+                printf("invalid number of jobs\n\n");
+                return -1;
+            }
         } else {
             printf("unknown option %s\n\n", argv[i]);
             return -1;
@@ -49,9 +209,11 @@ int main(int argc, const char* argv[]) {
         return -1;
     }
 
-    if (amp_gain <= 0 || amp_gain > 1e6f) {
-        printf("amplifier gain (%.2f) is invalid\n", amp_gain);
-        return -1;
+    for (int c = 0; c < num_amp_gains; c++) {
+        if (amp_gains[c] <= 0 || amp_gains[c] > 1e6f) {
+            printf("amplifier gain (%.2f) is invalid\n", amp_gains[c]);
+            return -1;
+        }
     }
 
     WavReader* reader = wav_reader_open(in_file);
@@ -65,6 +227,22 @@ int main(int argc, const char* argv[]) {
     int sample_rate = wav_reader_get_sample_rate(reader);
     SampleFormat format = wav_reader_get_sample_format(reader);
 
+    if (num_amp_gains == 1) {
+        for (int c = 1; c < num_channels; c++) {
+            amp_gains[c] = amp_gains[0];
+        }
+    } else if (num_amp_gains != num_channels) {
+        printf("%d amplifier gains given for %d channels\n", num_amp_gains, num_channels);
+        wav_reader_close(reader);
+        return -1;
+    }
+
+    if (format == kSampleFormatF32 || format == kSampleFormatI16) {
+        work_format = format;
+    } else {
+        work_format = kSampleFormatI32;
+    }
+
     WavWriter* writer = wav_writer_open(out_file, num_channels, sample_rate, format);
 
     if (writer == NULL) {
@@ -74,34 +252,31 @@ int main(int argc, const char* argv[]) {
     }
 
     int num_samples = sample_rate / 10;
-    int block_align = num_channels * sizeof(float);
-    float* sample_buf = (float*)malloc(num_samples * block_align);
 
-    while (1) {
-        int ret = wav_reader_read_f32(reader, num_samples, sample_buf);
+    // segments need random access, streams and unknown lengths are processed serially
+    if (num_jobs > 1 && wav_reader_get_num_samples(reader) >= 0
+            && amp_is_regular_file(in_file) && amp_is_regular_file(out_file)) {
+        int ret = amp_parallel(reader, writer, num_samples);
 
-        if (ret > 0) {
-            for (int i = 0; i < ret * num_channels; i++) {
-                sample_buf[i] = sample_buf[i] * amp_gain;
-
-                if (sample_buf[i] > 1.f) {
-                    sample_buf[i] = 1.f;
-                }
+        if (ret != 0) {
+            printf("process %s failed\n", in_file);
+        }
 
-                if (sample_buf[i] < -1.f) {
-                    sample_buf[i] = -1.f;
-                }
-            }
+        wav_reader_close(reader);
+        wav_writer_close(writer);
+        return ret;
+    }
 
-            wav_writer_write_f32(writer, num_samples, sample_buf);
-        }
+    // reads and writes in file format only move data, samples are converted in the pipeline
+    WavPipeline* pipeline = amp_pipeline_create(num_channels, format);
+    int ret = pipeline != NULL && wav_pipeline_run(pipeline, reader, writer, -1) >= 0 ? 0 : -1;
 
-        if (ret < num_samples) {
-            break;
-        }
+    if (ret != 0) {
+        printf("process %s failed\n", in_file);
     }
 
+    wav_pipeline_destroy(pipeline);
     wav_reader_close(reader);
     wav_writer_close(writer);
-    return 0;
+    return ret;
 }
@@ -0,0 +1,623 @@
+#include "wav_file.h"
+#include "wav_convert.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_LIST_SIZE       16
+#define BLOCK_FRAMES        4096
+#define KERNEL_SAMPLES      (64 * 1024)
+#define KERNEL_BYTES        (64 * 1024 * 1024)
+
+static const char* tmp_dir = "/tmp";
+static const char* json_file = NULL;
+static int channel_list[MAX_LIST_SIZE] = {1, 2, 8, 64, 256};
+static int num_channel_list = 5;
+static SampleFormat format_list[MAX_LIST_SIZE] = {
+    kSampleFormatI16, kSampleFormatI24, kSampleFormatI32, kSampleFormatF32
+};
+static int num_format_list = 4;
+static int size_list[MAX_LIST_SIZE] = {64};
+static int num_size_list = 1;
+static int repeat = 3;
+static int uncached = 0;
+static int run_convert = 1;
+static int run_write = 1;
+static int run_read = 1;
+
+static FILE* fp_json = NULL;
+static int num_results = 0;
+
+enum BenchMode {
+    kModeInterleaved = 0,
+    kModePlanar,
+    kModeAt,
+    kModeMmap,
+    kModeSubset,
+    kModeAsync
+};
+
+static const char* bench_mode_get_str(enum BenchMode mode) {
+    if (mode == kModePlanar) {
+        return "planar";
+    } else if (mode == kModeAt) {
+        return "read_at";
+    } else if (mode == kModeMmap) {
+        return "mmap";
+    } else if (mode == kModeSubset) {
+        return "subset";
+    } else if (mode == kModeAsync) {
+        return "async";
+    }
+
+    return "interleaved";
+}
+
+static void print_help(const char* program) {
+    printf("Usage: %s [options]\n", program);
+    printf("  -h, --help            show this help message and exit\n");
+    printf("  -d TMP_DIR            directory of synthetic wav files, default %s\n", tmp_dir);
+    printf("  -o JSON_FILE          json result file, default stdout\n");
+    printf("  -c CHANNELS           comma separated channel counts, default 1,2,8,64,256\n");
+    printf("  -f SAMPLE_FORMATS     comma separated file formats [i16|i24|i32|f32], default all\n");
+    printf("  -m MEGABYTES          comma separated file sizes in MB, default 64\n");
+    printf("  -r REPEAT             runs of each case, the fastest is reported, default 3\n");
+    printf("  -t TESTS              comma separated tests [convert|write|read], default all\n");
+    printf("  -u                    drop page cache of files before reads\n");
+}
+
+static SampleFormat parse_format(const char* str) {
+    if (strcmp(str, "i16") == 0) {
+        return kSampleFormatI16;
+    } else if (strcmp(str, "i24") == 0) {
+        return kSampleFormatI24;
+    } else if (strcmp(str, "i32") == 0) {
+        return kSampleFormatI32;
+    } else if (strcmp(str, "f32") == 0) {
+        return kSampleFormatF32;
+    }
+
+    return kSampleFormatInvalid;
+}
+
+// split comma separated str in place, returns number of items, -1 if too many
+static int split_list(char* str, char** items) {
+    int num_items = 0;
+
+    for (char* item = strtok(str, ","); item != NULL; item = strtok(NULL, ",")) {
+        if (num_items == MAX_LIST_SIZE) {
+            return -1;
+        }
+
+        items[num_items++] = item;
+    }
+
+    return num_items;
+}
+
+static double get_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report_begin(void) {
+    fprintf(fp_json, "{\n");
+    fprintf(fp_json, "  \"isa\": \"%s\",\n", convert_isa_get_str(convert_get_isa()));
+    fprintf(fp_json, "  \"repeat\": %d,\n", repeat);
+    fprintf(fp_json, "  \"uncached\": %s,\n", uncached ? "true" : "false");
+    fprintf(fp_json, "  \"results\": [");
+}
+
+static void report_end(void) {
+    fprintf(fp_json, "\n  ]\n}\n");
+}
+
+static void report_convert(const char* name, ConvertIsa isa, int64_t samples, int64_t bytes,
+                           double seconds) {
+    fprintf(fp_json, "%s\n    {\"test\": \"convert\", \"kernel\": \"%s\", \"isa\": \"%s\", "
+            "\"samples\": %" PRId64 ", \"bytes\": %" PRId64 ", \"seconds\": %.6f, "
+            "\"mb_per_s\": %.1f, \"samples_per_s\": %.0f}",
+            num_results > 0 ? "," : "", name, convert_isa_get_str(isa), samples, bytes, seconds,
+            bytes / seconds * 1e-6, samples / seconds);
+    num_results++;
+}
+
+static void report_io(const char* test, enum BenchMode mode, SampleFormat file_format,
+                      SampleFormat format, int num_channels, int64_t frames, int64_t bytes,
+                      double seconds) {
+    fprintf(fp_json, "%s\n    {\"test\": \"%s\", \"mode\": \"%s\", \"file_format\": \"%s\", "
+            "\"format\": \"%s\", \"convert\": %s, \"channels\": %d, \"frames\": %" PRId64 ", "
+            "\"bytes\": %" PRId64 ", \"seconds\": %.6f, \"mb_per_s\": %.1f, "
+            "\"frames_per_s\": %.0f}",
+            num_results > 0 ? "," : "", test, bench_mode_get_str(mode),
+            sample_format_get_str(file_format), sample_format_get_str(format),
+            file_format != format ? "true" : "false", num_channels, frames, bytes, seconds,
+            bytes / seconds * 1e-6, frames / seconds);
+    num_results++;
+}
+
+/* convert kernels */
+
+static void bench_convert_kernel(int kernel, const void* src, void* dst, int count) {
+    switch (kernel) {
+    case 0: convert_f32_to_i16((const float*)src, count, (int16_t*)dst); break;
+    case 1: convert_i16_to_f32((const int16_t*)src, count, (float*)dst); break;
+    case 2: convert_f32_to_i32((const float*)src, count, (int32_t*)dst); break;
+    case 3: convert_i32_to_f32((const int32_t*)src, count, (float*)dst); break;
+    case 4: convert_i16_to_i32((const int16_t*)src, count, (int32_t*)dst); break;
+    case 5: convert_i32_to_i16((const int32_t*)src, count, (int16_t*)dst); break;
+    case 6: convert_i24_to_i32((const uint8_t*)src, count, (int32_t*)dst); break;
+    case 7: convert_i32_to_i24((const int32_t*)src, count, (uint8_t*)dst); break;
+    case 8: convert_i24_to_f32((const uint8_t*)src, count, (float*)dst); break;
+    case 9: convert_f32_to_i24((const float*)src, count, (uint8_t*)dst); break;
+    case 10: convert_i24_to_i16((const uint8_t*)src, count, (int16_t*)dst); break;
+    case 11: convert_i16_to_i24((const int16_t*)src, count, (uint8_t*)dst); break;
+    }
+}
+
+static void bench_convert(void) {
+    static const char* names[] = {
+        "f32_to_i16", "i16_to_f32", "f32_to_i32", "i32_to_f32", "i16_to_i32", "i32_to_i16",
+        "i24_to_i32", "i32_to_i24", "i24_to_f32", "f32_to_i24", "i24_to_i16", "i16_to_i24"
+    };
+    static const SampleFormat src_formats[] = {
+        kSampleFormatF32, kSampleFormatI16, kSampleFormatF32, kSampleFormatI32,
+        kSampleFormatI16, kSampleFormatI32, kSampleFormatI24, kSampleFormatI32,
+        kSampleFormatI24, kSampleFormatF32, kSampleFormatI24, kSampleFormatI16
+    };
+    ConvertIsa best_isa = convert_get_isa();
+    float* f32 = (float*)malloc(KERNEL_SAMPLES * sizeof(float));
+    char* src[4];
+    char* dst = (char*)malloc(KERNEL_SAMPLES * sizeof(int32_t));
+
+    // synthetic source samples in every format, slightly over full scale to hit saturation
+    for (int i = 0; i < KERNEL_SAMPLES; i++) {
+        f32[i] = 1.05f * sinf(i * 0.001f) + 0.01f * (rand() / (float)RAND_MAX - 0.5f);
+    }
+
+    for (int k = 0; k < 4; k++) {
+        src[k] = (char*)malloc(KERNEL_SAMPLES * sizeof(int32_t));
+    }
+
+    memcpy(src[kSampleFormatF32], f32, KERNEL_SAMPLES * sizeof(float));
+    convert_f32_to_i16(f32, KERNEL_SAMPLES, (int16_t*)src[kSampleFormatI16]);
+    convert_f32_to_i32(f32, KERNEL_SAMPLES, (int32_t*)src[kSampleFormatI32]);
+    convert_f32_to_i24(f32, KERNEL_SAMPLES, (uint8_t*)src[kSampleFormatI24]);
+
+    for (int isa = kConvertIsaScalar; isa <= (int)best_isa; isa++) {
+        if (convert_set_isa((ConvertIsa)isa) != 0) {
+            continue;
+        }
+
+        for (int kernel = 0; kernel < (int)(sizeof(names) / sizeof(names[0])); kernel++) {
+            int64_t block_bytes = (int64_t)KERNEL_SAMPLES
+                                  * sample_format_get_bytes_per_sample(src_formats[kernel]);
+            int iterations = KERNEL_BYTES / block_bytes;
+            double best = 0;
+
+            for (int r = 0; r < repeat; r++) {
+                double start = get_time();
+
+                for (int i = 0; i < iterations; i++) {
+                    bench_convert_kernel(kernel, src[src_formats[kernel]], dst, KERNEL_SAMPLES);
+                }
+
+                double seconds = get_time() - start;
+                best = r == 0 || seconds < best ? seconds : best;
+            }
+
+            report_convert(names[kernel], (ConvertIsa)isa, (int64_t)iterations * KERNEL_SAMPLES,
+                           (int64_t)iterations * block_bytes, best);
+        }
+    }
+
+    convert_set_isa(best_isa);
+
+    for (int k = 0; k < 4; k++) {
+        free(src[k]);
+    }
+
+    free(dst);
+    free(f32);
+}
+
+/* file io */
+
+struct BenchBuffers {
+    char* samples[4];                   // one interleaved block in each sample format
+    void* planes[4][256];               // per channel pointers into samples
+};
+
+static int bench_write_block(WavWriter* writer, enum BenchMode mode, SampleFormat format,
+                             struct BenchBuffers* buffers, int num_samples) {
+    if (mode == kModePlanar) {
+        const void* const* planes = (const void* const*)buffers->planes[format];
+
+        if (format == kSampleFormatF32) {
+            return wav_writer_write_planar_f32(writer, num_samples, (const float* const*)planes);
+        } else if (format == kSampleFormatI16) {
+            return wav_writer_write_planar_i16(writer, num_samples, (const int16_t* const*)planes);
+        } else {
+            return wav_writer_write_planar_i32(writer, num_samples, (const int32_t* const*)planes);
+        }
+    }
+
+    const void* samples = buffers->samples[format];
+
+    if (format == kSampleFormatF32) {
+        return wav_writer_write_f32(writer, num_samples, (const float*)samples);
+    } else if (format == kSampleFormatI16) {
+        return wav_writer_write_i16(writer, num_samples, (const int16_t*)samples);
+    } else if (format == kSampleFormatI24) {
+        return wav_writer_write_i24(writer, num_samples, (const uint8_t*)samples);
+    } else {
+        return wav_writer_write_i32(writer, num_samples, (const int32_t*)samples);
+    }
+}
+
+// write num_frames frames to path, returns seconds from open to close, -1 on failure
+static double bench_write_file(const char* path, enum BenchMode mode, SampleFormat file_format,
+                               SampleFormat format, int num_channels, int64_t num_frames,
+                               struct BenchBuffers* buffers) {
+    double start = get_time();
+    WavWriter* writer = NULL;
+
+    if (mode == kModeAsync) {
+        writer = wav_writer_open_async(path, num_channels, 48000, file_format, 4, BLOCK_FRAMES, 1);
+    } else {
+        writer = wav_writer_open(path, num_channels, 48000, file_format);
+    }
+
+    if (writer == NULL) {
+        return -1;
+    }
+
+    for (int64_t done = 0; done < num_frames; done += BLOCK_FRAMES) {
+        int request = num_frames - done < BLOCK_FRAMES ? (int)(num_frames - done) : BLOCK_FRAMES;
+
+        if (bench_write_block(writer, mode, format, buffers, request) != request) {
+            wav_writer_close(writer);
+            return -1;
+        }
+    }
+
+    wav_writer_close(writer);
+    return get_time() - start;
+}
+
+static int bench_read_block(WavReader* reader, enum BenchMode mode, SampleFormat format,
+                            struct BenchBuffers* buffers, int64_t offset, int num_samples) {
+    void* samples = buffers->samples[format];
+
+    if (mode == kModePlanar) {
+        void* const* planes = buffers->planes[format];
+
+        if (format == kSampleFormatF32) {
+            return wav_reader_read_planar_f32(reader, num_samples, (float* const*)planes);
+        } else if (format == kSampleFormatI16) {
+            return wav_reader_read_planar_i16(reader, num_samples, (int16_t* const*)planes);
+        } else {
+            return wav_reader_read_planar_i32(reader, num_samples, (int32_t* const*)planes);
+        }
+    } else if (mode == kModeAt) {
+        if (format == kSampleFormatF32) {
+            return wav_reader_read_at_f32(reader, offset, num_samples, (float*)samples);
+        } else if (format == kSampleFormatI16) {
+            return wav_reader_read_at_i16(reader, offset, num_samples, (int16_t*)samples);
+        } else {
+            return wav_reader_read_at_i32(reader, offset, num_samples, (int32_t*)samples);
+        }
+    }
+
+    if (format == kSampleFormatF32) {
+        return wav_reader_read_f32(reader, num_samples, (float*)samples);
+    } else if (format == kSampleFormatI16) {
+        return wav_reader_read_i16(reader, num_samples, (int16_t*)samples);
+    } else if (format == kSampleFormatI24) {
+        return wav_reader_read_i24(reader, num_samples, (uint8_t*)samples);
+    } else {
+        return wav_reader_read_i32(reader, num_samples, (int32_t*)samples);
+    }
+}
+
+static void drop_page_cache(const char* path) {
+    int fd = open(path, O_RDONLY);
+
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+// read whole file at path, returns seconds from open to close, -1 on failure
+static double bench_read_file(const char* path, enum BenchMode mode, SampleFormat format,
+                              int64_t num_frames, struct BenchBuffers* buffers) {
+    if (uncached) {
+        drop_page_cache(path);
+    }
+
+    double start = get_time();
+    WavReader* reader = mode == kModeMmap ? wav_reader_open_mmap(path) : wav_reader_open(path);
+
+    if (reader == NULL) {
+        return -1;
+    }
+
+    if (mode == kModeSubset) {
+        // every other channel
+        int channels[256];
+        int num_read_channels = 0;
+
+        for (int c = 0; c < wav_reader_get_num_channels(reader); c += 2) {
+            channels[num_read_channels++] = c;
+        }
+
+        wav_reader_set_channels(reader, channels, num_read_channels);
+    }
+
+    int64_t done = 0;
+
+    while (done < num_frames) {
+        int ret = bench_read_block(reader, mode, format, buffers, done, BLOCK_FRAMES);
+
+        if (ret <= 0) {
+            break;
+        }
+
+        done += ret;
+    }
+
+    wav_reader_close(reader);
+    return done == num_frames ? get_time() - start : -1;
+}
+
+static struct BenchBuffers* bench_buffers_create(int num_channels) {
+    struct BenchBuffers* buffers = (struct BenchBuffers*)calloc(1, sizeof(struct BenchBuffers));
+    float* f32 = (float*)malloc((size_t)BLOCK_FRAMES * num_channels * sizeof(float));
+
+    for (int i = 0; i < BLOCK_FRAMES; i++) {
+        for (int c = 0; c < num_channels; c++) {
+            f32[i * num_channels + c] = 0.5f * sinf(i * 0.01f * (c + 1));
+        }
+    }
+
+    for (int k = 0; k < 4; k++) {
+        int bytes_per_sample = sample_format_get_bytes_per_sample((SampleFormat)k);
+        buffers->samples[k] = (char*)malloc((size_t)BLOCK_FRAMES * num_channels * sizeof(int32_t));
+
+        // planar buffers share storage with the interleaved block
+        for (int c = 0; c < num_channels; c++) {
+            buffers->planes[k][c] = buffers->samples[k] + (size_t)c * BLOCK_FRAMES * bytes_per_sample;
+        }
+    }
+
+    memcpy(buffers->samples[kSampleFormatF32], f32, (size_t)BLOCK_FRAMES * num_channels * sizeof(float));
+    convert_f32_to_i16(f32, BLOCK_FRAMES * num_channels, (int16_t*)buffers->samples[kSampleFormatI16]);
+    convert_f32_to_i32(f32, BLOCK_FRAMES * num_channels, (int32_t*)buffers->samples[kSampleFormatI32]);
+    convert_f32_to_i24(f32, BLOCK_FRAMES * num_channels, (uint8_t*)buffers->samples[kSampleFormatI24]);
+    free(f32);
+    return buffers;
+}
+
+static void bench_buffers_destroy(struct BenchBuffers* buffers) {
+    for (int k = 0; k < 4; k++) {
+        free(buffers->samples[k]);
+    }
+
+    free(buffers);
+}
+
+static int bench_file(SampleFormat file_format, int num_channels, int size_mb) {
+    static const SampleFormat io_formats[] = {
+        kSampleFormatF32, kSampleFormatI16, kSampleFormatI24, kSampleFormatI32
+    };
+    static const enum BenchMode write_modes[] = {kModeInterleaved, kModePlanar, kModeAsync};
+    static const enum BenchMode read_modes[] = {
+        kModeInterleaved, kModePlanar, kModeAt, kModeMmap, kModeSubset
+    };
+    char src_path[4096];
+    char dst_path[4096];
+    int block_align = num_channels * sample_format_get_bytes_per_sample(file_format);
+    int64_t num_frames = ((int64_t)size_mb << 20) / block_align;
+    int64_t bytes = num_frames * block_align;
+    struct BenchBuffers* buffers = bench_buffers_create(num_channels);
+    int ret = 0;
+
+    snprintf(src_path, sizeof(src_path), "%s/wavbench_%d_src.wav", tmp_dir, (int)getpid());
+    snprintf(dst_path, sizeof(dst_path), "%s/wavbench_%d_dst.wav", tmp_dir, (int)getpid());
+
+    // synthetic source file for reads
+    if (bench_write_file(src_path, kModeInterleaved, file_format, file_format, num_channels,
+                         num_frames, buffers) < 0) {
+        fprintf(stderr, "create %s failed (%s)\n", src_path, strerror(errno));
+        bench_buffers_destroy(buffers);
+        return -1;
+    }
+
+    for (int m = 0; run_write && m < (int)(sizeof(write_modes) / sizeof(write_modes[0])); m++) {
+        for (int f = 0; f < 4; f++) {
+            enum BenchMode mode = write_modes[m];
+            SampleFormat format = io_formats[f];
+            double best = 0;
+
+            if ((mode == kModePlanar && format == kSampleFormatI24)
+                    || (mode == kModeAsync && format != file_format)) {
+                continue;
+            }
+
+            for (int r = 0; r < repeat && ret == 0; r++) {
+                double seconds = bench_write_file(dst_path, mode, file_format, format,
+                                                  num_channels, num_frames, buffers);
+                ret = seconds < 0 ? -1 : 0;
+                best = r == 0 || seconds < best ? seconds : best;
+            }
+
+            if (ret == 0) {
+                report_io("write", mode, file_format, format, num_channels, num_frames, bytes, best);
+            }
+        }
+    }
+
+    for (int m = 0; run_read && m < (int)(sizeof(read_modes) / sizeof(read_modes[0])); m++) {
+        for (int f = 0; f < 4; f++) {
+            enum BenchMode mode = read_modes[m];
+            SampleFormat format = io_formats[f];
+            double best = 0;
+
+            if ((mode != kModeInterleaved && mode != kModeMmap && format == kSampleFormatI24)
+                    || (mode == kModeSubset && num_channels == 1)) {
+                continue;
+            }
+
+            for (int r = 0; r < repeat && ret == 0; r++) {
+                double seconds = bench_read_file(src_path, mode, format, num_frames, buffers);
+                ret = seconds < 0 ? -1 : 0;
+                best = r == 0 || seconds < best ? seconds : best;
+            }
+
+            if (ret == 0) {
+                report_io("read", mode, file_format, format, num_channels, num_frames, bytes, best);
+            }
+        }
+    }
+
+    if (ret != 0) {
+        fprintf(stderr, "benchmark of %s %d channels failed\n",
+                sample_format_get_str(file_format), num_channels);
+    }
+
+    unlink(src_path);
+    unlink(dst_path);
+    bench_buffers_destroy(buffers);
+    return ret;
+}
+
+int main(int argc, const char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        char* items[MAX_LIST_SIZE];
+        int num_items = 0;
+
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            print_help(argv[0]);
+            return 0;
+        } else if (strcmp(argv[i], "-u") == 0) {
+            uncached = 1;
+        } else if (i + 1 == argc) {
+            printf("option %s requires a value\n\n", argv[i]);
+            return -1;
+        } else if (strcmp(argv[i], "-d") == 0) {
+            tmp_dir = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0) {
+            json_file = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0) {
+            repeat = atoi(argv[++i]);
+
+            if (repeat <= 0) {
+                printf("invalid repeat %s\n\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-c") == 0) {
+            num_items = split_list((char*)argv[++i], items);
+            num_channel_list = num_items;
+
+            for (int k = 0; k < num_items; k++) {
+                channel_list[k] = atoi(items[k]);
+
+                if (channel_list[k] <= 0 || channel_list[k] > 256) {
+                    printf("invalid channels %s\n\n", items[k]);
+                    return -1;
+                }
+            }
+        } else if (strcmp(argv[i], "-f") == 0) {
+            num_items = split_list((char*)argv[++i], items);
+            num_format_list = num_items;
+
+            for (int k = 0; k < num_items; k++) {
+                format_list[k] = parse_format(items[k]);
+
+                if (format_list[k] == kSampleFormatInvalid) {
+                    printf("invalid sample format %s\n\n", items[k]);
+                    return -1;
+                }
+            }
+        } else if (strcmp(argv[i], "-m") == 0) {
+            num_items = split_list((char*)argv[++i], items);
+            num_size_list = num_items;
+
+            for (int k = 0; k < num_items; k++) {
+                size_list[k] = atoi(items[k]);
+
+                if (size_list[k] <= 0) {
+                    printf("invalid size %s\n\n", items[k]);
+                    return -1;
+                }
+            }
+        } else if (strcmp(argv[i], "-t") == 0) {
+            num_items = split_list((char*)argv[++i], items);
+            run_convert = run_write = run_read = 0;
+
+            for (int k = 0; k < num_items; k++) {
+                if (strcmp(items[k], "convert") == 0) {
+                    run_convert = 1;
+                } else if (strcmp(items[k], "write") == 0) {
+                    run_write = 1;
+                } else if (strcmp(items[k], "read") == 0) {
+                    run_read = 1;
+                } else {
+                    printf("invalid test %s\n\n", items[k]);
+                    return -1;
+                }
+            }
+        } else {
+            printf("unknown option %s\n\n", argv[i]);
+            return -1;
+        }
+
+        if (num_items < 0) {
+            printf("too many items in %s\n\n", argv[i]);
+            return -1;
+        }
+    }
+
+    fp_json = json_file != NULL ? fopen(json_file, "w") : stdout;
+
+    if (fp_json == NULL) {
+        printf("create json file %s failed (%s)\n", json_file, strerror(errno));
+        return -1;
+    }
+
+    int ret = 0;
+    report_begin();
+
+    if (run_convert) {
+        bench_convert();
+    }
+
+    for (int s = 0; (run_write || run_read) && s < num_size_list; s++) {
+        for (int f = 0; f < num_format_list; f++) {
+            for (int c = 0; c < num_channel_list; c++) {
+                fprintf(stderr, "benchmark %s %d channels %d MB\n",
+                        sample_format_get_str(format_list[f]), channel_list[c], size_list[s]);
+
+                if (bench_file(format_list[f], channel_list[c], size_list[s]) != 0) {
+                    ret = -1;
+                }
+            }
+        }
+    }
+
+    report_end();
+
+    if (fp_json != stdout) {
+        fclose(fp_json);
+    }
+
+    return ret;
+}
@@ -0,0 +1,125 @@
+#include "wav_file.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char* out_file = NULL;
+static SampleFormat sample_format = kSampleFormatInvalid;
+
+static void print_help(const char* program) {
+    printf("Usage: %s [options] WAV_FILE...\n", program);
+    printf("  -h, --help            show this help message and exit\n");
+    printf("  -o WAV_FILE           output wav file\n");
+    printf("  -f SAMPLE_FORMAT      sample format [i16|i24|i32|f32], default the same as the\n");
+    printf("                        first wav file\n");
+    printf("\n");
+    printf("  wav files are appended in order and must have the channels of the first one,\n");
+    printf("  files of another sample rate are resampled, payloads of the output format are\n");
+    printf("  copied inside the kernel\n");
+}
+
+int main(int argc, const char* argv[]) {
+    const char** in_files = (const char**)calloc(argc, sizeof(const char*));
+    int num_in_files = 0;
+
+    if (argc < 2 || in_files == NULL) {
+        print_help(argv[0]);
+        free(in_files);
+        return -1;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            print_help(argv[0]);
+            free(in_files);
+            return 0;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_file = argv[++i];
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            const char* format = argv[++i];
+
+            if (strcmp(format, "i16") == 0) {
+                sample_format = kSampleFormatI16;
+            } else if (strcmp(format, "i24") == 0) {
+                sample_format = kSampleFormatI24;
+            } else if (strcmp(format, "i32") == 0) {
+                sample_format = kSampleFormatI32;
+            } else if (strcmp(format, "f32") == 0) {
+                sample_format = kSampleFormatF32;
+            } else {
+                printf("invalid sample format %s\n\n", format);
+                free(in_files);
+                return -1;
+            }
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            printf("unknown option %s\n\n", argv[i]);
+            free(in_files);
+            return -1;
+        } else {
+            in_files[num_in_files++] = argv[i];
+        }
+    }
+
+    if (out_file == NULL || num_in_files == 0) {
+        printf("output wav file and input wav files are required\n");
+        free(in_files);
+        return -1;
+    }
+
+    WavWriter* writer = NULL;
+    int num_channels = 0;
+    int sample_rate = 0;
+    int ret = 0;
+
+    for (int k = 0; ret == 0 && k < num_in_files; k++) {
+        WavReader* reader = wav_reader_open(in_files[k]);
+
+        if (reader == NULL) {
+            printf("open wav file %s failed\n", in_files[k]);
+            ret = -1;
+            break;
+        }
+
+        // output takes channels, sample rate and format of the first file
+        if (writer == NULL) {
+            num_channels = wav_reader_get_num_channels(reader);
+            sample_rate = wav_reader_get_sample_rate(reader);
+
+            if (sample_format == kSampleFormatInvalid) {
+                sample_format = wav_reader_get_sample_format(reader);
+            }
+
+            writer = wav_writer_open(out_file, num_channels, sample_rate, sample_format);
+
+            if (writer == NULL) {
+                printf("create wav file %s failed (%s)\n", out_file, strerror(errno));
+                ret = -1;
+            }
+        }
+
+        if (ret == 0 && wav_reader_get_num_channels(reader) != num_channels) {
+            printf("wav file %s has %d channels, %d expected\n", in_files[k],
+                   wav_reader_get_num_channels(reader), num_channels);
+            ret = -1;
+        }
+
+        if (ret == 0 && wav_reader_get_sample_rate(reader) != sample_rate
+                && wav_reader_set_output_rate(reader, sample_rate) != 0) {
+            printf("resample wav file %s failed\n", in_files[k]);
+            ret = -1;
+        }
+
+        if (ret == 0 && wav_writer_copy_samples(writer, reader, -1)
+                != wav_reader_get_num_samples(reader)) {
+            printf("append wav file %s failed\n", in_files[k]);
+            ret = -1;
+        }
+
+        wav_reader_close(reader);
+    }
+
+    wav_writer_close(writer);
+    free(in_files);
+    return ret;
+}
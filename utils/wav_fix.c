@@ -0,0 +1,66 @@
+#include "wav_file.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+static int use_checkpoint = 0;
+static int dry_run = 0;
+
+static void print_help(const char* program) {
+    printf("Usage: %s [options] WAV_FILE...\n", program);
+    printf("  -h, --help            show this help message and exit\n");
+    printf("  -c                    keep the size of the last header checkpoint if the file is\n");
+    printf("                        longer, e.g. preallocated files\n");
+    printf("  -n                    report frames found, do not modify files\n");
+    printf("\n");
+    printf("  header sizes of files left by crashed recorders are rewritten in place,\n");
+    printf("  sample data is not copied\n");
+}
+
+int main(int argc, const char* argv[]) {
+    int num_files = 0;
+    int ret = 0;
+
+    if (argc < 2) {
+        print_help(argv[0]);
+        return -1;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            print_help(argv[0]);
+            return 0;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            use_checkpoint = 1;
+        } else if (strcmp(argv[i], "-n") == 0) {
+            dry_run = 1;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            printf("unknown option %s\n\n", argv[i]);
+            return -1;
+        }
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            continue;
+        }
+
+        int64_t num_samples = wav_repair(argv[i], use_checkpoint, dry_run);
+        num_files++;
+
+        if (num_samples < 0) {
+            printf("repair wav file %s failed\n", argv[i]);
+            ret = -1;
+        } else {
+            printf("%s: %" PRId64 " frames%s\n", argv[i], num_samples, dry_run ? "" : " repaired");
+        }
+    }
+
+    if (num_files == 0) {
+        printf("no wav file given\n");
+        return -1;
+    }
+
+    return ret;
+}
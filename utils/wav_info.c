@@ -1,28 +1,61 @@
 #include "wav_file.h"
+#include "wav_peaks.h"
+#include "wav_stats.h"
 #include <assert.h>
+#include <dirent.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#define PATH_QUEUE_SIZE     4096
+#define OUTPUT_BUFFER_SIZE  (256 * 1024)
+#define MAX_RECORD_SIZE     (32 * 1024)
+
+static const char* list_file = NULL;
+static const char* out_file = NULL;
+static int json_output = 0;
+static int num_jobs = 0;
+static int stats_mode = 0;
+static int peaks_mode = 0;
+static double target_loudness = NAN;
+
 static void print_help(const char* program) {
     printf("Usage: %s wav_file\n", program);
+    printf("       %s [options] PATH...\n", program);
+    printf("  -h, --help            show this help message and exit\n");
+    printf("  -l LIST_FILE          read paths from LIST_FILE, one per line, - for stdin\n");
+    printf("  -o MANIFEST_FILE      write manifest to MANIFEST_FILE, default stdout\n");
+    printf("  -f FORMAT             manifest format csv or json, default csv\n");
+    printf("  -j NUM_JOBS           parse headers on NUM_JOBS threads, default number of cpus\n");
+    printf("  --stats               measure peak, true peak, rms, dc, clips and loudness of each\n");
+    printf("                        wav file, -j splits each file over NUM_JOBS threads\n");
+    printf("  -t TARGET_LUFS        with --stats, print the wavamp gain reaching TARGET_LUFS\n");
+    printf("  --peaks               write waveform overview index WAV_FILE.peaks of each wav file\n");
+    printf("\n");
+    printf("  directories are walked recursively for .wav files, manifest rows are written\n");
+    printf("  in completion order\n");
 }
 
-int main(int argc, const char* argv[]) {
-    if (argc != 2) {
-        print_help(argv[0]);
-        return -1;
-    }
-
-    if (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
-        print_help(argv[0]);
-        return 0;
+static const char* get_format_name(SampleFormat format) {
+    if (format == kSampleFormatF32) {
+        return "float32";
+    } else if (format == kSampleFormatI16) {
+        return "int16";
+    } else if (format == kSampleFormatI24) {
+        return "int24";
     }
 
-    const char* wav_file = argv[1];
+    return "int32";
+}
 
+static int print_info(const char* wav_file) {
     if (access(wav_file, R_OK)) {
         printf("read wav file %s failed (%s)\n", wav_file, strerror(errno));
         return -1;
@@ -39,14 +72,551 @@ int main(int argc, const char* argv[]) {
     int sample_bits = wav_reader_get_bits_per_sample(reader);
 
     printf("Wav Information of %s\n", wav_file);
-    printf("         Audio Format: %s\n",
-           format == kSampleFormatF32 ? "float32" : (format == kSampleFormatI16 ? "int16" : "int32"));
+    printf("         Audio Format: %s\n", get_format_name(format));
     printf("      Number Channels: %d\n", wav_reader_get_num_channels(reader));
     printf("          Sample Rate: %d\n", wav_reader_get_sample_rate(reader));
     printf("      Bits Per Sample: %d\n", sample_bits);
     printf("Valid Bits Per Sample: %d\n", wav_reader_get_valid_bits_per_sample(reader));
-    printf("       Number Samples: %d\n", wav_reader_get_num_samples(reader));
+    printf("       Number Samples: %" PRId64 "\n", wav_reader_get_num_samples(reader));
 
     wav_reader_close(reader);
     return 0;
 }
+
+static double get_db(double x) {
+    return x > 0. ? 20. * log10(x) : -HUGE_VAL;
+}
+
+static int print_stats(const char* wav_file) {
+    WavReader* reader = wav_reader_open(wav_file);
+
+    if (reader == NULL) {
+        printf("open wav file %s failed\n", wav_file);
+        return -1;
+    }
+
+    WavStats* stats = wav_stats_measure(reader, num_jobs);
+    wav_reader_close(reader);
+
+    if (stats == NULL) {
+        printf("measure wav file %s failed\n", wav_file);
+        return -1;
+    }
+
+    printf("Wav Statistics of %s\n", wav_file);
+    printf("  channel   peak dBFS  true peak dBTP    rms dBFS          dc       clips\n");
+
+    for (int c = 0; c < wav_stats_get_num_channels(stats); c++) {
+        WavChannelStats ch;
+        wav_stats_get_channel(stats, c, &ch);
+        printf("  %7d %11.2f %14.2f %11.2f %11.6f %11" PRId64 "\n", c, get_db(ch.peak),
+               get_db(ch.true_peak), get_db(ch.rms), ch.dc, ch.num_clips);
+    }
+
+    double loudness = wav_stats_get_loudness(stats);
+    printf("  Integrated Loudness: %.2f LUFS\n", loudness);
+
+    // linear gain for wavamp -a, limited to its range
+    if (!isnan(target_loudness) && isfinite(loudness)) {
+        double gain = pow(10., (target_loudness - loudness) / 20.);
+        gain = gain < 1e6 ? gain : 1e6;
+        printf("  Gain to %.2f LUFS: %.6f (%+.2f dB)\n", target_loudness, gain,
+               target_loudness - loudness);
+    }
+
+    wav_stats_destroy(stats);
+    return 0;
+}
+
+static int write_peaks(const char* wav_file) {
+    WavReader* reader = wav_reader_open(wav_file);
+
+    if (reader == NULL) {
+        printf("open wav file %s failed\n", wav_file);
+        return -1;
+    }
+
+    WavPeaks* peaks = wav_peaks_build(reader, NULL, 0);
+    wav_reader_close(reader);
+
+    size_t len = strlen(wav_file);
+    char* peaks_file = (char*)malloc(len + sizeof(".peaks"));
+
+    if (peaks == NULL || peaks_file == NULL) {
+        printf("index wav file %s failed\n", wav_file);
+        wav_peaks_destroy(peaks);
+        free(peaks_file);
+        return -1;
+    }
+
+    memcpy(peaks_file, wav_file, len);
+    memcpy(peaks_file + len, ".peaks", sizeof(".peaks"));
+    int ret = wav_peaks_save(peaks, peaks_file);
+
+    if (ret != 0) {
+        printf("write peak index %s failed\n", peaks_file);
+    }
+
+    wav_peaks_destroy(peaks);
+    free(peaks_file);
+    return ret;
+}
+
+// bounded queue of paths from the directory walk to the header parsing threads
+struct PathQueue {
+    char* paths[PATH_QUEUE_SIZE];
+    int head;
+    int count;
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+};
+
+static void path_queue_push(struct PathQueue* queue, const char* path) {
+    char* item = strdup(path);
+
+    if (item == NULL) {
+        fprintf(stderr, "out of memory for %s\n", path);
+        return;
+    }
+
+    pthread_mutex_lock(&queue->lock);
+
+    while (queue->count == PATH_QUEUE_SIZE) {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+
+    queue->paths[(queue->head + queue->count) % PATH_QUEUE_SIZE] = item;
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// returns next path to be freed by caller, NULL once the queue is closed and drained
+static char* path_queue_pop(struct PathQueue* queue) {
+    char* item = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+
+    while (queue->count == 0 && !queue->closed) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+
+    if (queue->count > 0) {
+        item = queue->paths[queue->head];
+        queue->head = (queue->head + 1) % PATH_QUEUE_SIZE;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+static void path_queue_close(struct PathQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = 1;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static int has_wav_suffix(const char* name) {
+    size_t len = strlen(name);
+    return len > 4 && strcasecmp(name + len - 4, ".wav") == 0;
+}
+
+// queue .wav files below dir, symbolic links to directories are not followed
+static void walk_dir(struct PathQueue* queue, const char* dir) {
+    DIR* dp = opendir(dir);
+
+    if (dp == NULL) {
+        fprintf(stderr, "open directory %s failed (%s)\n", dir, strerror(errno));
+        return;
+    }
+
+    size_t dir_len = strlen(dir);
+    struct dirent* entry = NULL;
+
+    while ((entry = readdir(dp)) != NULL) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+            continue;
+        }
+
+        size_t name_len = strlen(entry->d_name);
+        char* path = (char*)malloc(dir_len + name_len + 2);
+
+        if (path == NULL) {
+            break;
+        }
+
+        memcpy(path, dir, dir_len);
+        path[dir_len] = '/';
+        memcpy(path + dir_len + 1, entry->d_name, name_len + 1);
+
+        // d_type saves a stat per entry, filesystems not filling it return DT_UNKNOWN
+        int is_dir = entry->d_type == DT_DIR;
+        int is_file = entry->d_type == DT_REG;
+        struct stat st;
+
+        if ((entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) && stat(path, &st) == 0) {
+            is_dir = entry->d_type == DT_UNKNOWN && S_ISDIR(st.st_mode);
+            is_file = S_ISREG(st.st_mode);
+        }
+
+        if (is_dir) {
+            walk_dir(queue, path);
+        } else if (is_file && has_wav_suffix(entry->d_name)) {
+            path_queue_push(queue, path);
+        }
+
+        free(path);
+    }
+
+    closedir(dp);
+}
+
+static void add_path(struct PathQueue* queue, const char* path) {
+    struct stat st;
+
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        walk_dir(queue, path);
+    } else {
+        path_queue_push(queue, path);
+    }
+}
+
+static void add_list(struct PathQueue* queue, const char* filename) {
+    FILE* fp = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r");
+
+    if (fp == NULL) {
+        fprintf(stderr, "open list file %s failed (%s)\n", filename, strerror(errno));
+        return;
+    }
+
+    char* line = NULL;
+    size_t line_size = 0;
+    ssize_t len = 0;
+
+    while ((len = getline(&line, &line_size, fp)) > 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+
+        if (len > 0) {
+            add_path(queue, line);
+        }
+    }
+
+    free(line);
+
+    if (fp != stdin) {
+        fclose(fp);
+    }
+}
+
+// manifest shared by the threads, each thread appends whole rows from its own buffer
+struct Manifest {
+    FILE* fp;
+    int json;
+    int64_t num_rows;
+    int64_t num_failed;
+    pthread_mutex_t lock;
+};
+
+struct ScanJob {
+    struct PathQueue* queue;
+    struct Manifest* manifest;
+    char* buf;
+    size_t size;
+    int num_rows;
+    int num_failed;
+    int started;
+};
+
+static size_t put_escaped_path(char* p, const char* path, int json) {
+    char* begin = p;
+    int quote = json || strpbrk(path, ",\"\r\n") != NULL;
+
+    if (quote) {
+        *p++ = '"';
+    }
+
+    for (const unsigned char* s = (const unsigned char*)path; *s != '\0'; s++) {
+        if (*s == '"') {
+            // json escapes quote with backslash, csv doubles it
+            *p++ = json ? '\\' : '"';
+            *p++ = '"';
+        } else if (json && *s == '\\') {
+            *p++ = '\\';
+            *p++ = '\\';
+        } else if (json && *s < 0x20) {
+            p += sprintf(p, "\\u%04x", *s);
+        } else {
+            *p++ = (char)*s;
+        }
+    }
+
+    if (quote) {
+        *p++ = '"';
+    }
+
+    return p - begin;
+}
+
+static void scan_job_flush(struct ScanJob* job) {
+    struct Manifest* manifest = job->manifest;
+
+    pthread_mutex_lock(&manifest->lock);
+
+    if (job->size > 0) {
+        // json rows start with a separator, the first row of the manifest has none
+        size_t skip = manifest->json && manifest->num_rows == 0 ? 2 : 0;
+        fwrite(job->buf + skip, 1, job->size - skip, manifest->fp);
+    }
+
+    manifest->num_rows += job->num_rows;
+    manifest->num_failed += job->num_failed;
+    pthread_mutex_unlock(&manifest->lock);
+
+    job->size = 0;
+    job->num_rows = 0;
+    job->num_failed = 0;
+}
+
+static void scan_job_add(struct ScanJob* job, const char* path, WavReader* reader) {
+    if (strlen(path) * 6 + 256 > MAX_RECORD_SIZE) {
+        fprintf(stderr, "path %s is too long\n", path);
+        job->num_failed++;
+        return;
+    }
+
+    if (job->size + MAX_RECORD_SIZE > OUTPUT_BUFFER_SIZE) {
+        scan_job_flush(job);
+    }
+
+    int num_channels = wav_reader_get_num_channels(reader);
+    int sample_rate = wav_reader_get_sample_rate(reader);
+    int sample_bits = wav_reader_get_bits_per_sample(reader);
+    int64_t num_samples = wav_reader_get_num_samples(reader);
+    const char* format = get_format_name(wav_reader_get_sample_format(reader));
+    double duration = (double)num_samples / sample_rate;
+    char* p = job->buf + job->size;
+
+    if (job->manifest->json) {
+        p += sprintf(p, ",\n  {\"path\": ");
+        p += put_escaped_path(p, path, 1);
+        p += sprintf(p, ", \"sample_rate\": %d, \"num_channels\": %d, \"format\": \"%s\", "
+                     "\"bits_per_sample\": %d, \"num_samples\": %" PRId64 ", \"duration\": %.6f}",
+                     sample_rate, num_channels, format, sample_bits, num_samples, duration);
+    } else {
+        p += put_escaped_path(p, path, 0);
+        p += sprintf(p, ",%d,%d,%s,%d,%" PRId64 ",%.6f\n",
+                     sample_rate, num_channels, format, sample_bits, num_samples, duration);
+    }
+
+    job->size = p - job->buf;
+    job->num_rows++;
+}
+
+static void* scan_job_run(void* arg) {
+    struct ScanJob* job = (struct ScanJob*)arg;
+    char* path = NULL;
+
+    while ((path = path_queue_pop(job->queue)) != NULL) {
+        // header is parsed from one positional read of the leading bytes
+        WavReader* reader = wav_reader_open(path);
+
+        if (reader != NULL) {
+            scan_job_add(job, path, reader);
+            wav_reader_close(reader);
+        } else {
+            fprintf(stderr, "open wav file %s failed\n", path);
+            job->num_failed++;
+        }
+
+        free(path);
+    }
+
+    scan_job_flush(job);
+    return NULL;
+}
+
+static int scan_batch(const char* const* paths, int num_paths) {
+    struct PathQueue queue;
+    struct Manifest manifest;
+    FILE* fp = out_file != NULL ? fopen(out_file, "w") : stdout;
+
+    if (fp == NULL) {
+        fprintf(stderr, "create manifest file %s failed (%s)\n", out_file, strerror(errno));
+        return -1;
+    }
+
+    memset(&queue, 0, sizeof(queue));
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.not_empty, NULL);
+    pthread_cond_init(&queue.not_full, NULL);
+
+    memset(&manifest, 0, sizeof(manifest));
+    manifest.fp = fp;
+    manifest.json = json_output;
+    pthread_mutex_init(&manifest.lock, NULL);
+
+    if (json_output) {
+        fprintf(fp, "[\n");
+    } else {
+        fprintf(fp, "path,sample_rate,num_channels,format,bits_per_sample,num_samples,duration\n");
+    }
+
+    struct ScanJob* jobs = (struct ScanJob*)calloc(num_jobs, sizeof(struct ScanJob));
+    pthread_t* threads = (pthread_t*)calloc(num_jobs, sizeof(pthread_t));
+    int num_started = 0;
+
+    for (int k = 0; jobs != NULL && threads != NULL && k < num_jobs; k++) {
+        jobs[k].queue = &queue;
+        jobs[k].manifest = &manifest;
+        jobs[k].buf = (char*)malloc(OUTPUT_BUFFER_SIZE);
+
+        if (jobs[k].buf == NULL) {
+            break;
+        }
+
+        jobs[k].started = pthread_create(&threads[k], NULL, scan_job_run, &jobs[k]) == 0;
+        num_started += jobs[k].started;
+    }
+
+    if (num_started == 0) {
+        fprintf(stderr, "start header parsing threads failed\n");
+        path_queue_close(&queue);
+    } else {
+        for (int i = 0; i < num_paths; i++) {
+            add_path(&queue, paths[i]);
+        }
+
+        if (list_file != NULL) {
+            add_list(&queue, list_file);
+        }
+
+        path_queue_close(&queue);
+    }
+
+    for (int k = 0; jobs != NULL && threads != NULL && k < num_jobs; k++) {
+        if (jobs[k].started) {
+            pthread_join(threads[k], NULL);
+        }
+
+        free(jobs[k].buf);
+    }
+
+    if (json_output) {
+        fprintf(fp, manifest.num_rows > 0 ? "\n]\n" : "]\n");
+    }
+
+    if (fp != stdout) {
+        fclose(fp);
+    }
+
+    free(jobs);
+    free(threads);
+    pthread_mutex_destroy(&manifest.lock);
+    pthread_mutex_destroy(&queue.lock);
+    pthread_cond_destroy(&queue.not_empty);
+    pthread_cond_destroy(&queue.not_full);
+
+    fprintf(stderr, "%" PRId64 " wav files indexed, %" PRId64 " failed\n",
+            manifest.num_rows, manifest.num_failed);
+    return num_started > 0 && manifest.num_failed == 0 ? 0 : -1;
+}
+
+int main(int argc, const char* argv[]) {
+    const char** paths = (const char**)calloc(argc, sizeof(const char*));
+    int num_paths = 0;
+    int batch = 0;
+
+    if (argc < 2 || paths == NULL) {
+        print_help(argv[0]);
+        free(paths);
+        return -1;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            print_help(argv[0]);
+            free(paths);
+            return 0;
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            list_file = argv[++i];
+            batch = 1;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_file = argv[++i];
+            batch = 1;
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            json_output = strcmp(argv[++i], "json") == 0;
+            batch = 1;
+
+            if (!json_output && strcmp(argv[i], "csv") != 0) {
+                printf("unknown manifest format %s\n\n", argv[i]);
+                free(paths);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            num_jobs = atoi(argv[++i]);
+            batch = 1;
+
+            if (num_jobs <= 0) {
+                printf("invalid number of jobs\n\n");
+                free(paths);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats_mode = 1;
+        } else if (strcmp(argv[i], "--peaks") == 0) {
+            peaks_mode = 1;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            target_loudness = atof(argv[++i]);
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            printf("unknown option %s\n\n", argv[i]);
+            free(paths);
+            return -1;
+        } else {
+            paths[num_paths++] = argv[i];
+        }
+    }
+
+    // statistics and peak indexes decode every file in argument order, statistics split
+    //   each file over num_jobs threads
+    if (stats_mode || peaks_mode) {
+        int ret = 0;
+
+        if (num_jobs == 0) {
+            long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            num_jobs = num_cpus > 0 ? (int)num_cpus : 1;
+        }
+
+        for (int i = 0; i < num_paths; i++) {
+            ret |= stats_mode ? print_stats(paths[i]) : 0;
+            ret |= peaks_mode ? write_peaks(paths[i]) : 0;
+        }
+
+        free(paths);
+        return ret;
+    }
+
+    struct stat st;
+
+    // a single wav file prints its information, anything else builds a manifest
+    if (!batch && num_paths == 1 && (stat(paths[0], &st) != 0 || !S_ISDIR(st.st_mode))) {
+        int ret = print_info(paths[0]);
+        free(paths);
+        return ret;
+    }
+
+    if (num_jobs == 0) {
+        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_jobs = num_cpus > 0 ? (int)num_cpus : 1;
+    }
+
+    int ret = scan_batch(paths, num_paths);
+    free(paths);
+    return ret;
+}
@@ -0,0 +1,210 @@
+#include "wav_file.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define MAX_NUM_RANGES  4096
+
+static const char* in_file = NULL;
+static const char* out_prefix = NULL;
+static SampleFormat sample_format = kSampleFormatInvalid;
+static double duration = 0.;
+static int64_t ranges[2 * MAX_NUM_RANGES];
+static int num_ranges = 0;
+
+static void print_help(const char* program) {
+    printf("Usage: %s [options]\n", program);
+    printf("  -h, --help            show this help message and exit\n");
+    printf("  -i WAV_FILE           wav file\n");
+    printf("  -o OUTPUT_PREFIX      segments are written to OUTPUT_PREFIX_000.wav, ...,\n");
+    printf("                        default WAV_FILE without .wav\n");
+    printf("  -d SECONDS            split into segments of SECONDS\n");
+    printf("  -r RANGES             comma separated frame ranges START-END, END excluded\n");
+    printf("  -f SAMPLE_FORMAT      sample format [i16|i24|i32|f32], default the same as wav file\n");
+    printf("\n");
+    printf("  payloads of segments in the format of wav file are copied inside the kernel\n");
+}
+
+static int parse_ranges(char* str) {
+    for (char* item = strtok(str, ","); item != NULL; item = strtok(NULL, ",")) {
+        char* end = NULL;
+
+        if (num_ranges == MAX_NUM_RANGES) {
+            printf("too many frame ranges\n\n");
+            return -1;
+        }
+
+        ranges[2 * num_ranges] = strtoll(item, &end, 10);
+
+        if (*end != '-') {
+            printf("invalid frame range %s\n\n", item);
+            return -1;
+        }
+
+        ranges[2 * num_ranges + 1] = strtoll(end + 1, &end, 10);
+
+        if (*end != '\0' || ranges[2 * num_ranges] < 0
+                || ranges[2 * num_ranges + 1] <= ranges[2 * num_ranges]) {
+            printf("invalid frame range %s\n\n", item);
+            return -1;
+        }
+
+        num_ranges++;
+    }
+
+    return 0;
+}
+
+// write frames [begin, end) of reader to segment index
+static int write_segment(WavReader* reader, const char* prefix, int index, int64_t begin,
+                         int64_t end) {
+    size_t len = strlen(prefix);
+    char* out_file = (char*)malloc(len + 32);
+
+    if (out_file == NULL) {
+        return -1;
+    }
+
+    snprintf(out_file, len + 32, "%s_%03d.wav", prefix, index);
+
+    WavWriter* writer = wav_writer_open(out_file, wav_reader_get_num_channels(reader),
+                                        wav_reader_get_sample_rate(reader), sample_format);
+    int ret = 0;
+
+    if (writer == NULL) {
+        printf("create wav file %s failed (%s)\n", out_file, strerror(errno));
+        ret = -1;
+    } else if (wav_reader_seek(reader, begin, SEEK_SET) != 0
+               || wav_writer_copy_samples(writer, reader, end - begin) != end - begin) {
+        printf("write wav file %s failed\n", out_file);
+        ret = -1;
+    }
+
+    wav_writer_close(writer);
+    free(out_file);
+    return ret;
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc < 2) {
+        print_help(argv[0]);
+        return -1;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            print_help(argv[0]);
+            return 0;
+        } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+            in_file = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out_prefix = argv[++i];
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            duration = atof(argv[++i]);
+
+            if (duration <= 0.) {
+                printf("invalid segment duration\n\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if (parse_ranges((char*)argv[++i]) != 0) {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            const char* format = argv[++i];
+
+            if (strcmp(format, "i16") == 0) {
+                sample_format = kSampleFormatI16;
+            } else if (strcmp(format, "i24") == 0) {
+                sample_format = kSampleFormatI24;
+            } else if (strcmp(format, "i32") == 0) {
+                sample_format = kSampleFormatI32;
+            } else if (strcmp(format, "f32") == 0) {
+                sample_format = kSampleFormatF32;
+            } else {
+                printf("invalid sample format %s\n\n", format);
+                return -1;
+            }
+        } else {
+            printf("unknown option %s\n\n", argv[i]);
+            return -1;
+        }
+    }
+
+    if (in_file == NULL || (duration <= 0. && num_ranges == 0)) {
+        printf("wav file and segment duration or frame ranges are required\n");
+        return -1;
+    }
+
+    if (access(in_file, R_OK)) {
+        printf("read wav file %s failed (%s)\n", in_file, strerror(errno));
+        return -1;
+    }
+
+    WavReader* reader = wav_reader_open(in_file);
+
+    if (reader == NULL) {
+        printf("open wav file %s failed\n", in_file);
+        return -1;
+    }
+
+    // default prefix is the input path without .wav suffix
+    size_t len = strlen(in_file);
+    char* prefix = (char*)malloc(len + 1);
+    int64_t num_samples = wav_reader_get_num_samples(reader);
+    int ret = 0;
+
+    if (prefix == NULL || num_samples < 0) {
+        printf("split wav file %s failed\n", in_file);
+        wav_reader_close(reader);
+        free(prefix);
+        return -1;
+    }
+
+    if (out_prefix != NULL) {
+        strcpy(prefix, out_prefix);
+    } else {
+        strcpy(prefix, in_file);
+
+        if (len > 4 && strcasecmp(prefix + len - 4, ".wav") == 0) {
+            prefix[len - 4] = '\0';
+        }
+    }
+
+    if (sample_format == kSampleFormatInvalid) {
+        sample_format = wav_reader_get_sample_format(reader);
+    }
+
+    if (num_ranges > 0) {
+        for (int k = 0; ret == 0 && k < num_ranges; k++) {
+            int64_t end = ranges[2 * k + 1] < num_samples ? ranges[2 * k + 1] : num_samples;
+
+            if (ranges[2 * k] >= end) {
+                printf("frame range %" PRId64 "-%" PRId64 " is beyond %" PRId64 " frames\n",
+                       ranges[2 * k], ranges[2 * k + 1], num_samples);
+                ret = -1;
+                break;
+            }
+
+            ret = write_segment(reader, prefix, k, ranges[2 * k], end);
+        }
+    } else {
+        int64_t segment_samples = (int64_t)(duration * wav_reader_get_sample_rate(reader));
+        segment_samples = segment_samples > 0 ? segment_samples : 1;
+
+        for (int64_t begin = 0, k = 0; ret == 0 && begin < num_samples;
+                begin += segment_samples, k++) {
+            int64_t end = num_samples - begin < segment_samples ? num_samples
+                          : begin + segment_samples;
+            ret = write_segment(reader, prefix, (int)k, begin, end);
+        }
+    }
+
+    wav_reader_close(reader);
+    free(prefix);
+    return ret;
+}
@@ -0,0 +1,1864 @@
+#include "wav_convert.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONVERT_X86 1
+#include <immintrin.h>
+#endif
+
+/* scalar kernels */
+
+static void f32_to_i16_scalar(const float* src, int count, int16_t* dst) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = sample_f32_to_i16(src[i]);
+    }
+}
+
+static void i16_to_f32_scalar(const int16_t* src, int count, float* dst) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = sample_i16_to_f32(src[i]);
+    }
+}
+
+static void f32_to_i32_scalar(const float* src, int count, int32_t* dst) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = sample_f32_to_i32(src[i]);
+    }
+}
+
+static void i32_to_f32_scalar(const int32_t* src, int count, float* dst) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = sample_i32_to_f32(src[i]);
+    }
+}
+
+static void i16_to_i32_scalar(const int16_t* src, int count, int32_t* dst) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = sample_i16_to_i32(src[i]);
+    }
+}
+
+static void i32_to_i16_scalar(const int32_t* src, int count, int16_t* dst) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = sample_i32_to_i16(src[i]);
+    }
+}
+
+/* packed 24 bit scalar kernels, 24 bit samples are the top 3 bytes of left-justified int32 */
+
+static void i24_to_i32_scalar(const uint8_t* src, int count, int32_t* dst) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = sample_i24_to_i32(src + 3 * i);
+    }
+}
+
+static void i32_to_i24_scalar(const int32_t* src, int count, uint8_t* dst) {
+    for (int i = 0; i < count; i++) {
+        sample_i32_to_i24(src[i], dst + 3 * i);
+    }
+}
+
+static void i24_to_f32_scalar(const uint8_t* src, int count, float* dst) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = sample_i32_to_f32(sample_i24_to_i32(src + 3 * i));
+    }
+}
+
+static void f32_to_i24_scalar(const float* src, int count, uint8_t* dst) {
+    for (int i = 0; i < count; i++) {
+        sample_i32_to_i24(sample_f32_to_i32(src[i]), dst + 3 * i);
+    }
+}
+
+static void i24_to_i16_scalar(const uint8_t* src, int count, int16_t* dst) {
+    for (int i = 0; i < count; i++) {
+        dst[i] = (int16_t)(src[3 * i + 1] | (src[3 * i + 2] << 8));
+    }
+}
+
+static void i16_to_i24_scalar(const int16_t* src, int count, uint8_t* dst) {
+    for (int i = 0; i < count; i++) {
+        dst[3 * i] = 0;
+        dst[3 * i + 1] = (uint8_t)src[i];
+        dst[3 * i + 2] = (uint8_t)(src[i] >> 8);
+    }
+}
+
+#ifdef CONVERT_X86
+
+/* sse2 kernels, 8 samples per iteration */
+
+__attribute__((target("sse2")))
+static void f32_to_i16_sse2(const float* src, int count, int16_t* dst) {
+    const __m128 scale = _mm_set1_ps(32767.f);
+    const __m128 hi = _mm_set1_ps(32767.f);
+    const __m128 lo = _mm_set1_ps(-32768.f);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+        a = _mm_max_ps(_mm_min_ps(a, hi), lo);
+        b = _mm_max_ps(_mm_min_ps(b, hi), lo);
+        __m128i v = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+        _mm_storeu_si128((__m128i*)(dst + i), v);
+    }
+
+    f32_to_i16_scalar(src + i, count - i, dst + i);
+}
+
+__attribute__((target("sse2")))
+static void i16_to_f32_sse2(const int16_t* src, int count, float* dst) {
+    const __m128 scale = _mm_set1_ps(1.f / 32768.f);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        // sign extend by placing sample in the high half and shifting back
+        __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(a), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+    }
+
+    i16_to_f32_scalar(src + i, count - i, dst + i);
+}
+
+__attribute__((target("sse2")))
+static void f32_to_i32_sse2(const float* src, int count, int32_t* dst) {
+    const __m128 scale = _mm_set1_ps(2147483648.f);
+    const __m128 hi = _mm_set1_ps(2147483520.f);
+    const __m128 lo = _mm_set1_ps(-2147483648.f);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+        a = _mm_max_ps(_mm_min_ps(a, hi), lo);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_cvttps_epi32(a));
+    }
+
+    f32_to_i32_scalar(src + i, count - i, dst + i);
+}
+
+__attribute__((target("sse2")))
+static void i32_to_f32_sse2(const int32_t* src, int count, float* dst) {
+    const __m128 scale = _mm_set1_ps(1.f / 2147483648.f);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+
+    i32_to_f32_scalar(src + i, count - i, dst + i);
+}
+
+__attribute__((target("sse2")))
+static void i16_to_i32_sse2(const int16_t* src, int count, int32_t* dst) {
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        // zero low half and sample in high half is exactly sample << 16
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(zero, v));
+        _mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(zero, v));
+    }
+
+    i16_to_i32_scalar(src + i, count - i, dst + i);
+}
+
+__attribute__((target("sse2")))
+static void i32_to_i16_sse2(const int32_t* src, int count, int16_t* dst) {
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(src + i)), 16);
+        __m128i b = _mm_srai_epi32(_mm_loadu_si128((const __m128i*)(src + i + 4)), 16);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(a, b));
+    }
+
+    i32_to_i16_scalar(src + i, count - i, dst + i);
+}
+
+/* avx2 kernels, 16 samples per iteration */
+
+__attribute__((target("avx2")))
+static void f32_to_i16_avx2(const float* src, int count, int16_t* dst) {
+    const __m256 scale = _mm256_set1_ps(32767.f);
+    const __m256 hi = _mm256_set1_ps(32767.f);
+    const __m256 lo = _mm256_set1_ps(-32768.f);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m256 a = _mm256_mul_ps(_mm256_loadu_ps(src + i), scale);
+        __m256 b = _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), scale);
+        a = _mm256_max_ps(_mm256_min_ps(a, hi), lo);
+        b = _mm256_max_ps(_mm256_min_ps(b, hi), lo);
+        __m256i v = _mm256_packs_epi32(_mm256_cvttps_epi32(a), _mm256_cvttps_epi32(b));
+        // packs works within 128 bit lanes, restore sample order
+        v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(dst + i), v);
+    }
+
+    f32_to_i16_sse2(src + i, count - i, dst + i);
+}
+
+__attribute__((target("avx2")))
+static void i16_to_f32_avx2(const int16_t* src, int count, float* dst) {
+    const __m256 scale = _mm256_set1_ps(1.f / 32768.f);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+        __m256i b = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i + 8)));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(a), scale));
+        _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(b), scale));
+    }
+
+    i16_to_f32_sse2(src + i, count - i, dst + i);
+}
+
+__attribute__((target("avx2")))
+static void f32_to_i32_avx2(const float* src, int count, int32_t* dst) {
+    const __m256 scale = _mm256_set1_ps(2147483648.f);
+    const __m256 hi = _mm256_set1_ps(2147483520.f);
+    const __m256 lo = _mm256_set1_ps(-2147483648.f);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 a = _mm256_mul_ps(_mm256_loadu_ps(src + i), scale);
+        a = _mm256_max_ps(_mm256_min_ps(a, hi), lo);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_cvttps_epi32(a));
+    }
+
+    f32_to_i32_sse2(src + i, count - i, dst + i);
+}
+
+__attribute__((target("avx2")))
+static void i32_to_f32_avx2(const int32_t* src, int count, float* dst) {
+    const __m256 scale = _mm256_set1_ps(1.f / 2147483648.f);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+
+    i32_to_f32_sse2(src + i, count - i, dst + i);
+}
+
+__attribute__((target("avx2")))
+static void i16_to_i32_avx2(const int16_t* src, int count, int32_t* dst) {
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+        __m256i b = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i + 8)));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_slli_epi32(a, 16));
+        _mm256_storeu_si256((__m256i*)(dst + i + 8), _mm256_slli_epi32(b, 16));
+    }
+
+    i16_to_i32_sse2(src + i, count - i, dst + i);
+}
+
+__attribute__((target("avx2")))
+static void i32_to_i16_avx2(const int32_t* src, int count, int16_t* dst) {
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(src + i)), 16);
+        __m256i b = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i*)(src + i + 8)), 16);
+        __m256i v = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(dst + i), v);
+    }
+
+    i32_to_i16_sse2(src + i, count - i, dst + i);
+}
+
+/* avx2 packed 24 bit kernels, 8 samples per iteration */
+
+// place the 3 bytes of each sample in the top of a 32 bit lane, two 12 byte groups per register
+#define UNPACK_I24_SHUFFLE _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, \
+                                            -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11)
+#define PACK_I24_SHUFFLE _mm256_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1, \
+                                          1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1)
+// move the 12 packed bytes of both lanes together
+#define PACK_I24_PERMUTE _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7)
+
+__attribute__((target("avx2")))
+static inline __m256i unpack_i24_avx2(const uint8_t* src) {
+    __m128i lo = _mm_loadu_si128((const __m128i*)src);
+    __m128i hi = _mm_loadu_si128((const __m128i*)(src + 12));
+    __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    return _mm256_shuffle_epi8(v, UNPACK_I24_SHUFFLE);
+}
+
+__attribute__((target("avx2")))
+static inline void pack_i24_avx2(__m256i v, uint8_t* dst) {
+    // 32 bytes are stored, the last 8 are garbage overwritten by the following samples
+    v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, PACK_I24_SHUFFLE), PACK_I24_PERMUTE);
+    _mm256_storeu_si256((__m256i*)dst, v);
+}
+
+// loads read 28 bytes and stores write 32 bytes from the current sample, loops stop
+//   early enough to stay inside the 3 * count bytes
+
+__attribute__((target("avx2")))
+static void i24_to_i32_avx2(const uint8_t* src, int count, int32_t* dst) {
+    int i = 0;
+
+    for (; i + 10 <= count; i += 8) {
+        _mm256_storeu_si256((__m256i*)(dst + i), unpack_i24_avx2(src + 3 * i));
+    }
+
+    i24_to_i32_scalar(src + 3 * i, count - i, dst + i);
+}
+
+__attribute__((target("avx2")))
+static void i32_to_i24_avx2(const int32_t* src, int count, uint8_t* dst) {
+    int i = 0;
+
+    for (; i + 11 <= count; i += 8) {
+        pack_i24_avx2(_mm256_loadu_si256((const __m256i*)(src + i)), dst + 3 * i);
+    }
+
+    i32_to_i24_scalar(src + i, count - i, dst + 3 * i);
+}
+
+__attribute__((target("avx2")))
+static void i24_to_f32_avx2(const uint8_t* src, int count, float* dst) {
+    const __m256 scale = _mm256_set1_ps(1.f / 2147483648.f);
+    int i = 0;
+
+    for (; i + 10 <= count; i += 8) {
+        __m256 v = _mm256_cvtepi32_ps(unpack_i24_avx2(src + 3 * i));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(v, scale));
+    }
+
+    i24_to_f32_scalar(src + 3 * i, count - i, dst + i);
+}
+
+__attribute__((target("avx2")))
+static void f32_to_i24_avx2(const float* src, int count, uint8_t* dst) {
+    const __m256 scale = _mm256_set1_ps(2147483648.f);
+    const __m256 hi = _mm256_set1_ps(2147483520.f);
+    const __m256 lo = _mm256_set1_ps(-2147483648.f);
+    int i = 0;
+
+    for (; i + 11 <= count; i += 8) {
+        __m256 a = _mm256_mul_ps(_mm256_loadu_ps(src + i), scale);
+        a = _mm256_max_ps(_mm256_min_ps(a, hi), lo);
+        pack_i24_avx2(_mm256_cvttps_epi32(a), dst + 3 * i);
+    }
+
+    f32_to_i24_scalar(src + i, count - i, dst + 3 * i);
+}
+
+__attribute__((target("avx2")))
+static void i24_to_i16_avx2(const uint8_t* src, int count, int16_t* dst) {
+    int i = 0;
+
+    for (; i + 10 <= count; i += 8) {
+        // top 16 bits of the left-justified samples, packing never saturates
+        __m256i v = _mm256_srai_epi32(unpack_i24_avx2(src + 3 * i), 16);
+        __m128i lo = _mm256_castsi256_si128(v);
+        __m128i hi = _mm256_extracti128_si256(v, 1);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packs_epi32(lo, hi));
+    }
+
+    i24_to_i16_scalar(src + 3 * i, count - i, dst + i);
+}
+
+__attribute__((target("avx2")))
+static void i16_to_i24_avx2(const int16_t* src, int count, uint8_t* dst) {
+    int i = 0;
+
+    for (; i + 11 <= count; i += 8) {
+        __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+        pack_i24_avx2(_mm256_slli_epi32(v, 16), dst + 3 * i);
+    }
+
+    i16_to_i24_scalar(src + i, count - i, dst + 3 * i);
+}
+
+/* avx-512 kernels, 16 samples per iteration */
+
+__attribute__((target("avx512f")))
+static void f32_to_i16_avx512(const float* src, int count, int16_t* dst) {
+    const __m512 scale = _mm512_set1_ps(32767.f);
+    const __m512 hi = _mm512_set1_ps(32767.f);
+    const __m512 lo = _mm512_set1_ps(-32768.f);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m512 a = _mm512_mul_ps(_mm512_loadu_ps(src + i), scale);
+        a = _mm512_max_ps(_mm512_min_ps(a, hi), lo);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm512_cvtsepi32_epi16(_mm512_cvttps_epi32(a)));
+    }
+
+    f32_to_i16_avx2(src + i, count - i, dst + i);
+}
+
+__attribute__((target("avx512f")))
+static void i16_to_f32_avx512(const int16_t* src, int count, float* dst) {
+    const __m512 scale = _mm512_set1_ps(1.f / 32768.f);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m512i v = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)(src + i)));
+        _mm512_storeu_ps(dst + i, _mm512_mul_ps(_mm512_cvtepi32_ps(v), scale));
+    }
+
+    i16_to_f32_avx2(src + i, count - i, dst + i);
+}
+
+__attribute__((target("avx512f")))
+static void f32_to_i32_avx512(const float* src, int count, int32_t* dst) {
+    const __m512 scale = _mm512_set1_ps(2147483648.f);
+    const __m512 hi = _mm512_set1_ps(2147483520.f);
+    const __m512 lo = _mm512_set1_ps(-2147483648.f);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m512 a = _mm512_mul_ps(_mm512_loadu_ps(src + i), scale);
+        a = _mm512_max_ps(_mm512_min_ps(a, hi), lo);
+        _mm512_storeu_si512((void*)(dst + i), _mm512_cvttps_epi32(a));
+    }
+
+    f32_to_i32_avx2(src + i, count - i, dst + i);
+}
+
+__attribute__((target("avx512f")))
+static void i32_to_f32_avx512(const int32_t* src, int count, float* dst) {
+    const __m512 scale = _mm512_set1_ps(1.f / 2147483648.f);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m512i v = _mm512_loadu_si512((const void*)(src + i));
+        _mm512_storeu_ps(dst + i, _mm512_mul_ps(_mm512_cvtepi32_ps(v), scale));
+    }
+
+    i32_to_f32_avx2(src + i, count - i, dst + i);
+}
+
+__attribute__((target("avx512f")))
+static void i16_to_i32_avx512(const int16_t* src, int count, int32_t* dst) {
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m512i v = _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)(src + i)));
+        _mm512_storeu_si512((void*)(dst + i), _mm512_slli_epi32(v, 16));
+    }
+
+    i16_to_i32_avx2(src + i, count - i, dst + i);
+}
+
+__attribute__((target("avx512f")))
+static void i32_to_i16_avx512(const int32_t* src, int count, int16_t* dst) {
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m512i v = _mm512_srai_epi32(_mm512_loadu_si512((const void*)(src + i)), 16);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm512_cvtepi32_epi16(v));
+    }
+
+    i32_to_i16_avx2(src + i, count - i, dst + i);
+}
+
+#endif // CONVERT_X86
+
+/* gain kernels, samples[i] scaled by gains[i] with saturation */
+
+// integer samples are widened exactly (int16 to float, int32 to double) and rounded
+//   half away from zero, float samples are clipped to [-1, 1]
+
+static void scale_f32_scalar(float* samples, const float* gains, int count) {
+    for (int i = 0; i < count; i++) {
+        float v = samples[i] * gains[i];
+        v = v < 1.f ? v : 1.f;
+        samples[i] = v > -1.f ? v : -1.f;
+    }
+}
+
+static void scale_i16_scalar(int16_t* samples, const float* gains, int count) {
+    for (int i = 0; i < count; i++) {
+        float v = (float)samples[i] * gains[i];
+        v += v < 0.f ? -0.5f : 0.5f;
+        v = v < 32767.f ? v : 32767.f;
+        samples[i] = (int16_t)(v > -32768.f ? v : -32768.f);
+    }
+}
+
+static void scale_i32_scalar(int32_t* samples, const double* gains, int count) {
+    for (int i = 0; i < count; i++) {
+        double v = (double)samples[i] * gains[i];
+        v += v < 0. ? -0.5 : 0.5;
+        v = v < 2147483647. ? v : 2147483647.;
+        samples[i] = (int32_t)(v > -2147483648. ? v : -2147483648.);
+    }
+}
+
+#ifdef CONVERT_X86
+
+__attribute__((target("sse2")))
+static void scale_f32_sse2(float* samples, const float* gains, int count) {
+    const __m128 hi = _mm_set1_ps(1.f);
+    const __m128 lo = _mm_set1_ps(-1.f);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(samples + i), _mm_loadu_ps(gains + i));
+        _mm_storeu_ps(samples + i, _mm_max_ps(_mm_min_ps(v, hi), lo));
+    }
+
+    scale_f32_scalar(samples + i, gains + i, count - i);
+}
+
+// v + copysign(0.5, v), so that truncation rounds half away from zero
+__attribute__((target("sse2")))
+static inline __m128 round_bias_sse2(__m128 v) {
+    return _mm_add_ps(v, _mm_or_ps(_mm_and_ps(v, _mm_set1_ps(-0.f)), _mm_set1_ps(0.5f)));
+}
+
+__attribute__((target("sse2")))
+static inline __m128d round_bias_pd_sse2(__m128d v) {
+    return _mm_add_pd(v, _mm_or_pd(_mm_and_pd(v, _mm_set1_pd(-0.)), _mm_set1_pd(0.5)));
+}
+
+__attribute__((target("sse2")))
+static void scale_i16_sse2(int16_t* samples, const float* gains, int count) {
+    const __m128 hi = _mm_set1_ps(32767.f);
+    const __m128 lo = _mm_set1_ps(-32768.f);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(samples + i));
+        __m128 a = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+        __m128 b = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+        a = round_bias_sse2(_mm_mul_ps(a, _mm_loadu_ps(gains + i)));
+        b = round_bias_sse2(_mm_mul_ps(b, _mm_loadu_ps(gains + i + 4)));
+        a = _mm_max_ps(_mm_min_ps(a, hi), lo);
+        b = _mm_max_ps(_mm_min_ps(b, hi), lo);
+        v = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+        _mm_storeu_si128((__m128i*)(samples + i), v);
+    }
+
+    scale_i16_scalar(samples + i, gains + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void scale_i32_sse2(int32_t* samples, const double* gains, int count) {
+    const __m128d hi = _mm_set1_pd(2147483647.);
+    const __m128d lo = _mm_set1_pd(-2147483648.);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(samples + i));
+        __m128d a = _mm_cvtepi32_pd(v);
+        __m128d b = _mm_cvtepi32_pd(_mm_srli_si128(v, 8));
+        a = round_bias_pd_sse2(_mm_mul_pd(a, _mm_loadu_pd(gains + i)));
+        b = round_bias_pd_sse2(_mm_mul_pd(b, _mm_loadu_pd(gains + i + 2)));
+        a = _mm_max_pd(_mm_min_pd(a, hi), lo);
+        b = _mm_max_pd(_mm_min_pd(b, hi), lo);
+        v = _mm_unpacklo_epi64(_mm_cvttpd_epi32(a), _mm_cvttpd_epi32(b));
+        _mm_storeu_si128((__m128i*)(samples + i), v);
+    }
+
+    scale_i32_scalar(samples + i, gains + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void scale_f32_avx2(float* samples, const float* gains, int count) {
+    const __m256 hi = _mm256_set1_ps(1.f);
+    const __m256 lo = _mm256_set1_ps(-1.f);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(samples + i), _mm256_loadu_ps(gains + i));
+        _mm256_storeu_ps(samples + i, _mm256_max_ps(_mm256_min_ps(v, hi), lo));
+    }
+
+    scale_f32_sse2(samples + i, gains + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 round_bias_avx2(__m256 v) {
+    return _mm256_add_ps(v, _mm256_or_ps(_mm256_and_ps(v, _mm256_set1_ps(-0.f)),
+                                         _mm256_set1_ps(0.5f)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256d round_bias_pd_avx2(__m256d v) {
+    return _mm256_add_pd(v, _mm256_or_pd(_mm256_and_pd(v, _mm256_set1_pd(-0.)),
+                                         _mm256_set1_pd(0.5)));
+}
+
+__attribute__((target("avx2")))
+static void scale_i16_avx2(int16_t* samples, const float* gains, int count) {
+    const __m256 hi = _mm256_set1_ps(32767.f);
+    const __m256 lo = _mm256_set1_ps(-32768.f);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m256 a = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(
+                                          _mm_loadu_si128((const __m128i*)(samples + i))));
+        __m256 b = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(
+                                          _mm_loadu_si128((const __m128i*)(samples + i + 8))));
+        a = round_bias_avx2(_mm256_mul_ps(a, _mm256_loadu_ps(gains + i)));
+        b = round_bias_avx2(_mm256_mul_ps(b, _mm256_loadu_ps(gains + i + 8)));
+        a = _mm256_max_ps(_mm256_min_ps(a, hi), lo);
+        b = _mm256_max_ps(_mm256_min_ps(b, hi), lo);
+        __m256i v = _mm256_packs_epi32(_mm256_cvttps_epi32(a), _mm256_cvttps_epi32(b));
+        // packs works within 128 bit lanes, restore sample order
+        v = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(samples + i), v);
+    }
+
+    scale_i16_sse2(samples + i, gains + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void scale_i32_avx2(int32_t* samples, const double* gains, int count) {
+    const __m256d hi = _mm256_set1_pd(2147483647.);
+    const __m256d lo = _mm256_set1_pd(-2147483648.);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256d a = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)(samples + i)));
+        __m256d b = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)(samples + i + 4)));
+        a = round_bias_pd_avx2(_mm256_mul_pd(a, _mm256_loadu_pd(gains + i)));
+        b = round_bias_pd_avx2(_mm256_mul_pd(b, _mm256_loadu_pd(gains + i + 4)));
+        a = _mm256_max_pd(_mm256_min_pd(a, hi), lo);
+        b = _mm256_max_pd(_mm256_min_pd(b, hi), lo);
+        _mm_storeu_si128((__m128i*)(samples + i), _mm256_cvttpd_epi32(a));
+        _mm_storeu_si128((__m128i*)(samples + i + 4), _mm256_cvttpd_epi32(b));
+    }
+
+    scale_i32_sse2(samples + i, gains + i, count - i);
+}
+
+__attribute__((target("avx512f")))
+static void scale_f32_avx512(float* samples, const float* gains, int count) {
+    const __m512 hi = _mm512_set1_ps(1.f);
+    const __m512 lo = _mm512_set1_ps(-1.f);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m512 v = _mm512_mul_ps(_mm512_loadu_ps(samples + i), _mm512_loadu_ps(gains + i));
+        _mm512_storeu_ps(samples + i, _mm512_max_ps(_mm512_min_ps(v, hi), lo));
+    }
+
+    scale_f32_avx2(samples + i, gains + i, count - i);
+}
+
+// float and/or need avx512dq, use integer ops on the bit patterns
+__attribute__((target("avx512f")))
+static inline __m512 round_bias_avx512(__m512 v) {
+    __m512i sign = _mm512_and_epi32(_mm512_castps_si512(v), _mm512_set1_epi32(INT32_MIN));
+    __m512i half = _mm512_or_epi32(sign, _mm512_castps_si512(_mm512_set1_ps(0.5f)));
+    return _mm512_add_ps(v, _mm512_castsi512_ps(half));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d round_bias_pd_avx512(__m512d v) {
+    __m512i sign = _mm512_and_epi64(_mm512_castpd_si512(v), _mm512_set1_epi64(INT64_MIN));
+    __m512i half = _mm512_or_epi64(sign, _mm512_castpd_si512(_mm512_set1_pd(0.5)));
+    return _mm512_add_pd(v, _mm512_castsi512_pd(half));
+}
+
+__attribute__((target("avx512f")))
+static void scale_i16_avx512(int16_t* samples, const float* gains, int count) {
+    const __m512 hi = _mm512_set1_ps(32767.f);
+    const __m512 lo = _mm512_set1_ps(-32768.f);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m512 a = _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(
+                                          _mm256_loadu_si256((const __m256i*)(samples + i))));
+        a = round_bias_avx512(_mm512_mul_ps(a, _mm512_loadu_ps(gains + i)));
+        a = _mm512_max_ps(_mm512_min_ps(a, hi), lo);
+        _mm256_storeu_si256((__m256i*)(samples + i), _mm512_cvtepi32_epi16(_mm512_cvttps_epi32(a)));
+    }
+
+    scale_i16_avx2(samples + i, gains + i, count - i);
+}
+
+__attribute__((target("avx512f")))
+static void scale_i32_avx512(int32_t* samples, const double* gains, int count) {
+    const __m512d hi = _mm512_set1_pd(2147483647.);
+    const __m512d lo = _mm512_set1_pd(-2147483648.);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m512d a = _mm512_cvtepi32_pd(_mm256_loadu_si256((const __m256i*)(samples + i)));
+        a = round_bias_pd_avx512(_mm512_mul_pd(a, _mm512_loadu_pd(gains + i)));
+        a = _mm512_max_pd(_mm512_min_pd(a, hi), lo);
+        _mm256_storeu_si256((__m256i*)(samples + i), _mm512_cvttpd_epi32(a));
+    }
+
+    scale_i32_avx2(samples + i, gains + i, count - i);
+}
+
+#endif // CONVERT_X86
+
+/* polyphase fir kernels, one dot product of num_taps (multiple of 16) per output */
+
+static void fir_f32_scalar(const float* src, const int* offsets, const int* phases, int count,
+                           const float* filters, int num_taps, float* dst, int stride) {
+    for (int i = 0; i < count; i++) {
+        const float* x = src + offsets[i];
+        const float* h = phases != NULL ? filters + (long)phases[i] * num_taps : filters;
+        float acc[4] = {0.f, 0.f, 0.f, 0.f};
+
+        for (int k = 0; k < num_taps; k += 4) {
+            acc[0] += x[k] * h[k];
+            acc[1] += x[k + 1] * h[k + 1];
+            acc[2] += x[k + 2] * h[k + 2];
+            acc[3] += x[k + 3] * h[k + 3];
+        }
+
+        dst[(long)i * stride] = (acc[0] + acc[2]) + (acc[1] + acc[3]);
+    }
+}
+
+#ifdef CONVERT_X86
+
+__attribute__((target("sse2")))
+static void fir_f32_sse2(const float* src, const int* offsets, const int* phases, int count,
+                         const float* filters, int num_taps, float* dst, int stride) {
+    for (int i = 0; i < count; i++) {
+        const float* x = src + offsets[i];
+        const float* h = phases != NULL ? filters + (long)phases[i] * num_taps : filters;
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+
+        for (int k = 0; k < num_taps; k += 8) {
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + k), _mm_loadu_ps(h + k)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x + k + 4), _mm_loadu_ps(h + k + 4)));
+        }
+
+        acc0 = _mm_add_ps(acc0, acc1);
+        acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+        acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+        dst[(long)i * stride] = _mm_cvtss_f32(acc0);
+    }
+}
+
+__attribute__((target("avx2")))
+static void fir_f32_avx2(const float* src, const int* offsets, const int* phases, int count,
+                         const float* filters, int num_taps, float* dst, int stride) {
+    for (int i = 0; i < count; i++) {
+        const float* x = src + offsets[i];
+        const float* h = phases != NULL ? filters + (long)phases[i] * num_taps : filters;
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+
+        for (int k = 0; k < num_taps; k += 16) {
+            acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(x + k),
+                                 _mm256_loadu_ps(h + k)));
+            acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(x + k + 8),
+                                 _mm256_loadu_ps(h + k + 8)));
+        }
+
+        acc0 = _mm256_add_ps(acc0, acc1);
+        __m128 v = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+        v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+        dst[(long)i * stride] = _mm_cvtss_f32(v);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void fir_f32_avx512(const float* src, const int* offsets, const int* phases, int count,
+                           const float* filters, int num_taps, float* dst, int stride) {
+    for (int i = 0; i < count; i++) {
+        const float* x = src + offsets[i];
+        const float* h = phases != NULL ? filters + (long)phases[i] * num_taps : filters;
+        __m512 acc = _mm512_setzero_ps();
+
+        for (int k = 0; k < num_taps; k += 16) {
+            acc = _mm512_fmadd_ps(_mm512_loadu_ps(x + k), _mm512_loadu_ps(h + k), acc);
+        }
+
+        dst[(long)i * stride] = _mm512_reduce_add_ps(acc);
+    }
+}
+
+#endif // CONVERT_X86
+
+/* mixing matrix kernels over planar frames, vectorized across frames */
+
+// channels are accumulated in order without fma, every isa gives the same result
+static void mix_frames_scalar(const float* const* src, int num_channels, int begin, int end,
+                              const float* weights, float* dst) {
+    for (int i = begin; i < end; i++) {
+        float acc = 0.f;
+
+        for (int c = 0; c < num_channels; c++) {
+            acc += weights[c] * src[c][i];
+        }
+
+        dst[i] = acc;
+    }
+}
+
+static void mix_f32_scalar(const float* const* src, int num_channels, int count,
+                           const float* matrix, int num_out, float* const* dst) {
+    for (int o = 0; o < num_out; o++) {
+        mix_frames_scalar(src, num_channels, 0, count, matrix + (long)o * num_channels, dst[o]);
+    }
+}
+
+#ifdef CONVERT_X86
+
+__attribute__((target("sse2")))
+static void mix_f32_sse2(const float* const* src, int num_channels, int count,
+                         const float* matrix, int num_out, float* const* dst) {
+    for (int o = 0; o < num_out; o++) {
+        const float* weights = matrix + (long)o * num_channels;
+        int i = 0;
+
+        for (; i + 8 <= count; i += 8) {
+            __m128 acc0 = _mm_setzero_ps();
+            __m128 acc1 = _mm_setzero_ps();
+
+            for (int c = 0; c < num_channels; c++) {
+                __m128 w = _mm_set1_ps(weights[c]);
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(w, _mm_loadu_ps(src[c] + i)));
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(w, _mm_loadu_ps(src[c] + i + 4)));
+            }
+
+            _mm_storeu_ps(dst[o] + i, acc0);
+            _mm_storeu_ps(dst[o] + i + 4, acc1);
+        }
+
+        mix_frames_scalar(src, num_channels, i, count, weights, dst[o]);
+    }
+}
+
+__attribute__((target("avx2")))
+static void mix_f32_avx2(const float* const* src, int num_channels, int count,
+                         const float* matrix, int num_out, float* const* dst) {
+    for (int o = 0; o < num_out; o++) {
+        const float* weights = matrix + (long)o * num_channels;
+        int i = 0;
+
+        for (; i + 16 <= count; i += 16) {
+            __m256 acc0 = _mm256_setzero_ps();
+            __m256 acc1 = _mm256_setzero_ps();
+
+            for (int c = 0; c < num_channels; c++) {
+                __m256 w = _mm256_set1_ps(weights[c]);
+                acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(w, _mm256_loadu_ps(src[c] + i)));
+                acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(w, _mm256_loadu_ps(src[c] + i + 8)));
+            }
+
+            _mm256_storeu_ps(dst[o] + i, acc0);
+            _mm256_storeu_ps(dst[o] + i + 8, acc1);
+        }
+
+        mix_frames_scalar(src, num_channels, i, count, weights, dst[o]);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void mix_f32_avx512(const float* const* src, int num_channels, int count,
+                           const float* matrix, int num_out, float* const* dst) {
+    for (int o = 0; o < num_out; o++) {
+        const float* weights = matrix + (long)o * num_channels;
+        int i = 0;
+
+        for (; i + 32 <= count; i += 32) {
+            __m512 acc0 = _mm512_setzero_ps();
+            __m512 acc1 = _mm512_setzero_ps();
+
+            for (int c = 0; c < num_channels; c++) {
+                __m512 w = _mm512_set1_ps(weights[c]);
+                acc0 = _mm512_add_ps(acc0, _mm512_mul_ps(w, _mm512_loadu_ps(src[c] + i)));
+                acc1 = _mm512_add_ps(acc1, _mm512_mul_ps(w, _mm512_loadu_ps(src[c] + i + 16)));
+            }
+
+            _mm512_storeu_ps(dst[o] + i, acc0);
+            _mm512_storeu_ps(dst[o] + i + 16, acc1);
+        }
+
+        for (; i + 16 <= count; i += 16) {
+            __m512 acc = _mm512_setzero_ps();
+
+            for (int c = 0; c < num_channels; c++) {
+                acc = _mm512_add_ps(acc, _mm512_mul_ps(_mm512_set1_ps(weights[c]),
+                                    _mm512_loadu_ps(src[c] + i)));
+            }
+
+            _mm512_storeu_ps(dst[o] + i, acc);
+        }
+
+        mix_frames_scalar(src, num_channels, i, count, weights, dst[o]);
+    }
+}
+
+#endif // CONVERT_X86
+
+/* quantize kernels, float to left-justified integer rounded to nearest, optionally dithered */
+
+// src[i] * scale (+ tpdf noise of +-1 lsb) clamped to [lo, hi], rounded to nearest even
+//   and shifted left by shift, rng holds one xorshift32 state per vector lane
+
+static inline uint32_t xorshift32(uint32_t s) {
+    s ^= s << 13;
+    s ^= s >> 17;
+    return s ^ (s << 5);
+}
+
+// uniform in [-0.5, 0.5) from the top 23 bits
+static inline float uniform_f32(uint32_t s) {
+    union {
+        uint32_t u;
+        float f;
+    } v = {(s >> 9) | 0x3f800000u};
+    return v.f - 1.5f;
+}
+
+// round to nearest even without libm or branches, adding and removing 1.5 * 2^52
+//   drops the fraction of a double
+static inline double round_f64(double v) {
+    return (v + 6755399441055744.) - 6755399441055744.;
+}
+
+static void quantize_f32_scalar(const float* src, int count, float scale, float lo, float hi,
+                                int shift, int tpdf, uint32_t* rng, int32_t* dst) {
+    uint32_t s = rng[0];
+
+    for (int i = 0; i < count; i++) {
+        float v = src[i] * scale;
+
+        if (tpdf) {
+            s = xorshift32(s);
+            float d = uniform_f32(s);
+            s = xorshift32(s);
+            v += d + uniform_f32(s);
+        }
+
+        v = v < hi ? v : hi;
+        v = v > lo ? v : lo;
+        dst[i] = (int32_t)((uint32_t)(int32_t)round_f64(v) << shift);
+    }
+
+    rng[0] = s;
+}
+
+// tpdf noise of +-1 lsb, four generator lanes interleaved
+static void tpdf_f32_scalar(int count, uint32_t* rng, float* dst) {
+    for (int i = 0; i < count; i++) {
+        uint32_t a = xorshift32(rng[i & 3]);
+        uint32_t b = xorshift32(a);
+        rng[i & 3] = b;
+        dst[i] = uniform_f32(a) + uniform_f32(b);
+    }
+}
+
+#ifdef CONVERT_X86
+
+__attribute__((target("sse2")))
+static inline __m128i xorshift32_sse2(__m128i s) {
+    s = _mm_xor_si128(s, _mm_slli_epi32(s, 13));
+    s = _mm_xor_si128(s, _mm_srli_epi32(s, 17));
+    return _mm_xor_si128(s, _mm_slli_epi32(s, 5));
+}
+
+// sum of two uniforms in [1, 2) minus 3, triangular in [-1, 1)
+__attribute__((target("sse2")))
+static inline __m128 tpdf_sse2(__m128i* state) {
+    const __m128i one = _mm_set1_epi32(0x3f800000);
+    __m128i a = xorshift32_sse2(*state);
+    __m128i b = xorshift32_sse2(a);
+    *state = b;
+    __m128 u = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(a, 9), one));
+    __m128 w = _mm_castsi128_ps(_mm_or_si128(_mm_srli_epi32(b, 9), one));
+    return _mm_sub_ps(_mm_add_ps(u, w), _mm_set1_ps(3.f));
+}
+
+__attribute__((target("sse2")))
+static void quantize_f32_sse2(const float* src, int count, float scale, float lo, float hi,
+                              int shift, int tpdf, uint32_t* rng, int32_t* dst) {
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 vlo = _mm_set1_ps(lo);
+    const __m128 vhi = _mm_set1_ps(hi);
+    const __m128i vshift = _mm_cvtsi32_si128(shift);
+    __m128i state = _mm_loadu_si128((const __m128i*)rng);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), vscale);
+
+        if (tpdf) {
+            v = _mm_add_ps(v, tpdf_sse2(&state));
+        }
+
+        v = _mm_max_ps(_mm_min_ps(v, vhi), vlo);
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_sll_epi32(_mm_cvtps_epi32(v), vshift));
+    }
+
+    _mm_storeu_si128((__m128i*)rng, state);
+    quantize_f32_scalar(src + i, count - i, scale, lo, hi, shift, tpdf, rng, dst + i);
+}
+
+__attribute__((target("sse2")))
+static void tpdf_f32_sse2(int count, uint32_t* rng, float* dst) {
+    __m128i state = _mm_loadu_si128((const __m128i*)rng);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(dst + i, tpdf_sse2(&state));
+    }
+
+    _mm_storeu_si128((__m128i*)rng, state);
+    tpdf_f32_scalar(count - i, rng, dst + i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i xorshift32_avx2(__m256i s) {
+    s = _mm256_xor_si256(s, _mm256_slli_epi32(s, 13));
+    s = _mm256_xor_si256(s, _mm256_srli_epi32(s, 17));
+    return _mm256_xor_si256(s, _mm256_slli_epi32(s, 5));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 tpdf_avx2(__m256i* state) {
+    const __m256i one = _mm256_set1_epi32(0x3f800000);
+    __m256i a = xorshift32_avx2(*state);
+    __m256i b = xorshift32_avx2(a);
+    *state = b;
+    __m256 u = _mm256_castsi256_ps(_mm256_or_si256(_mm256_srli_epi32(a, 9), one));
+    __m256 w = _mm256_castsi256_ps(_mm256_or_si256(_mm256_srli_epi32(b, 9), one));
+    return _mm256_sub_ps(_mm256_add_ps(u, w), _mm256_set1_ps(3.f));
+}
+
+__attribute__((target("avx2")))
+static void quantize_f32_avx2(const float* src, int count, float scale, float lo, float hi,
+                              int shift, int tpdf, uint32_t* rng, int32_t* dst) {
+    const __m256 vscale = _mm256_set1_ps(scale);
+    const __m256 vlo = _mm256_set1_ps(lo);
+    const __m256 vhi = _mm256_set1_ps(hi);
+    const __m128i vshift = _mm_cvtsi32_si128(shift);
+    __m256i state = _mm256_loadu_si256((const __m256i*)rng);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src + i), vscale);
+
+        if (tpdf) {
+            v = _mm256_add_ps(v, tpdf_avx2(&state));
+        }
+
+        v = _mm256_max_ps(_mm256_min_ps(v, vhi), vlo);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_sll_epi32(_mm256_cvtps_epi32(v), vshift));
+    }
+
+    _mm256_storeu_si256((__m256i*)rng, state);
+    quantize_f32_sse2(src + i, count - i, scale, lo, hi, shift, tpdf, rng, dst + i);
+}
+
+__attribute__((target("avx2")))
+static void tpdf_f32_avx2(int count, uint32_t* rng, float* dst) {
+    __m256i state = _mm256_loadu_si256((const __m256i*)rng);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(dst + i, tpdf_avx2(&state));
+    }
+
+    _mm256_storeu_si256((__m256i*)rng, state);
+    tpdf_f32_sse2(count - i, rng, dst + i);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i xorshift32_avx512(__m512i s) {
+    s = _mm512_xor_si512(s, _mm512_slli_epi32(s, 13));
+    s = _mm512_xor_si512(s, _mm512_srli_epi32(s, 17));
+    return _mm512_xor_si512(s, _mm512_slli_epi32(s, 5));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 tpdf_avx512(__m512i* state) {
+    const __m512i one = _mm512_set1_epi32(0x3f800000);
+    __m512i a = xorshift32_avx512(*state);
+    __m512i b = xorshift32_avx512(a);
+    *state = b;
+    __m512 u = _mm512_castsi512_ps(_mm512_or_si512(_mm512_srli_epi32(a, 9), one));
+    __m512 w = _mm512_castsi512_ps(_mm512_or_si512(_mm512_srli_epi32(b, 9), one));
+    return _mm512_sub_ps(_mm512_add_ps(u, w), _mm512_set1_ps(3.f));
+}
+
+__attribute__((target("avx512f")))
+static void quantize_f32_avx512(const float* src, int count, float scale, float lo, float hi,
+                                int shift, int tpdf, uint32_t* rng, int32_t* dst) {
+    const __m512 vscale = _mm512_set1_ps(scale);
+    const __m512 vlo = _mm512_set1_ps(lo);
+    const __m512 vhi = _mm512_set1_ps(hi);
+    const __m128i vshift = _mm_cvtsi32_si128(shift);
+    __m512i state = _mm512_loadu_si512(rng);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m512 v = _mm512_mul_ps(_mm512_loadu_ps(src + i), vscale);
+
+        if (tpdf) {
+            v = _mm512_add_ps(v, tpdf_avx512(&state));
+        }
+
+        v = _mm512_max_ps(_mm512_min_ps(v, vhi), vlo);
+        _mm512_storeu_si512(dst + i, _mm512_sll_epi32(_mm512_cvtps_epi32(v), vshift));
+    }
+
+    _mm512_storeu_si512(rng, state);
+    quantize_f32_avx2(src + i, count - i, scale, lo, hi, shift, tpdf, rng, dst + i);
+}
+
+__attribute__((target("avx512f")))
+static void tpdf_f32_avx512(int count, uint32_t* rng, float* dst) {
+    __m512i state = _mm512_loadu_si512(rng);
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        _mm512_storeu_ps(dst + i, tpdf_avx512(&state));
+    }
+
+    _mm512_storeu_si512(rng, state);
+    tpdf_f32_avx2(count - i, rng, dst + i);
+}
+
+#endif // CONVERT_X86
+
+/* level kernels, peak of |x|, sum, sum of squares and samples at full scale */
+
+// vector lanes accumulate in float over blocks, each block is added to the double totals
+#define LEVEL_BLOCK_SAMPLES 1024
+
+static void level_f32_scalar(const float* src, int count, float* peak, double* sum,
+                             double* sum_sq, int64_t* num_clips) {
+    float p = *peak;
+    double s = 0.;
+    double q = 0.;
+    int64_t clips = 0;
+
+    for (int i = 0; i < count; i++) {
+        float x = src[i];
+        float a = x < 0.f ? -x : x;
+        p = a > p ? a : p;
+        s += x;
+        q += (double)x * x;
+        clips += a >= 1.f;
+    }
+
+    *peak = p;
+    *sum += s;
+    *sum_sq += q;
+    *num_clips += clips;
+}
+
+#ifdef CONVERT_X86
+
+__attribute__((target("sse2")))
+static void level_f32_sse2(const float* src, int count, float* peak, double* sum,
+                           double* sum_sq, int64_t* num_clips) {
+    const __m128 sign = _mm_set1_ps(-0.f);
+    const __m128 one = _mm_set1_ps(1.f);
+    __m128 vp = _mm_set1_ps(*peak);
+    float lanes[4];
+    int i = 0;
+
+    while (i + 4 <= count) {
+        int end = count - i < LEVEL_BLOCK_SAMPLES ? count : i + LEVEL_BLOCK_SAMPLES;
+        __m128 vs = _mm_setzero_ps();
+        __m128 vq = _mm_setzero_ps();
+        __m128i vc = _mm_setzero_si128();
+
+        for (; i + 4 <= end; i += 4) {
+            __m128 x = _mm_loadu_ps(src + i);
+            __m128 a = _mm_andnot_ps(sign, x);
+            vp = _mm_max_ps(vp, a);
+            vs = _mm_add_ps(vs, x);
+            vq = _mm_add_ps(vq, _mm_mul_ps(x, x));
+            // compare mask is -1 per clipped sample
+            vc = _mm_sub_epi32(vc, _mm_castps_si128(_mm_cmpge_ps(a, one)));
+        }
+
+        _mm_storeu_ps(lanes, vs);
+        *sum += ((double)lanes[0] + lanes[1]) + ((double)lanes[2] + lanes[3]);
+        _mm_storeu_ps(lanes, vq);
+        *sum_sq += ((double)lanes[0] + lanes[1]) + ((double)lanes[2] + lanes[3]);
+        int32_t counts[4];
+        _mm_storeu_si128((__m128i*)counts, vc);
+        *num_clips += (int64_t)counts[0] + counts[1] + counts[2] + counts[3];
+    }
+
+    _mm_storeu_ps(lanes, vp);
+    float p = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+    p = lanes[2] > p ? lanes[2] : p;
+    *peak = lanes[3] > p ? lanes[3] : p;
+    level_f32_scalar(src + i, count - i, peak, sum, sum_sq, num_clips);
+}
+
+__attribute__((target("avx2")))
+static void level_f32_avx2(const float* src, int count, float* peak, double* sum,
+                           double* sum_sq, int64_t* num_clips) {
+    const __m256 sign = _mm256_set1_ps(-0.f);
+    const __m256 one = _mm256_set1_ps(1.f);
+    __m256 vp = _mm256_set1_ps(*peak);
+    float lanes[8];
+    int i = 0;
+
+    while (i + 8 <= count) {
+        int end = count - i < LEVEL_BLOCK_SAMPLES ? count : i + LEVEL_BLOCK_SAMPLES;
+        __m256 vs = _mm256_setzero_ps();
+        __m256 vq = _mm256_setzero_ps();
+        __m256i vc = _mm256_setzero_si256();
+
+        for (; i + 8 <= end; i += 8) {
+            __m256 x = _mm256_loadu_ps(src + i);
+            __m256 a = _mm256_andnot_ps(sign, x);
+            vp = _mm256_max_ps(vp, a);
+            vs = _mm256_add_ps(vs, x);
+            vq = _mm256_add_ps(vq, _mm256_mul_ps(x, x));
+            vc = _mm256_sub_epi32(vc, _mm256_castps_si256(_mm256_cmp_ps(a, one, _CMP_GE_OQ)));
+        }
+
+        // 4 + 4 lanes reduced in double
+        __m256d s = _mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(vs)),
+                                  _mm256_cvtps_pd(_mm256_extractf128_ps(vs, 1)));
+        __m256d q = _mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(vq)),
+                                  _mm256_cvtps_pd(_mm256_extractf128_ps(vq, 1)));
+        double d[4];
+        _mm256_storeu_pd(d, s);
+        *sum += (d[0] + d[1]) + (d[2] + d[3]);
+        _mm256_storeu_pd(d, q);
+        *sum_sq += (d[0] + d[1]) + (d[2] + d[3]);
+        __m128i c = _mm_add_epi32(_mm256_castsi256_si128(vc), _mm256_extracti128_si256(vc, 1));
+        int32_t counts[4];
+        _mm_storeu_si128((__m128i*)counts, c);
+        *num_clips += (int64_t)counts[0] + counts[1] + counts[2] + counts[3];
+    }
+
+    _mm256_storeu_ps(lanes, vp);
+
+    for (int k = 0; k < 8; k++) {
+        *peak = lanes[k] > *peak ? lanes[k] : *peak;
+    }
+
+    level_f32_sse2(src + i, count - i, peak, sum, sum_sq, num_clips);
+}
+
+__attribute__((target("avx512f")))
+static void level_f32_avx512(const float* src, int count, float* peak, double* sum,
+                             double* sum_sq, int64_t* num_clips) {
+    const __m512 one = _mm512_set1_ps(1.f);
+    __m512 vp = _mm512_set1_ps(*peak);
+    int i = 0;
+
+    while (i + 16 <= count) {
+        int end = count - i < LEVEL_BLOCK_SAMPLES ? count : i + LEVEL_BLOCK_SAMPLES;
+        __m512 vs = _mm512_setzero_ps();
+        __m512 vq = _mm512_setzero_ps();
+        int64_t clips = 0;
+
+        for (; i + 16 <= end; i += 16) {
+            __m512 x = _mm512_loadu_ps(src + i);
+            __m512 a = _mm512_abs_ps(x);
+            vp = _mm512_max_ps(vp, a);
+            vs = _mm512_add_ps(vs, x);
+            vq = _mm512_add_ps(vq, _mm512_mul_ps(x, x));
+            clips += __builtin_popcount(_mm512_cmp_ps_mask(a, one, _CMP_GE_OQ));
+        }
+
+        __m512d s = _mm512_add_pd(_mm512_cvtps_pd(_mm512_castps512_ps256(vs)),
+                                  _mm512_cvtps_pd(_mm256_castpd_ps(
+                                      _mm512_extractf64x4_pd(_mm512_castps_pd(vs), 1))));
+        __m512d q = _mm512_add_pd(_mm512_cvtps_pd(_mm512_castps512_ps256(vq)),
+                                  _mm512_cvtps_pd(_mm256_castpd_ps(
+                                      _mm512_extractf64x4_pd(_mm512_castps_pd(vq), 1))));
+        *sum += _mm512_reduce_add_pd(s);
+        *sum_sq += _mm512_reduce_add_pd(q);
+        *num_clips += clips;
+    }
+
+    float p = _mm512_reduce_max_ps(vp);
+    *peak = p > *peak ? p : *peak;
+    level_f32_avx2(src + i, count - i, peak, sum, sum_sq, num_clips);
+}
+
+#endif // CONVERT_X86
+
+/* min/max kernels, smallest and largest sample and sum of squares */
+
+static void minmax_f32_scalar(const float* src, int count, float* min, float* max,
+                              double* sum_sq) {
+    float lo = *min;
+    float hi = *max;
+    double q = 0.;
+
+    for (int i = 0; i < count; i++) {
+        float x = src[i];
+        lo = x < lo ? x : lo;
+        hi = x > hi ? x : hi;
+        q += (double)x * x;
+    }
+
+    *min = lo;
+    *max = hi;
+    *sum_sq += q;
+}
+
+#ifdef CONVERT_X86
+
+__attribute__((target("sse2")))
+static void minmax_f32_sse2(const float* src, int count, float* min, float* max,
+                            double* sum_sq) {
+    __m128 vlo = _mm_set1_ps(*min);
+    __m128 vhi = _mm_set1_ps(*max);
+    float lanes[4];
+    int i = 0;
+
+    while (i + 4 <= count) {
+        int end = count - i < LEVEL_BLOCK_SAMPLES ? count : i + LEVEL_BLOCK_SAMPLES;
+        __m128 vq = _mm_setzero_ps();
+
+        for (; i + 4 <= end; i += 4) {
+            __m128 x = _mm_loadu_ps(src + i);
+            vlo = _mm_min_ps(vlo, x);
+            vhi = _mm_max_ps(vhi, x);
+            vq = _mm_add_ps(vq, _mm_mul_ps(x, x));
+        }
+
+        _mm_storeu_ps(lanes, vq);
+        *sum_sq += ((double)lanes[0] + lanes[1]) + ((double)lanes[2] + lanes[3]);
+    }
+
+    _mm_storeu_ps(lanes, vlo);
+
+    for (int k = 0; k < 4; k++) {
+        *min = lanes[k] < *min ? lanes[k] : *min;
+    }
+
+    _mm_storeu_ps(lanes, vhi);
+
+    for (int k = 0; k < 4; k++) {
+        *max = lanes[k] > *max ? lanes[k] : *max;
+    }
+
+    minmax_f32_scalar(src + i, count - i, min, max, sum_sq);
+}
+
+__attribute__((target("avx2")))
+static void minmax_f32_avx2(const float* src, int count, float* min, float* max,
+                            double* sum_sq) {
+    __m256 vlo = _mm256_set1_ps(*min);
+    __m256 vhi = _mm256_set1_ps(*max);
+    float lanes[8];
+    int i = 0;
+
+    while (i + 8 <= count) {
+        int end = count - i < LEVEL_BLOCK_SAMPLES ? count : i + LEVEL_BLOCK_SAMPLES;
+        __m256 vq = _mm256_setzero_ps();
+
+        for (; i + 8 <= end; i += 8) {
+            __m256 x = _mm256_loadu_ps(src + i);
+            vlo = _mm256_min_ps(vlo, x);
+            vhi = _mm256_max_ps(vhi, x);
+            vq = _mm256_add_ps(vq, _mm256_mul_ps(x, x));
+        }
+
+        __m256d q = _mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(vq)),
+                                  _mm256_cvtps_pd(_mm256_extractf128_ps(vq, 1)));
+        double d[4];
+        _mm256_storeu_pd(d, q);
+        *sum_sq += (d[0] + d[1]) + (d[2] + d[3]);
+    }
+
+    _mm256_storeu_ps(lanes, vlo);
+
+    for (int k = 0; k < 8; k++) {
+        *min = lanes[k] < *min ? lanes[k] : *min;
+    }
+
+    _mm256_storeu_ps(lanes, vhi);
+
+    for (int k = 0; k < 8; k++) {
+        *max = lanes[k] > *max ? lanes[k] : *max;
+    }
+
+    minmax_f32_sse2(src + i, count - i, min, max, sum_sq);
+}
+
+__attribute__((target("avx512f")))
+static void minmax_f32_avx512(const float* src, int count, float* min, float* max,
+                              double* sum_sq) {
+    __m512 vlo = _mm512_set1_ps(*min);
+    __m512 vhi = _mm512_set1_ps(*max);
+    int i = 0;
+
+    while (i + 16 <= count) {
+        int end = count - i < LEVEL_BLOCK_SAMPLES ? count : i + LEVEL_BLOCK_SAMPLES;
+        __m512 vq = _mm512_setzero_ps();
+
+        for (; i + 16 <= end; i += 16) {
+            __m512 x = _mm512_loadu_ps(src + i);
+            vlo = _mm512_min_ps(vlo, x);
+            vhi = _mm512_max_ps(vhi, x);
+            vq = _mm512_add_ps(vq, _mm512_mul_ps(x, x));
+        }
+
+        __m512d q = _mm512_add_pd(_mm512_cvtps_pd(_mm512_castps512_ps256(vq)),
+                                  _mm512_cvtps_pd(_mm256_castpd_ps(
+                                      _mm512_extractf64x4_pd(_mm512_castps_pd(vq), 1))));
+        *sum_sq += _mm512_reduce_add_pd(q);
+    }
+
+    float lo = _mm512_reduce_min_ps(vlo);
+    float hi = _mm512_reduce_max_ps(vhi);
+    *min = lo < *min ? lo : *min;
+    *max = hi > *max ? hi : *max;
+    minmax_f32_avx2(src + i, count - i, min, max, sum_sq);
+}
+
+#endif // CONVERT_X86
+
+/* fused convert and transpose */
+
+// frames per tile, a tile of 256 channels stays within L2 and each destination
+//   row of a tile covers whole cache lines
+#define PLANAR_TILE_FRAMES 64
+
+#define DEFINE_PLANAR_CONVERT(src_name, src_type, dst_name, dst_type) \
+void deinterleave_##src_name##_to_##dst_name(const src_type* src, int num_channels, int count, \
+                                             void* const* dst, int offset) { \
+    for (int t = 0; t < count; t += PLANAR_TILE_FRAMES) { \
+        int n = count - t < PLANAR_TILE_FRAMES ? count - t : PLANAR_TILE_FRAMES; \
+        const src_type* tile = src + (long)t * num_channels; \
+        for (int c = 0; c < num_channels; c++) { \
+            dst_type* out = (dst_type*)dst[c] + offset + t; \
+            for (int i = 0; i < n; i++) { \
+                out[i] = sample_##src_name##_to_##dst_name(tile[i * num_channels + c]); \
+            } \
+        } \
+    } \
+} \
+void interleave_##src_name##_to_##dst_name(const void* const* src, int offset, int num_channels, \
+                                           int count, dst_type* dst) { \
+    for (int t = 0; t < count; t += PLANAR_TILE_FRAMES) { \
+        int n = count - t < PLANAR_TILE_FRAMES ? count - t : PLANAR_TILE_FRAMES; \
+        dst_type* tile = dst + (long)t * num_channels; \
+        for (int c = 0; c < num_channels; c++) { \
+            const src_type* in = (const src_type*)src[c] + offset + t; \
+            for (int i = 0; i < n; i++) { \
+                tile[i * num_channels + c] = sample_##src_name##_to_##dst_name(in[i]); \
+            } \
+        } \
+    } \
+} \
+void gather_##src_name##_to_##dst_name(const src_type* src, int num_channels, int count, \
+                                       const int* map, int num_map, \
+                                       void* const* dst, int stride, int offset) { \
+    for (int t = 0; t < count; t += PLANAR_TILE_FRAMES) { \
+        int n = count - t < PLANAR_TILE_FRAMES ? count - t : PLANAR_TILE_FRAMES; \
+        const src_type* tile = src + (long)t * num_channels; \
+        for (int k = 0; k < num_map; k++) { \
+            const src_type* in = tile + map[k]; \
+            dst_type* out = (dst_type*)dst[k] + (long)(offset + t) * stride; \
+            for (int i = 0; i < n; i++) { \
+                out[(long)i * stride] = sample_##src_name##_to_##dst_name(in[i * num_channels]); \
+            } \
+        } \
+    } \
+}
+
+DEFINE_PLANAR_CONVERT(f32, float, f32, float)
+DEFINE_PLANAR_CONVERT(f32, float, i16, int16_t)
+DEFINE_PLANAR_CONVERT(f32, float, i32, int32_t)
+DEFINE_PLANAR_CONVERT(i16, int16_t, f32, float)
+DEFINE_PLANAR_CONVERT(i16, int16_t, i16, int16_t)
+DEFINE_PLANAR_CONVERT(i16, int16_t, i32, int32_t)
+DEFINE_PLANAR_CONVERT(i32, int32_t, f32, float)
+DEFINE_PLANAR_CONVERT(i32, int32_t, i16, int16_t)
+DEFINE_PLANAR_CONVERT(i32, int32_t, i32, int32_t)
+
+/* runtime dispatch */
+
+struct ConvertKernels {
+    ConvertIsa isa;
+    void (*f32_to_i16)(const float* src, int count, int16_t* dst);
+    void (*i16_to_f32)(const int16_t* src, int count, float* dst);
+    void (*f32_to_i32)(const float* src, int count, int32_t* dst);
+    void (*i32_to_f32)(const int32_t* src, int count, float* dst);
+    void (*i16_to_i32)(const int16_t* src, int count, int32_t* dst);
+    void (*i32_to_i16)(const int32_t* src, int count, int16_t* dst);
+    void (*i24_to_i32)(const uint8_t* src, int count, int32_t* dst);
+    void (*i32_to_i24)(const int32_t* src, int count, uint8_t* dst);
+    void (*i24_to_f32)(const uint8_t* src, int count, float* dst);
+    void (*f32_to_i24)(const float* src, int count, uint8_t* dst);
+    void (*i24_to_i16)(const uint8_t* src, int count, int16_t* dst);
+    void (*i16_to_i24)(const int16_t* src, int count, uint8_t* dst);
+    void (*scale_f32)(float* samples, const float* gains, int count);
+    void (*scale_i16)(int16_t* samples, const float* gains, int count);
+    void (*scale_i32)(int32_t* samples, const double* gains, int count);
+    void (*fir_f32)(const float* src, const int* offsets, const int* phases, int count,
+                    const float* filters, int num_taps, float* dst, int stride);
+    void (*mix_f32)(const float* const* src, int num_channels, int count,
+                    const float* matrix, int num_out, float* const* dst);
+    void (*quantize_f32)(const float* src, int count, float scale, float lo, float hi,
+                         int shift, int tpdf, uint32_t* rng, int32_t* dst);
+    void (*tpdf_f32)(int count, uint32_t* rng, float* dst);
+    void (*level_f32)(const float* src, int count, float* peak, double* sum, double* sum_sq,
+                      int64_t* num_clips);
+    void (*minmax_f32)(const float* src, int count, float* min, float* max, double* sum_sq);
+};
+
+static const struct ConvertKernels kernels_scalar = {
+    kConvertIsaScalar,
+    f32_to_i16_scalar, i16_to_f32_scalar, f32_to_i32_scalar,
+    i32_to_f32_scalar, i16_to_i32_scalar, i32_to_i16_scalar,
+    i24_to_i32_scalar, i32_to_i24_scalar, i24_to_f32_scalar, f32_to_i24_scalar,
+    i24_to_i16_scalar, i16_to_i24_scalar,
+    scale_f32_scalar, scale_i16_scalar, scale_i32_scalar,
+    fir_f32_scalar, mix_f32_scalar, quantize_f32_scalar, tpdf_f32_scalar,
+    level_f32_scalar, minmax_f32_scalar
+};
+
+#ifdef CONVERT_X86
+static const struct ConvertKernels kernels_sse2 = {
+    kConvertIsaSse2,
+    f32_to_i16_sse2, i16_to_f32_sse2, f32_to_i32_sse2,
+    i32_to_f32_sse2, i16_to_i32_sse2, i32_to_i16_sse2,
+    // byte shuffles of packed 24 bit need ssse3, sse2 keeps the scalar kernels
+    i24_to_i32_scalar, i32_to_i24_scalar, i24_to_f32_scalar, f32_to_i24_scalar,
+    i24_to_i16_scalar, i16_to_i24_scalar,
+    scale_f32_sse2, scale_i16_sse2, scale_i32_sse2,
+    fir_f32_sse2, mix_f32_sse2, quantize_f32_sse2, tpdf_f32_sse2,
+    level_f32_sse2, minmax_f32_sse2
+};
+
+static const struct ConvertKernels kernels_avx2 = {
+    kConvertIsaAvx2,
+    f32_to_i16_avx2, i16_to_f32_avx2, f32_to_i32_avx2,
+    i32_to_f32_avx2, i16_to_i32_avx2, i32_to_i16_avx2,
+    i24_to_i32_avx2, i32_to_i24_avx2, i24_to_f32_avx2, f32_to_i24_avx2,
+    i24_to_i16_avx2, i16_to_i24_avx2,
+    scale_f32_avx2, scale_i16_avx2, scale_i32_avx2,
+    fir_f32_avx2, mix_f32_avx2, quantize_f32_avx2, tpdf_f32_avx2,
+    level_f32_avx2, minmax_f32_avx2
+};
+
+static const struct ConvertKernels kernels_avx512 = {
+    kConvertIsaAvx512,
+    f32_to_i16_avx512, i16_to_f32_avx512, f32_to_i32_avx512,
+    i32_to_f32_avx512, i16_to_i32_avx512, i32_to_i16_avx512,
+    i24_to_i32_avx2, i32_to_i24_avx2, i24_to_f32_avx2, f32_to_i24_avx2,
+    i24_to_i16_avx2, i16_to_i24_avx2,
+    scale_f32_avx512, scale_i16_avx512, scale_i32_avx512,
+    fir_f32_avx512, mix_f32_avx512, quantize_f32_avx512, tpdf_f32_avx512,
+    level_f32_avx512, minmax_f32_avx512
+};
+#endif
+
+// scalar until cpu detection runs at load time
+static const struct ConvertKernels* kernels = &kernels_scalar;
+
+static int convert_isa_supported(ConvertIsa isa) {
+#ifdef CONVERT_X86
+    __builtin_cpu_init();
+
+    if (isa == kConvertIsaSse2) {
+        return __builtin_cpu_supports("sse2");
+    } else if (isa == kConvertIsaAvx2) {
+        return __builtin_cpu_supports("avx2");
+    } else if (isa == kConvertIsaAvx512) {
+        // avx512 kernels fall back to avx2 for tails
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2");
+    }
+#endif
+
+    return isa == kConvertIsaScalar;
+}
+
+int convert_set_isa(ConvertIsa isa) {
+    if (!convert_isa_supported(isa)) {
+        return -1;
+    }
+
+#ifdef CONVERT_X86
+    if (isa == kConvertIsaAvx512) {
+        kernels = &kernels_avx512;
+    } else if (isa == kConvertIsaAvx2) {
+        kernels = &kernels_avx2;
+    } else if (isa == kConvertIsaSse2) {
+        kernels = &kernels_sse2;
+    } else {
+        kernels = &kernels_scalar;
+    }
+#else
+    kernels = &kernels_scalar;
+#endif
+
+    return 0;
+}
+
+ConvertIsa convert_get_isa(void) {
+    return kernels->isa;
+}
+
+#ifdef __GNUC__
+__attribute__((constructor))
+#endif
+static void convert_init(void) {
+    if (convert_set_isa(kConvertIsaAvx512) != 0
+            && convert_set_isa(kConvertIsaAvx2) != 0
+            && convert_set_isa(kConvertIsaSse2) != 0) {
+        convert_set_isa(kConvertIsaScalar);
+    }
+}
+
+void convert_f32_to_i16(const float* src, int count, int16_t* dst) {
+    kernels->f32_to_i16(src, count, dst);
+}
+
+void convert_i16_to_f32(const int16_t* src, int count, float* dst) {
+    kernels->i16_to_f32(src, count, dst);
+}
+
+void convert_f32_to_i32(const float* src, int count, int32_t* dst) {
+    kernels->f32_to_i32(src, count, dst);
+}
+
+void convert_i32_to_f32(const int32_t* src, int count, float* dst) {
+    kernels->i32_to_f32(src, count, dst);
+}
+
+void convert_i16_to_i32(const int16_t* src, int count, int32_t* dst) {
+    kernels->i16_to_i32(src, count, dst);
+}
+
+void convert_i32_to_i16(const int32_t* src, int count, int16_t* dst) {
+    kernels->i32_to_i16(src, count, dst);
+}
+
+void convert_i24_to_i32(const uint8_t* src, int count, int32_t* dst) {
+    kernels->i24_to_i32(src, count, dst);
+}
+
+void convert_i32_to_i24(const int32_t* src, int count, uint8_t* dst) {
+    kernels->i32_to_i24(src, count, dst);
+}
+
+void convert_i24_to_f32(const uint8_t* src, int count, float* dst) {
+    kernels->i24_to_f32(src, count, dst);
+}
+
+void convert_f32_to_i24(const float* src, int count, uint8_t* dst) {
+    kernels->f32_to_i24(src, count, dst);
+}
+
+void convert_i24_to_i16(const uint8_t* src, int count, int16_t* dst) {
+    kernels->i24_to_i16(src, count, dst);
+}
+
+void convert_i16_to_i24(const int16_t* src, int count, uint8_t* dst) {
+    kernels->i16_to_i24(src, count, dst);
+}
+
+// per channel gains are repeated into a pattern covering whole frames, so the
+//   kernels scale contiguous samples by contiguous gains
+#define GAIN_PATTERN_SAMPLES 4096
+
+#define DEFINE_GAIN(name, type, gain_type) \
+void gain_##name(type* samples, int num_channels, int count, const float* gains) { \
+    gain_type pattern[GAIN_PATTERN_SAMPLES]; \
+    long total = (long)count * num_channels; \
+    if (num_channels > GAIN_PATTERN_SAMPLES) { \
+        for (long f = 0; f < total; f += num_channels) { \
+            for (int c = 0; c < num_channels; c += GAIN_PATTERN_SAMPLES) { \
+                int n = num_channels - c < GAIN_PATTERN_SAMPLES ? num_channels - c \
+                        : GAIN_PATTERN_SAMPLES; \
+                for (int k = 0; k < n; k++) { \
+                    pattern[k] = (gain_type)gains[c + k]; \
+                } \
+                kernels->scale_##name(samples + f + c, pattern, n); \
+            } \
+        } \
+        return; \
+    } \
+    int period = GAIN_PATTERN_SAMPLES / num_channels * num_channels; \
+    period = total < period ? (int)total : period; \
+    for (int k = 0; k < period; k++) { \
+        pattern[k] = (gain_type)gains[k % num_channels]; \
+    } \
+    for (long i = 0; i < total; i += period) { \
+        int n = total - i < period ? (int)(total - i) : period; \
+        kernels->scale_##name(samples + i, pattern, n); \
+    } \
+}
+
+DEFINE_GAIN(f32, float, float)
+DEFINE_GAIN(i16, int16_t, float)
+DEFINE_GAIN(i32, int32_t, double)
+
+void fir_f32(const float* src, const int* offsets, const int* phases, int count,
+             const float* filters, int num_taps, float* dst, int stride) {
+    kernels->fir_f32(src, offsets, phases, count, filters, num_taps, dst, stride);
+}
+
+void mix_f32(const float* const* src, int num_channels, int count, const float* matrix,
+             int num_out, float* const* dst) {
+    kernels->mix_f32(src, num_channels, count, matrix, num_out, dst);
+}
+
+/* float to integer with rounding or dither */
+
+#define DITHER_MAX_CHANNELS     256
+#define QUANTIZE_TILE_SAMPLES   4096
+
+// generator lanes kept per thread so that concurrent reads and writes dither without locks,
+//   the noise shaping error belongs to the stream and is passed in by the caller
+struct DitherState {
+    uint32_t rng[16];
+    int seeded;
+};
+
+static __thread struct DitherState dither_state;
+static uint64_t dither_seed;
+
+static struct DitherState* dither_get_state(void) {
+    struct DitherState* st = &dither_state;
+
+    if (!st->seeded) {
+        // splitmix64 of a per thread sequence, lanes never start at the zero state
+        uint64_t x = __atomic_add_fetch(&dither_seed, 1, __ATOMIC_RELAXED) * 0x9e3779b97f4a7c15ull;
+
+        for (int k = 0; k < 16; k++) {
+            uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            st->rng[k] = (uint32_t)(z ^ (z >> 31)) | 1u;
+        }
+
+        st->seeded = 1;
+    }
+
+    return st;
+}
+
+// tpdf dither with first order error feedback, y = q(x - e[n - 1]), the requantization
+//   error is shaped by (1 - z^-1) towards nyquist
+//   the recursion runs per channel in double, noise comes from the vector generator and
+//   the feedback error excludes clipping, so clipped samples feed back at most 1.5 lsb
+//   error_state of NULL starts from zero error and keeps nothing
+static void quantize_shaped(const float* src, int num_channels, int count, float scale,
+                            float lo, float hi, int shift, uint32_t* rng, float* error_state,
+                            int32_t* dst) {
+    float noise[QUANTIZE_TILE_SAMPLES];
+    double error[DITHER_MAX_CHANNELS];
+    long total = (long)count * num_channels;
+    int tile_samples = QUANTIZE_TILE_SAMPLES / num_channels * num_channels;
+
+    for (int c = 0; c < num_channels && c < DITHER_MAX_CHANNELS; c++) {
+        error[c] = error_state != NULL ? error_state[c] : 0.;
+    }
+
+    for (long t = 0; t < total; t += tile_samples) {
+        int n = total - t < tile_samples ? (int)(total - t) : tile_samples;
+        kernels->tpdf_f32(n, rng, noise);
+
+        // dithered input off the feedback path, noise[k] = src * scale + tpdf
+        for (int k = 0; k < n; k++) {
+            noise[k] += src[t + k] * scale;
+        }
+
+        for (int k = 0; k < n; k += num_channels) {
+            for (int c = 0; c < num_channels; c++) {
+                double* e = &error[c & (DITHER_MAX_CHANNELS - 1)];
+                double q = round_f64((double)noise[k + c] - *e);
+                *e = q - ((double)(src[t + k + c] * scale) - *e);
+                float v = (float)q;
+                v = v < hi ? v : hi;
+                v = v > lo ? v : lo;
+                dst[t + k + c] = (int32_t)((uint32_t)(int32_t)v << shift);
+            }
+        }
+    }
+
+    for (int c = 0; error_state != NULL && c < num_channels && c < DITHER_MAX_CHANNELS; c++) {
+        error_state[c] = (float)error[c];
+    }
+}
+
+// count frames quantized to bits, left-justified in int32
+static void quantize_frames(const float* src, int num_channels, int count, int mode, int bits,
+                            float* error_state, int32_t* dst) {
+    struct DitherState* st = dither_get_state();
+    int shift = 32 - bits;
+    // int16 keeps the scale of convert_f32_to_i16, hi of int32 is the largest float below 2^31
+    float scale = bits == 16 ? 32767.f : (float)(1u << (bits - 1));
+    float lo = -(float)(1u << (bits - 1));
+    float hi = bits == 32 ? 2147483520.f : (float)((1u << (bits - 1)) - 1);
+
+    if (mode == 3) {
+        quantize_shaped(src, num_channels, count, scale, lo, hi, shift, st->rng, error_state,
+                        dst);
+    } else {
+        kernels->quantize_f32(src, count * num_channels, scale, lo, hi, shift, mode == 2,
+                              st->rng, dst);
+    }
+}
+
+void quantize_f32_to_i16(const float* src, int num_channels, int count, int mode,
+                         float* error_state, int16_t* dst) {
+    int32_t tile[QUANTIZE_TILE_SAMPLES];
+    int tile_frames = QUANTIZE_TILE_SAMPLES / num_channels;
+
+    if (mode == 0) {
+        kernels->f32_to_i16(src, count * num_channels, dst);
+        return;
+    }
+
+    for (int t = 0; t < count; t += tile_frames) {
+        int n = count - t < tile_frames ? count - t : tile_frames;
+        long offset = (long)t * num_channels;
+        quantize_frames(src + offset, num_channels, n, mode, 16, error_state, tile);
+        kernels->i32_to_i16(tile, n * num_channels, dst + offset);
+    }
+}
+
+void quantize_f32_to_i24(const float* src, int num_channels, int count, int mode,
+                         float* error_state, uint8_t* dst) {
+    int32_t tile[QUANTIZE_TILE_SAMPLES];
+    int tile_frames = QUANTIZE_TILE_SAMPLES / num_channels;
+
+    if (mode == 0) {
+        kernels->f32_to_i24(src, count * num_channels, dst);
+        return;
+    }
+
+    for (int t = 0; t < count; t += tile_frames) {
+        int n = count - t < tile_frames ? count - t : tile_frames;
+        long offset = (long)t * num_channels;
+        quantize_frames(src + offset, num_channels, n, mode, 24, error_state, tile);
+        kernels->i32_to_i24(tile, n * num_channels, dst + 3 * offset);
+    }
+}
+
+void quantize_f32_to_i32(const float* src, int num_channels, int count, int mode, int bits,
+                         float* error_state, int32_t* dst) {
+    if (mode == 0) {
+        kernels->f32_to_i32(src, count * num_channels, dst);
+    } else {
+        quantize_frames(src, num_channels, count, mode, bits, error_state, dst);
+    }
+}
+
+void level_f32(const float* src, int count, float* peak, double* sum, double* sum_sq,
+               int64_t* num_clips) {
+    kernels->level_f32(src, count, peak, sum, sum_sq, num_clips);
+}
+
+void minmax_f32(const float* src, int count, float* min, float* max, double* sum_sq) {
+    kernels->minmax_f32(src, count, min, max, sum_sq);
+}
@@ -0,0 +1,189 @@
+#ifndef WAV_CONVERT
+#define WAV_CONVERT
+
+#include <stdint.h>
+
+/** Sample format convertion kernels
+ *    - scalar/SSE2/AVX2/AVX-512 implementations, best one picked once by cpu detection
+ *    - float to int convertion saturates instead of overflow
+ *    - int16/int24 <--> int32 keeps samples left-justified (shift by 16/8 bits)
+ */
+
+typedef enum {
+    kConvertIsaScalar = 0,
+    kConvertIsaSse2 = 1,
+    kConvertIsaAvx2 = 2,
+    kConvertIsaAvx512 = 3
+} ConvertIsa;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void convert_f32_to_i16(const float* src, int count, int16_t* dst);
+void convert_i16_to_f32(const int16_t* src, int count, float* dst);
+void convert_f32_to_i32(const float* src, int count, int32_t* dst);
+void convert_i32_to_f32(const int32_t* src, int count, float* dst);
+void convert_i16_to_i32(const int16_t* src, int count, int32_t* dst);
+void convert_i32_to_i16(const int32_t* src, int count, int16_t* dst);
+
+// packed 24 bit little endian samples, 3 bytes per sample
+void convert_i24_to_i32(const uint8_t* src, int count, int32_t* dst);
+void convert_i32_to_i24(const int32_t* src, int count, uint8_t* dst);
+void convert_i24_to_f32(const uint8_t* src, int count, float* dst);
+void convert_f32_to_i24(const float* src, int count, uint8_t* dst);
+void convert_i24_to_i16(const uint8_t* src, int count, int16_t* dst);
+void convert_i16_to_i24(const int16_t* src, int count, uint8_t* dst);
+
+/** fused convertion and (de)interleave, cache blocked over tiles of frames
+ *    deinterleave: interleaved src -> per channel arrays dst[c] + offset
+ *    interleave: per channel arrays src[c] + offset -> interleaved dst
+ *    gather: channel map[k] of interleaved src -> dst[k][(offset + i) * stride]
+ */
+
+#define DECLARE_PLANAR_CONVERT(src_name, src_type, dst_name, dst_type) \
+void deinterleave_##src_name##_to_##dst_name(const src_type* src, int num_channels, int count, \
+                                             void* const* dst, int offset); \
+void interleave_##src_name##_to_##dst_name(const void* const* src, int offset, int num_channels, \
+                                           int count, dst_type* dst); \
+void gather_##src_name##_to_##dst_name(const src_type* src, int num_channels, int count, \
+                                       const int* map, int num_map, \
+                                       void* const* dst, int stride, int offset);
+
+DECLARE_PLANAR_CONVERT(f32, float, f32, float)
+DECLARE_PLANAR_CONVERT(f32, float, i16, int16_t)
+DECLARE_PLANAR_CONVERT(f32, float, i32, int32_t)
+DECLARE_PLANAR_CONVERT(i16, int16_t, f32, float)
+DECLARE_PLANAR_CONVERT(i16, int16_t, i16, int16_t)
+DECLARE_PLANAR_CONVERT(i16, int16_t, i32, int32_t)
+DECLARE_PLANAR_CONVERT(i32, int32_t, f32, float)
+DECLARE_PLANAR_CONVERT(i32, int32_t, i16, int16_t)
+DECLARE_PLANAR_CONVERT(i32, int32_t, i32, int32_t)
+
+/** saturating gain in place on count interleaved frames, gains[c] scales channel c
+ *    int16/int32 samples are widened exactly (to float/double), scaled and rounded to
+ *    nearest integer without going through [-1, 1] float, float samples are clipped to [-1, 1]
+ */
+void gain_f32(float* samples, int num_channels, int count, const float* gains);
+void gain_i16(int16_t* samples, int num_channels, int count, const float* gains);
+void gain_i32(int32_t* samples, int num_channels, int count, const float* gains);
+
+/** polyphase fir over one channel of planar samples
+ *    dst[i * stride] = sum of filters[phases[i] * num_taps + k] * src[offsets[i] + k]
+ *    for k in [0, num_taps), num_taps must be a multiple of 16
+ *    phases NULL applies the first filter to every output (integer decimation)
+ */
+void fir_f32(const float* src, const int* offsets, const int* phases, int count,
+             const float* filters, int num_taps, float* dst, int stride);
+
+/** mixing matrix over count frames of per channel arrays
+ *    dst[o][i] = sum of matrix[o * num_channels + c] * src[c][i] for c in [0, num_channels)
+ */
+void mix_f32(const float* const* src, int num_channels, int count, const float* matrix,
+             int num_out, float* const* dst);
+
+/** float to integer over count interleaved frames, mode is a DitherMode of wav_file.h
+ *    0 truncates as convert_f32_to_*, 1 rounds to nearest, 2 adds tpdf dither of +-1 lsb
+ *    before rounding, 3 also shapes the error of each channel by first order feedback
+ *    error_state holds the shaping error of num_channels of one stream across calls,
+ *    NULL starts every call from zero error
+ *    dither comes from per thread xorshift generators in vector lanes, int32 output is
+ *    quantized to its top bits (e.g. 24 valid bits) and saturates like the convertion
+ */
+void quantize_f32_to_i16(const float* src, int num_channels, int count, int mode,
+                         float* error_state, int16_t* dst);
+void quantize_f32_to_i24(const float* src, int num_channels, int count, int mode,
+                         float* error_state, uint8_t* dst);
+void quantize_f32_to_i32(const float* src, int num_channels, int count, int mode, int bits,
+                         float* error_state, int32_t* dst);
+
+/** level statistics of count samples accumulated into the outputs
+ *    peak = max(peak, |src[i]|), sum += src[i], sum_sq += src[i]^2, num_clips counts
+ *    samples with |src[i]| >= 1, vector lanes sum in float over blocks of 1024 samples
+ */
+void level_f32(const float* src, int count, float* peak, double* sum, double* sum_sq,
+               int64_t* num_clips);
+
+/** min/max statistics of count samples accumulated into the outputs
+ *    min = min(min, src[i]), max = max(max, src[i]), sum_sq += src[i]^2
+ */
+void minmax_f32(const float* src, int count, float* min, float* max, double* sum_sq);
+
+// returns isa of the kernels in use
+ConvertIsa convert_get_isa(void);
+
+// force kernels of isa, returns 0 on success, -1 if isa is not supported by cpu
+int convert_set_isa(ConvertIsa isa);
+
+static inline const char* convert_isa_get_str(ConvertIsa isa) {
+    if (isa == kConvertIsaSse2) {
+        return "sse2";
+    } else if (isa == kConvertIsaAvx2) {
+        return "avx2";
+    } else if (isa == kConvertIsaAvx512) {
+        return "avx512";
+    }
+
+    return "scalar";
+}
+
+/* single sample convertion, same rounding and saturation as the kernels */
+
+static inline int16_t sample_f32_to_i16(float x) {
+    float v = x * 32767.f;
+    v = v < 32767.f ? v : 32767.f;
+    v = v > -32768.f ? v : -32768.f;
+    return (int16_t)v;
+}
+
+static inline float sample_i16_to_f32(int16_t x) {
+    return (float)x * (1.f / 32768.f);
+}
+
+static inline int32_t sample_f32_to_i32(float x) {
+    // 2147483520 is the largest float below 2^31
+    float v = x * 2147483648.f;
+    v = v < 2147483520.f ? v : 2147483520.f;
+    v = v > -2147483648.f ? v : -2147483648.f;
+    return (int32_t)v;
+}
+
+static inline float sample_i32_to_f32(int32_t x) {
+    return (float)x * (1.f / 2147483648.f);
+}
+
+static inline int32_t sample_i16_to_i32(int16_t x) {
+    return (int32_t)x * 65536;
+}
+
+static inline int16_t sample_i32_to_i16(int32_t x) {
+    return (int16_t)(x >> 16);
+}
+
+static inline int32_t sample_i24_to_i32(const uint8_t* p) {
+    return (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24));
+}
+
+static inline void sample_i32_to_i24(int32_t x, uint8_t* p) {
+    p[0] = (uint8_t)(x >> 8);
+    p[1] = (uint8_t)(x >> 16);
+    p[2] = (uint8_t)(x >> 24);
+}
+
+static inline float sample_f32_to_f32(float x) {
+    return x;
+}
+
+static inline int16_t sample_i16_to_i16(int16_t x) {
+    return x;
+}
+
+static inline int32_t sample_i32_to_i32(int32_t x) {
+    return x;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WAV_CONVERT
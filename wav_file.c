@@ -1,11 +1,26 @@
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
 #include "wav_file.h"
+#include "wav_convert.h"
+#include "wav_peaks.h"
+#include "wav_resample.h"
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdio_ext.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #define MAX_NUM_CHANNELS    256
 #define MAX_SAMPLE_RATE     (48000 * MAX_NUM_CHANNELS)
-#define MAX_DATA_SIZE       (1 << 30)
+#define MAX_BYTE_RATE       (1 << 30)
 #define DEFAULT_PACKET_SIZE (MAX_NUM_CHANNELS * 1024)
 
 /* wav header */
@@ -14,6 +29,10 @@
 (((uint32_t)b) << 8) | (((uint32_t)c) << 16) | (((uint32_t)d) << 24))
 
 #define ID_RIFF FOUR_CC('R', 'I', 'F', 'F')
+#define ID_RF64 FOUR_CC('R', 'F', '6', '4')
+#define ID_BW64 FOUR_CC('B', 'W', '6', '4')
+#define ID_DS64 FOUR_CC('d', 's', '6', '4')
+#define ID_JUNK FOUR_CC('J', 'U', 'N', 'K')
 #define ID_WAVE FOUR_CC('W', 'A', 'V', 'E')
 #define ID_FMT  FOUR_CC('f', 'm', 't', ' ')
 #define ID_DATA FOUR_CC('d', 'a', 't', 'a')
@@ -48,8 +67,21 @@ struct FmtSubchunk2 {
         uint8_t data4[8];
     } guid;
 };
+
+// RF64/BW64 64 bit sizes, replaces the 32 bit riff and data size set to 0xFFFFFFFF
+struct Ds64Chunk {
+    uint32_t riff_size_low;
+    uint32_t riff_size_high;
+    uint32_t data_size_low;
+    uint32_t data_size_high;
+    uint32_t sample_count_low;
+    uint32_t sample_count_high;
+    uint32_t table_length;
+};
 #pragma pack()
 
+#define RIFF_SIZE_MAX   0xFFFFFFFFu
+
 enum WavFormat {
     kWavFormatPcm = 0x0001,
     kWavFormatFloat = 0x0003,
@@ -63,11 +95,12 @@ struct WavHeader {
     int bytes_per_sample;
     int block_align;
     int valid_bits_per_sample;
-    long num_samples;
-    int data_offset;
+    int64_t num_samples;
+    int64_t data_offset;
+    int streaming;      // num_samples unknown until the end of stream is reached
 };
 
-static int wav_header_check(struct WavHeader* header) {
+static int wav_header_check(const struct WavHeader* header) {
     if (header->num_channels < 1 || header->num_channels > MAX_NUM_CHANNELS) {
         return -1;
     }
@@ -76,7 +109,7 @@ static int wav_header_check(struct WavHeader* header) {
         return -1;
     }
 
-    if (header->bytes_per_sample != 2 && header->bytes_per_sample != 4) {
+    if (header->bytes_per_sample < 2 || header->bytes_per_sample > 4) {
         return -1;
     }
 
@@ -91,6 +124,10 @@ static int wav_header_check(struct WavHeader* header) {
             return -1;
         }
 
+        if (header->bytes_per_sample == 3 && header->valid_bits_per_sample <= 16) {
+            return -1;
+        }
+
         break;
 
     case kWavFormatFloat:
@@ -104,55 +141,222 @@ static int wav_header_check(struct WavHeader* header) {
         return -1;
     }
 
-    if (header->sample_rate * header->num_channels * header->bytes_per_sample > MAX_DATA_SIZE) {
+    if ((int64_t)header->sample_rate * header->num_channels * header->bytes_per_sample
+            > MAX_BYTE_RATE) {
         return -1;
     }
 
-    // riff_id + riff_size + wave_id + fmt_id + fmt_size + data_id + data_size
-    int max_data_size = MAX_DATA_SIZE - sizeof(struct FmtSubchunk2) - sizeof(uint32_t) * 7;
-
-    if (header->num_samples * header->block_align > max_data_size) {
+    if (header->block_align != header->num_channels * header->bytes_per_sample) {
         return -1;
     }
 
-    if (header->num_samples % header->num_channels != 0) {
+    if (header->num_samples < 0) {
         return -1;
     }
 
     return 0;
 }
 
-static int wav_header_read(struct WavHeader* header, FILE* fp) {
-    uint32_t id = 0;
-    uint32_t size = 0;
+// positional read, retry on short read until size bytes or end of file
+static long pread_full(int fd, void* buf, size_t size, off_t offset) {
+    size_t done = 0;
 
-    // RIFF ID
-    if (fread(&id, sizeof(id), 1, fp) != 1 || id != ID_RIFF) {
-        return -1;
+    while (done < size) {
+        ssize_t ret = pread(fd, (char*)buf + done, size - done, offset + done);
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (ret <= 0) {
+            break;
+        }
+
+        done += ret;
+    }
+
+    return (long)done;
+}
+
+// opened file or stream shared by reader and its cursors
+struct WavSource {
+    int refs;
+    int fd;             // -1 once the file is memory mapped or for user io
+    void* map_addr;     // whole file mapping, NULL if not opened by wav_reader_open_mmap
+    size_t map_size;
+    const char* mem;    // caller buffer of wav_reader_open_memory, not owned
+    size_t mem_size;
+    struct WavIo io;    // io.read is NULL for regular files read by pread
+    int64_t io_position;
+    pthread_mutex_t io_lock;
+};
+
+static long fd_read(void* ctx, void* buf, size_t size) {
+    ssize_t ret = 0;
+
+    do {
+        ret = read(*(int*)ctx, buf, size);
+    } while (ret < 0 && errno == EINTR);
+
+    return (long)ret;
+}
+
+// read from stream position offset, streams without seek only move forward
+static long wav_source_read_io(struct WavSource* src, void* buf, size_t size, int64_t offset) {
+    size_t done = 0;
+
+    pthread_mutex_lock(&src->io_lock);
+
+    if (offset != src->io_position) {
+        if (src->io.seek != NULL) {
+            if (src->io.seek(src->io.ctx, offset, SEEK_SET) != offset) {
+                pthread_mutex_unlock(&src->io_lock);
+                return 0;
+            }
+        } else {
+            // skip forward by reading, e.g. unknown chunks of a pipe
+            char skip[4096];
+
+            while (src->io_position < offset) {
+                size_t request = offset - src->io_position < (int64_t)sizeof(skip)
+                                 ? (size_t)(offset - src->io_position) : sizeof(skip);
+                long ret = src->io.read(src->io.ctx, skip, request);
+
+                if (ret <= 0) {
+                    pthread_mutex_unlock(&src->io_lock);
+                    return 0;
+                }
+
+                src->io_position += ret;
+            }
+
+            if (src->io_position != offset) {
+                pthread_mutex_unlock(&src->io_lock);
+                return 0;
+            }
+        }
+
+        src->io_position = offset;
+    }
+
+    while (done < size) {
+        long ret = src->io.read(src->io.ctx, (char*)buf + done, size - done);
+
+        if (ret <= 0) {
+            break;
+        }
+
+        done += ret;
+    }
+
+    src->io_position += done;
+    pthread_mutex_unlock(&src->io_lock);
+    return (long)done;
+}
+
+// read size bytes at offset, retry on short read until size bytes or end of file
+static long wav_source_read(struct WavSource* src, void* buf, size_t size, int64_t offset) {
+    if (src->mem != NULL) {
+        if (offset < 0 || (uint64_t)offset >= src->mem_size) {
+            return 0;
+        }
+
+        size = size < src->mem_size - offset ? size : src->mem_size - offset;
+        memcpy(buf, src->mem + offset, size);
+        return (long)size;
+    }
+
+    if (src->io.read != NULL) {
+        return wav_source_read_io(src, buf, size, offset);
+    }
+
+    return pread_full(src->fd, buf, size, offset);
+}
+
+// returns size of the file, -1 for streams of unknown size
+static int64_t wav_source_get_size(struct WavSource* src) {
+    if (src->mem != NULL) {
+        return (int64_t)src->mem_size;
+    }
+
+    if (src->io.read == NULL) {
+        struct stat st;
+        return fstat(src->fd, &st) == 0 ? st.st_size : -1;
     }
 
-    // RIFF SIZE
-    if (fread(&size, sizeof(size), 1, fp) != 1) {
+    if (src->io.seek == NULL) {
         return -1;
     }
 
-    // WAVE ID
-    if (fread(&id, sizeof(id), 1, fp) != 1 || id != ID_WAVE) {
+    pthread_mutex_lock(&src->io_lock);
+    int64_t size = src->io.seek(src->io.ctx, 0, SEEK_END);
+
+    if (src->io.seek(src->io.ctx, src->io_position, SEEK_SET) != src->io_position) {
+        size = -1;
+    }
+
+    pthread_mutex_unlock(&src->io_lock);
+    return size;
+}
+
+#define HEADER_PROBE_SIZE   4096
+
+// leading bytes of the file fetched by one read, chunks past them are read from source
+struct HeaderProbe {
+    struct WavSource* src;
+    const char* data;   // buf, or the caller buffer parsed in place
+    int64_t size;
+    char buf[HEADER_PROBE_SIZE];
+};
+
+static long header_probe_read(struct HeaderProbe* probe, void* buf, size_t size, int64_t offset) {
+    if (offset + (int64_t)size <= probe->size) {
+        memcpy(buf, probe->data + offset, size);
+        return (long)size;
+    }
+
+    return wav_source_read(probe->src, buf, size, offset);
+}
+
+static int wav_header_read(struct WavHeader* header, struct WavSource* src) {
+    uint32_t riff[3] = {0, 0, 0};
+    off_t offset = 0;
+    int64_t ds64_data_size = -1;
+    struct HeaderProbe probe;
+
+    memset(header, 0, sizeof(*header));
+    probe.src = src;
+    probe.data = probe.buf;
+    probe.size = 0;
+
+    if (src->mem != NULL) {
+        probe.data = src->mem;
+        probe.size = (int64_t)src->mem_size;
+    } else if (src->io.read == NULL || src->io.seek != NULL) {
+        // streams without seek must not read past the data chunk header
+        probe.size = wav_source_read(src, probe.buf, sizeof(probe.buf), 0);
+    }
+
+    // RIFF ID, or RF64/BW64 with 64 bit sizes in ds64 chunk, RIFF SIZE, WAVE ID
+    if (header_probe_read(&probe, riff, sizeof(riff), offset) != sizeof(riff)
+            || (riff[0] != ID_RIFF && riff[0] != ID_RF64 && riff[0] != ID_BW64)
+            || riff[2] != ID_WAVE) {
         return -1;
     }
 
+    int is_rf64 = riff[0] != ID_RIFF;
+    offset += 12;
+
     for (;;) {
-        uint32_t chunk_id = 0;
+        uint32_t chunk[2] = {0, 0};
 
-        if (fread(&chunk_id, sizeof(chunk_id), 1, fp) != 1) {
+        if (header_probe_read(&probe, chunk, sizeof(chunk), offset) != sizeof(chunk)) {
             return -1;
         }
 
-        uint32_t chunk_size = 0;
-
-        if (fread(&chunk_size, sizeof(chunk_size), 1, fp) != 1) {
-            return -1;
-        }
+        uint32_t chunk_id = chunk[0];
+        uint32_t chunk_size = chunk[1];
+        offset += sizeof(chunk);
 
         if (chunk_id == ID_FMT) {
             if (chunk_size != sizeof(struct FmtSubchunk)
@@ -163,10 +367,12 @@ static int wav_header_read(struct WavHeader* header, FILE* fp) {
 
             struct FmtSubchunk2 fmt2;
 
-            if (fread(&fmt2, chunk_size, 1, fp) != 1) {
+            if (header_probe_read(&probe, &fmt2, chunk_size, offset) != chunk_size) {
                 return -1;
             }
 
+            offset += chunk_size;
+
             header->num_channels = (int)fmt2.fmt1.fmt.num_channels;
             header->sample_rate = (int)fmt2.fmt1.fmt.sample_rate;
             header->bytes_per_sample = (int)fmt2.fmt1.fmt.bits_per_sample / 8;
@@ -181,25 +387,43 @@ static int wav_header_read(struct WavHeader* header, FILE* fp) {
             } else {
                 return -1;
             }
+        } else if (chunk_id == ID_DS64 && is_rf64) {
+            struct Ds64Chunk ds64;
+
+            if (chunk_size < sizeof(ds64)
+                    || header_probe_read(&probe, &ds64, sizeof(ds64), offset) != sizeof(ds64)) {
+                return -1;
+            }
+
+            ds64_data_size = ((int64_t)ds64.data_size_high << 32) | ds64.data_size_low;
+            offset += chunk_size + (chunk_size & 1);
         } else if (chunk_id == ID_DATA) {
-            long data_size = 0;
-            header->data_offset = ftell(fp);
+            int64_t data_size = chunk_size;
+            int64_t file_size = wav_source_get_size(src);
+            header->data_offset = offset;
+
+            if (is_rf64 && chunk_size == RIFF_SIZE_MAX && ds64_data_size >= 0) {
+                data_size = ds64_data_size;
+            } else if (file_size < 0 && (data_size == 0 || data_size == RIFF_SIZE_MAX)) {
+                // stream of unknown length, read until end of stream
+                data_size = INT64_MAX - header->data_offset;
+                header->streaming = 1;
+            }
 
-            fseek(fp, 0, SEEK_END);
-            long left_size = ftell(fp) - header->data_offset;
-            fseek(fp, header->data_offset, SEEK_SET);
+            if (file_size >= 0 && (data_size == 0 || data_size > file_size - header->data_offset)) {
+                data_size = file_size - header->data_offset;
+            }
 
-            if (chunk_size == 0) {
-                data_size = left_size;
-            } else {
-                data_size = chunk_size < left_size ? chunk_size : left_size;
+            if (header->block_align <= 0) {
+                return -1;
             }
 
-            header->num_samples = data_size / header->bytes_per_sample;
+            header->num_samples = data_size / header->block_align;
 
-            return 0;
+            return wav_header_check(header);
         } else {
-            fseek(fp, chunk_size, SEEK_CUR);
+            // chunks are word aligned
+            offset += chunk_size + (chunk_size & 1);
             continue;
         }
     }
@@ -208,34 +432,65 @@ static int wav_header_read(struct WavHeader* header, FILE* fp) {
 }
 
 
-static int wav_header_write(struct WavHeader* header, FILE* fp) {
-    if (wav_header_check(header) != 0) {
-        return -1;
-    }
+#define WAV_HEADER_SIZE (3 * sizeof(uint32_t) + 2 * sizeof(uint32_t) + sizeof(struct Ds64Chunk) \
+                         + 2 * sizeof(uint32_t) + sizeof(struct FmtSubchunk) + 2 * sizeof(uint32_t))
 
-    uint32_t id = 0;
-    uint32_t size = 0;
+// write size bytes, retry on short write, returns the number of bytes written
+static long wav_io_write(const struct WavIo* io, const void* buf, size_t size) {
+    size_t done = 0;
 
-    id = ID_RIFF;
+    while (done < size) {
+        long ret = io->write(io->ctx, (const char*)buf + done, size - done);
 
-    if (fwrite(&id, sizeof(id), 1, fp) != 1) {
-        return -1;
-    }
+        if (ret <= 0) {
+            break;
+        }
 
-    if (fwrite(&size, sizeof(size), 1, fp) != 1) {
-        return -1;
+        done += ret;
     }
 
-    id = ID_WAVE;
+    return (long)done;
+}
+
+static char* put_u32(char* p, uint32_t value) {
+    memcpy(p, &value, sizeof(value));
+    return p + sizeof(value);
+}
 
-    if (fwrite(&id, sizeof(id), 1, fp) != 1) {
+// build wav header for data_size bytes of samples into buf of WAV_HEADER_SIZE, switch to
+//    RF64 if any size exceeds 32 bits, data_size -1 marks a stream of unknown length
+static int wav_header_build(const struct WavHeader* header, int64_t data_size, char* buf) {
+    if (wav_header_check(header) != 0) {
         return -1;
     }
 
-    id = ID_FMT;
-
-    if (fwrite(&id, sizeof(id), 1, fp) != 1) {
-        return -1;
+    char* p = buf;
+    uint32_t riff_id = ID_RIFF;
+    uint32_t riff_size32 = RIFF_SIZE_MAX;
+    uint32_t data_size32 = RIFF_SIZE_MAX;
+    struct Ds64Chunk ds64;
+
+    // JUNK chunk reserved after WAVE id becomes ds64
+    uint32_t ds64_id = ID_JUNK;
+    memset(&ds64, 0, sizeof(ds64));
+
+    if (data_size >= 0) {
+        int64_t riff_size = (int64_t)WAV_HEADER_SIZE - 2 * sizeof(uint32_t) + data_size
+                            + (data_size & 1);
+
+        if (riff_size > RIFF_SIZE_MAX || data_size > RIFF_SIZE_MAX) {
+            riff_id = ID_RF64;
+            ds64_id = ID_DS64;
+            ds64.riff_size_low = (uint32_t)riff_size;
+            ds64.riff_size_high = (uint32_t)(riff_size >> 32);
+            ds64.data_size_low = (uint32_t)data_size;
+            ds64.data_size_high = (uint32_t)(data_size >> 32);
+            ds64.sample_count_low = (uint32_t)(data_size / header->block_align);
+            ds64.sample_count_high = (uint32_t)(data_size / header->block_align >> 32);
+        } else {
+            riff_size32 = (uint32_t)riff_size;
+            data_size32 = (uint32_t)data_size;
+        }
     }
 
     struct FmtSubchunk fmt;
@@ -252,80 +507,52 @@ static int wav_header_write(struct WavHeader* header, FILE* fp) {
 
     fmt.bits_per_sample = (uint16_t)(header->bytes_per_sample * 8);
 
-    size = sizeof(struct FmtSubchunk);
-
-    if (fwrite(&size, sizeof(size), 1, fp) != 1) {
-        return -1;
-    }
-
-    if (fwrite(&fmt, size, 1, fp) != 1) {
-        return -1;
-    }
-
-    id = ID_DATA;
-
-    if (fwrite(&id, sizeof(id), 1, fp) != 1) {
-        return -1;
-    }
+    p = put_u32(p, riff_id);
+    p = put_u32(p, riff_size32);
+    p = put_u32(p, ID_WAVE);
+    p = put_u32(p, ds64_id);
+    p = put_u32(p, sizeof(ds64));
+    memcpy(p, &ds64, sizeof(ds64));
+    p += sizeof(ds64);
+    p = put_u32(p, ID_FMT);
+    p = put_u32(p, sizeof(fmt));
+    memcpy(p, &fmt, sizeof(fmt));
+    p += sizeof(fmt);
+    p = put_u32(p, ID_DATA);
+    p = put_u32(p, data_size32);
+    assert(p == buf + WAV_HEADER_SIZE);
+    return 0;
+}
 
-    size = 0;
+// write wav header for data_size bytes of samples in one io write
+static int wav_header_write(struct WavHeader* header, const struct WavIo* io, int64_t data_size) {
+    char buf[WAV_HEADER_SIZE];
 
-    if (fwrite(&size, sizeof(size), 1, fp) != 1) {
+    if (wav_header_build(header, data_size, buf) != 0
+            || wav_io_write(io, buf, sizeof(buf)) != sizeof(buf)) {
         return -1;
     }
 
-    header->data_offset = ftell(fp);
+    header->data_offset = WAV_HEADER_SIZE;
     return 0;
 }
 
-// write riff size and data size to wav header
-static void wav_header_write_end(struct WavHeader* header, FILE* fp) {
-    long file_size = ftell(fp);
-    uint32_t riff_size = file_size - 2 * sizeof(uint32_t);   // exclude RIFF header size
-    fseek(fp, sizeof(uint32_t), SEEK_SET);
-    fwrite(&riff_size, sizeof(uint32_t), 1, fp);
-    fseek(fp, header->data_offset - sizeof(uint32_t), SEEK_SET);
-    uint32_t data_size = header->num_samples * header->block_align;
-    fwrite(&data_size, sizeof(uint32_t), 1, fp);
-}
-
-/* inline functions */
-
-static inline void convert_f32_to_i16(const float* src, int count, int16_t* dst) {
-    for (int i = 0; i < count; i++) {
-        *dst++ = (int16_t)(*src++ * (((uint32_t)1 << 15) - 1));
+// rewrite wav header with the final sizes, only possible on seekable io
+static void wav_header_write_end(struct WavHeader* header, const struct WavIo* io) {
+    if (io->seek == NULL) {
+        return;
     }
-}
-
-static inline void convert_i16_to_f32(const int16_t* src, int count, float* dst) {
-    for (int i = 0; i < count; i++) {
-        *dst++ = (float) * src++ / ((uint32_t)1 << 15);
-    }
-}
 
-static inline void convert_f32_to_i32(const float* src, int count, int32_t* dst) {
-    for (int i = 0; i < count; i++) {
-        *dst++ = (int32_t)(*src++ * (((uint32_t)1 << 31) - 1));
-    }
-}
+    int64_t end = io->seek(io->ctx, 0, SEEK_CUR);
 
-static inline void convert_i32_to_f32(const int32_t* src, int count, float* dst) {
-    for (int i = 0; i < count; i++) {
-        *dst++ = (float) * src++ / ((uint32_t)1 << 31);
+    if (end >= 0 && io->seek(io->ctx, 0, SEEK_SET) == 0) {
+        wav_header_write(header, io, header->num_samples * header->block_align);
+        io->seek(io->ctx, end, SEEK_SET);
     }
 }
 
-static inline void convert_i16_to_i32(const int16_t* src, int count, int32_t* dst) {
-    for (int i = 0; i < count; i++) {
-        *dst++ = (int32_t) * src++ * ((uint32_t)1 << 24);
-    }
-}
 
-static inline void convert_i32_to_i16(const int32_t* src, int count, int16_t* dst) {
-    for (int i = 0; i < count; i++) {
-        *dst++ = (int16_t)(*src++ / ((uint32_t)1 << 24));
-    }
-}
+/* inline functions */
 
 static inline int compare_format(const enum WavFormat wav_format, int bits_per_sample,
                                  const SampleFormat format) {
@@ -334,6 +561,8 @@ static inline int compare_format(const enum WavFormat wav_format, int bits_per_s
     } else if (wav_format == kWavFormatPcm) {
         if (bits_per_sample == 16 && format == kSampleFormatI16) {
             return 0;
+        } else if (bits_per_sample == 24 && format == kSampleFormatI24) {
+            return 0;
         } else if (bits_per_sample == 32 && format == kSampleFormatI32) {
             return 0;
         }
@@ -342,291 +571,2729 @@ static inline int compare_format(const enum WavFormat wav_format, int bits_per_s
     return 1;
 }
 
+static inline SampleFormat wav_header_get_sample_format(const struct WavHeader* header) {
+    if (header->format == kWavFormatFloat) {
+        return kSampleFormatF32;
+    } else if (header->bytes_per_sample == 2) {
+        return kSampleFormatI16;
+    } else if (header->bytes_per_sample == 3) {
+        return kSampleFormatI24;
+    } else {
+        return kSampleFormatI32;
+    }
+}
+
+// convert count interleaved samples between any two sample formats
+static void convert_samples(SampleFormat src_format, const void* src, int count,
+                            SampleFormat dst_format, void* dst) {
+    if (src_format == dst_format) {
+        memcpy(dst, src, (size_t)count * sample_format_get_bytes_per_sample(src_format));
+    } else if (src_format == kSampleFormatF32) {
+        if (dst_format == kSampleFormatI16) {
+            convert_f32_to_i16((const float*)src, count, (int16_t*)dst);
+        } else if (dst_format == kSampleFormatI24) {
+            convert_f32_to_i24((const float*)src, count, (uint8_t*)dst);
+        } else {
+            convert_f32_to_i32((const float*)src, count, (int32_t*)dst);
+        }
+    } else if (src_format == kSampleFormatI16) {
+        if (dst_format == kSampleFormatF32) {
+            convert_i16_to_f32((const int16_t*)src, count, (float*)dst);
+        } else if (dst_format == kSampleFormatI24) {
+            convert_i16_to_i24((const int16_t*)src, count, (uint8_t*)dst);
+        } else {
+            convert_i16_to_i32((const int16_t*)src, count, (int32_t*)dst);
+        }
+    } else if (src_format == kSampleFormatI24) {
+        if (dst_format == kSampleFormatF32) {
+            convert_i24_to_f32((const uint8_t*)src, count, (float*)dst);
+        } else if (dst_format == kSampleFormatI16) {
+            convert_i24_to_i16((const uint8_t*)src, count, (int16_t*)dst);
+        } else {
+            convert_i24_to_i32((const uint8_t*)src, count, (int32_t*)dst);
+        }
+    } else {
+        if (dst_format == kSampleFormatF32) {
+            convert_i32_to_f32((const int32_t*)src, count, (float*)dst);
+        } else if (dst_format == kSampleFormatI16) {
+            convert_i32_to_i16((const int32_t*)src, count, (int16_t*)dst);
+        } else {
+            convert_i32_to_i24((const int32_t*)src, count, (uint8_t*)dst);
+        }
+    }
+}
+
+// quantize count interleaved float frames to integer dst_format with rounding or dither,
+//    error is the noise shaping state of the stream, NULL for positional access
+static void quantize_samples(DitherMode mode, float* error, const float* src, int num_channels,
+                             int count, SampleFormat dst_format, void* dst) {
+    if (dst_format == kSampleFormatI16) {
+        quantize_f32_to_i16(src, num_channels, count, mode, error, (int16_t*)dst);
+    } else if (dst_format == kSampleFormatI24) {
+        quantize_f32_to_i24(src, num_channels, count, mode, error, (uint8_t*)dst);
+    } else {
+        quantize_f32_to_i32(src, num_channels, count, mode, 32, error, (int32_t*)dst);
+    }
+}
+
+// samples of packed 24 bit files are staged as int32 for (de)interleave and gather
+#define STAGE_TILE_SAMPLES  (16 * 1024)
+
+// planar float samples per tile of mixing matrix input and output, kept in L1
+#define MIX_TILE_SAMPLES    4096
+
 /* wav reader */
 
 struct WavReader {
     struct WavHeader hdr;
-    long num_samples_left;
-    FILE* fp;
+    int64_t num_samples_left;
+    struct WavSource* src;
+    const char* data;   // data chunk inside the mapping or caller buffer
+    int num_read_channels;  // 0 reads all channels, otherwise reads channel_map[0, num_read_channels)
+    int channel_map[MAX_NUM_CHANNELS];
+    int num_mix_channels;   // 0 unless a mixing matrix is set, number of mixed channels read
+    int num_mix_inputs;     // file channels with a weight, mix_map[0, num_mix_inputs)
+    int mix_map[MAX_NUM_CHANNELS];
+    float* mix_matrix;      // num_mix_channels rows of num_mix_inputs weights
+    int output_rate;        // 0 reads at file sample rate
+    Resampler* resampler;   // reads, seek and positions are at output_rate if not NULL
+    DitherMode dither_mode; // float to integer convertion of reads
+    float dither_error[MAX_NUM_CHANNELS];   // noise shaping error of stream reads
 };
 
-WavReader* wav_reader_open(const char* filename) {
-    WavReader* reader = (WavReader*)malloc(sizeof(WavReader));
+static void wav_source_release(struct WavSource* src) {
+    if (__atomic_sub_fetch(&src->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        if (src->map_addr != NULL) {
+            munmap(src->map_addr, src->map_size);
+        }
 
-    if (reader == NULL) {
-        return NULL;
+        if (src->fd >= 0) {
+            close(src->fd);
+        }
+
+        pthread_mutex_destroy(&src->io_lock);
+        free(src);
     }
+}
+
+// create reader on opened fd, user io or caller buffer, fd is closed on failure
+static WavReader* wav_reader_create(int fd, const struct WavIo* io, const void* mem,
+                                    size_t mem_size) {
+    WavReader* reader = (WavReader*)malloc(sizeof(WavReader));
 
-    reader->fp = fopen(filename, "rb");
+    if (reader != NULL) {
+        reader->src = (struct WavSource*)calloc(1, sizeof(struct WavSource));
+    }
 
-    if (reader->fp == NULL) {
+    if (reader == NULL || reader->src == NULL) {
         free(reader);
+
+        if (fd >= 0) {
+            close(fd);
+        }
+
         return NULL;
     }
 
-    int read_success = wav_header_read(&reader->hdr, reader->fp);
+    struct stat st;
+    reader->src->refs = 1;
+    reader->src->fd = fd;
+    pthread_mutex_init(&reader->src->io_lock, NULL);
+
+    if (mem != NULL) {
+        reader->src->mem = (const char*)mem;
+        reader->src->mem_size = mem_size;
+    } else if (io != NULL) {
+        reader->src->io = *io;
+    } else if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        // pipes and devices can not pread, read them as a stream
+        reader->src->io.read = fd_read;
+        reader->src->io.ctx = &reader->src->fd;
+    }
+
+    int read_success = wav_header_read(&reader->hdr, reader->src);
 
     if (read_success != 0) {
-        fclose(reader->fp);
+        wav_source_release(reader->src);
         free(reader);
         return NULL;
     }
 
     reader->num_samples_left = reader->hdr.num_samples;
+    reader->data = mem != NULL ? (const char*)mem + reader->hdr.data_offset : NULL;
+    reader->num_read_channels = 0;
+    reader->num_mix_channels = 0;
+    reader->mix_matrix = NULL;
+    reader->output_rate = 0;
+    reader->resampler = NULL;
+    reader->dither_mode = kDitherModeTruncate;
+    memset(reader->dither_error, 0, sizeof(reader->dither_error));
     return reader;
 }
 
-void wav_reader_close(WavReader* reader) {
-    if (reader != NULL) {
-        fclose(reader->fp);
-        free(reader);
+WavReader* wav_reader_open(const char* filename) {
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return NULL;
     }
+
+    return wav_reader_create(fd, NULL, NULL, 0);
 }
 
-static int wav_reader_read(WavReader* reader, SampleFormat format,
-                           int num_samples, void* samples_buf);
+WavReader* wav_reader_open_io(const WavIo* io) {
+    if (io == NULL || io->read == NULL) {
+        return NULL;
+    }
 
-int wav_reader_read_f32(WavReader* reader, int num_samples, float* samples) {
-    return wav_reader_read(reader, kSampleFormatF32, num_samples, samples);
+    return wav_reader_create(-1, io, NULL, 0);
 }
 
-int wav_reader_read_i16(WavReader* reader, int num_samples, int16_t* samples) {
-    return wav_reader_read(reader, kSampleFormatI16, num_samples, samples);
+WavReader* wav_reader_open_memory(const void* data, size_t size) {
+    if (data == NULL) {
+        return NULL;
+    }
+
+    return wav_reader_create(-1, NULL, data, size);
 }
 
-static int wav_reader_read(WavReader* reader, SampleFormat format,
-                           int num_samples, void* samples_buf) {
-    num_samples = num_samples > reader->num_samples_left ? reader->num_samples_left : num_samples;
+WavReader* wav_reader_open_mmap(const char* filename) {
+    WavReader* reader = wav_reader_open(filename);
 
-    if (compare_format(reader->hdr.format, reader->hdr.bytes_per_sample * 8, format) == 0) {
-        size_t read = fread(samples_buf, reader->hdr.block_align, num_samples, reader->fp);
-        assert(read <= num_samples);
-        reader->num_samples_left -= read;
-        return read;
-    } else {
-        char tmp[DEFAULT_PACKET_SIZE];
-        int ret = 0;
+    if (reader == NULL) {
+        return NULL;
+    }
 
-        while (ret < num_samples && reader->num_samples_left > 0) {
-            int request = DEFAULT_PACKET_SIZE / reader->hdr.block_align;
+    if (reader->src->io.read != NULL) {
+        wav_reader_close(reader);
+        return NULL;
+    }
 
-            if (request > num_samples - ret) {
-                request = num_samples - ret;
-            }
+    size_t map_size = reader->hdr.data_offset + reader->hdr.num_samples * reader->hdr.block_align;
+    void* addr = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, reader->src->fd, 0);
 
-            size_t read_samples = fread(tmp, reader->hdr.block_align, request, reader->fp);
-            assert(read_samples <= request);
+    if (addr == MAP_FAILED) {
+        wav_reader_close(reader);
+        return NULL;
+    }
 
-            if (read_samples == 0) {
-                break;
-            }
+    // samples are consumed front to back once, let the kernel read ahead aggressively
+    madvise(addr, map_size, MADV_SEQUENTIAL);
 
-            reader->num_samples_left -= read_samples;
+    // the mapping stays valid after the descriptor is closed
+    close(reader->src->fd);
+    reader->src->fd = -1;
+    reader->src->map_addr = addr;
+    reader->src->map_size = map_size;
+    reader->data = (const char*)addr + reader->hdr.data_offset;
+    return reader;
+}
 
-            if (format == kSampleFormatF32) {    // i16/i32 --> f32
-                if (reader->hdr.bytes_per_sample == sizeof(int16_t)) {
-                    convert_i16_to_f32((int16_t*)tmp,
-                                       read_samples * reader->hdr.num_channels,
-                                       (float*)samples_buf + ret * reader->hdr.num_channels);
-                } else {
-                    convert_i32_to_f32((int32_t*)tmp,
-                                       read_samples * reader->hdr.num_channels,
-                                       (float*)samples_buf + ret * reader->hdr.num_channels);
-                }
-            } else if (reader->hdr.format == kWavFormatFloat) {  // f32 --> i16/i32
-                if (format == kSampleFormatI16) {
-                    convert_f32_to_i16((float*)tmp,
-                                       read_samples * reader->hdr.num_channels,
-                                       (int16_t*)samples_buf + ret * reader->hdr.num_channels);
-                } else {
-                    convert_f32_to_i32((float*)tmp,
-                                       read_samples * reader->hdr.num_channels,
-                                       (int32_t*)samples_buf + ret * reader->hdr.num_channels);
-                }
-            } else {    // i16 <--> i32
-                if (format == kSampleFormatI16) {
-                    convert_i32_to_i16((int32_t*)tmp,
-                                       read_samples * reader->hdr.num_channels,
-                                       (int16_t*)samples_buf + ret * reader->hdr.num_channels);
-                } else {
-                    convert_i16_to_i32((int16_t*)tmp,
-                                       read_samples * reader->hdr.num_channels,
-                                       (int32_t*)samples_buf + ret * reader->hdr.num_channels);
-                }
-            }
+WavReader* wav_reader_dup(WavReader* reader) {
+    WavReader* cursor = (WavReader*)malloc(sizeof(WavReader));
 
-            ret += read_samples;
+    if (cursor == NULL) {
+        return NULL;
+    }
 
-            if (read_samples < request) {
-                break;
-            }
+    *cursor = *reader;
+    cursor->num_samples_left = reader->hdr.num_samples;
+    memset(cursor->dither_error, 0, sizeof(cursor->dither_error));
+    cursor->resampler = NULL;
+
+    if (reader->mix_matrix != NULL) {
+        size_t size = (size_t)reader->num_mix_channels * reader->num_mix_inputs * sizeof(float);
+        cursor->mix_matrix = (float*)malloc(size > 0 ? size : 1);
+
+        if (cursor->mix_matrix == NULL) {
+            free(cursor);
+            return NULL;
         }
 
-        return ret;
+        memcpy(cursor->mix_matrix, reader->mix_matrix, size);
     }
-}
 
-int wav_reader_get_num_channels(WavReader* reader) {
-    return reader->hdr.num_channels;
-}
+    if (reader->resampler != NULL) {
+        cursor->resampler = resampler_create(wav_reader_get_num_read_channels(reader),
+                                             reader->hdr.sample_rate, reader->output_rate);
 
-int wav_reader_get_sample_rate(WavReader* reader) {
-    return reader->hdr.sample_rate;
+        if (cursor->resampler == NULL) {
+            free(cursor->mix_matrix);
+            free(cursor);
+            return NULL;
+        }
+    }
+    __atomic_add_fetch(&cursor->src->refs, 1, __ATOMIC_RELAXED);
+    return cursor;
 }
 
-int wav_reader_get_bits_per_sample(WavReader* reader) {
-    return reader->hdr.bytes_per_sample * 8;
+void wav_reader_close(WavReader* reader) {
+    if (reader != NULL) {
+        resampler_destroy(reader->resampler);
+        free(reader->mix_matrix);
+        wav_source_release(reader->src);
+        free(reader);
+    }
 }
 
-int wav_reader_get_block_align(WavReader* reader) {
-    return reader->hdr.block_align;
-}
+const void* wav_reader_get_data(WavReader* reader, int64_t* size) {
+    if (size != NULL) {
+        *size = reader->data != NULL ? reader->hdr.num_samples * reader->hdr.block_align : 0;
+    }
 
-int wav_reader_get_valid_bits_per_sample(WavReader* reader) {
-    return reader->hdr.valid_bits_per_sample;
+    return reader->data;
 }
 
-SampleFormat wav_reader_get_sample_format(WavReader* reader) {
-    if (reader->hdr.format == kWavFormatFloat) {
-        return kSampleFormatF32;
-    } else {
-        int bits_per_sample = wav_reader_get_bits_per_sample(reader);
-        return bits_per_sample == 16 ? kSampleFormatI16 : kSampleFormatI32;
+// number of frames at output rate, hdr.num_samples if not resampled
+static int64_t wav_reader_get_length(const WavReader* reader) {
+    if (reader->resampler == NULL || reader->hdr.streaming) {
+        return reader->hdr.num_samples;
     }
-}
 
-int wav_reader_get_num_samples(WavReader* reader) {
-    return reader->hdr.num_samples;
+    return resampler_get_out_length(reader->resampler, reader->hdr.num_samples);
 }
 
-/* wav writer */
+int wav_reader_seek(WavReader* reader, int64_t frame_offset, int whence) {
+    int64_t position = wav_reader_tell(reader);
+    int64_t length = wav_reader_get_length(reader);
 
-struct WavWriter {
-    struct WavHeader hdr;
-    FILE* fp;
-};
+    if (whence == SEEK_SET) {
+        position = frame_offset;
+    } else if (whence == SEEK_CUR) {
+        position += frame_offset;
+    } else if (whence == SEEK_END && !reader->hdr.streaming) {
+        position = length + frame_offset;
+    } else {
+        return -1;
+    }
 
-WavWriter* wav_writer_open(const char* filename, int num_channels, int sample_rate,
-                           SampleFormat format) {
-    WavWriter* writer = (WavWriter*)malloc(sizeof(WavWriter));
+    if (position < 0 || position > length) {
+        return -1;
+    }
 
-    if (writer == NULL) {
-        return NULL;
+    if (reader->resampler != NULL) {
+        resampler_seek(reader->resampler, position);
+        return 0;
     }
 
-    writer->fp = fopen(filename, "wb");
+    reader->num_samples_left = reader->hdr.num_samples - position;
+    return 0;
+}
 
-    if (writer->fp == NULL) {
-        free(writer);
-        return NULL;
+int64_t wav_reader_tell(WavReader* reader) {
+    if (reader->resampler != NULL) {
+        return resampler_tell(reader->resampler);
     }
 
-    int bits_per_sample = format == kSampleFormatI16 ? 16 : 32;
-    writer->hdr.format = format == kSampleFormatF32 ? kWavFormatFloat : kWavFormatPcm;
-    writer->hdr.num_channels = num_channels;
-    writer->hdr.sample_rate = sample_rate;
-    writer->hdr.bytes_per_sample = bits_per_sample / 8;
-    writer->hdr.block_align = num_channels * bits_per_sample / 8;
-    writer->hdr.valid_bits_per_sample = bits_per_sample;
-    writer->hdr.num_samples = 0;
-    writer->hdr.data_offset = -1;
+    return reader->hdr.num_samples - reader->num_samples_left;
+}
 
-    int write_success = wav_header_write(&writer->hdr, writer->fp);
+// (re)create resampler of read channels at output frame position
+static int wav_reader_init_resampler(WavReader* reader, int64_t position) {
+    Resampler* resampler = resampler_create(wav_reader_get_num_read_channels(reader),
+                                            reader->hdr.sample_rate, reader->output_rate);
 
-    if (write_success != 0) {
-        fclose(writer->fp);
-        free(writer);
-        return NULL;
+    if (resampler == NULL) {
+        return -1;
     }
 
-    return writer;
+    resampler_destroy(reader->resampler);
+    reader->resampler = resampler;
+    resampler_seek(resampler, position);
+    return 0;
 }
 
-void wav_writer_close(WavWriter* writer) {
-    if (writer != NULL) {
-        wav_header_write_end(&writer->hdr, writer->fp);
-        fclose(writer->fp);
-        free(writer);
+int wav_reader_set_output_rate(WavReader* reader, int sample_rate) {
+    if (sample_rate < 0 || sample_rate > MAX_SAMPLE_RATE) {
+        return -1;
+    }
+
+    // keep the read position at the same time
+    int64_t position = wav_reader_tell(reader);
+
+    if (reader->resampler != NULL) {
+        position = resampler_get_in_position(reader->resampler, position);
+    }
+
+    if (sample_rate == 0 || sample_rate == reader->hdr.sample_rate) {
+        resampler_destroy(reader->resampler);
+        reader->resampler = NULL;
+        reader->output_rate = 0;
+        reader->num_samples_left = reader->hdr.num_samples - position;
+        return 0;
+    }
+
+    int output_rate = reader->output_rate;
+    Resampler* resampler = reader->resampler;
+    reader->output_rate = sample_rate;
+    reader->resampler = NULL;
+
+    if (wav_reader_init_resampler(reader, 0) != 0) {
+        reader->output_rate = output_rate;
+        reader->resampler = resampler;
+        return -1;
     }
+
+    resampler_destroy(resampler);
+    resampler_seek(reader->resampler, resampler_get_out_length(reader->resampler, position));
+    return 0;
 }
 
-static long wav_writer_write(WavWriter* writer, SampleFormat format,
-                             int num_samples, const void* samples_buf);
+int wav_reader_set_dither_mode(WavReader* reader, DitherMode mode) {
+    if (mode < kDitherModeTruncate || mode > kDitherModeShaped) {
+        return -1;
+    }
 
-int wav_writer_write_f32(WavWriter* writer, int num_samples, const float* samples) {
-    return wav_writer_write(writer, kSampleFormatF32, num_samples, samples);
+    reader->dither_mode = mode;
+    return 0;
 }
 
-int wav_writer_write_i16(WavWriter* writer, int num_samples, const int16_t* samples) {
-    return wav_writer_write(writer, kSampleFormatI16, num_samples, samples);
+// destination of a read, interleaved samples or per channel arrays
+struct ReadTarget {
+    SampleFormat format;
+    void* samples;
+    void* const* channels;  // NULL for interleaved samples
+    float* dither_error;    // noise shaping error of stream reads, NULL for read_at
+};
+
+static int wav_reader_read_at(const WavReader* reader, int64_t frame_offset,
+                              const struct ReadTarget* target, int num_samples);
+static int wav_reader_read_resampled(WavReader* reader, const struct ReadTarget* target,
+                                     int num_samples);
+
+static int wav_reader_read(WavReader* reader, const struct ReadTarget* target, int num_samples) {
+    // stream reads carry the noise shaping of the reader from one read to the next
+    struct ReadTarget stream = *target;
+    stream.dither_error = reader->dither_error;
+
+    if (reader->resampler != NULL) {
+        return wav_reader_read_resampled(reader, &stream, num_samples);
+    }
+
+    int64_t position = reader->hdr.num_samples - reader->num_samples_left;
+    int ret = wav_reader_read_at(reader, position, &stream, num_samples);
+
+    if (ret < 0) {
+        return -1;
+    }
+
+    if (ret < num_samples && reader->hdr.streaming) {
+        // end of stream reached, length is known from now on
+        reader->hdr.num_samples = position + ret;
+        reader->hdr.streaming = 0;
+        reader->num_samples_left = 0;
+        return ret;
+    }
+
+    reader->num_samples_left -= ret;
+    return ret;
 }
 
-int wav_writer_write_i32(WavWriter* writer, int num_samples, const int32_t* samples) {
-    return wav_writer_write(writer, kSampleFormatI32, num_samples, samples);
+int wav_reader_read_f32(WavReader* reader, int num_samples, float* samples) {
+    struct ReadTarget target = {kSampleFormatF32, samples, NULL, NULL};
+    return wav_reader_read(reader, &target, num_samples);
 }
 
-static long wav_writer_write(WavWriter* writer, SampleFormat format,
-                             int num_samples, const void* samples_buf) {
-    if (num_samples + writer->hdr.num_samples > MAX_DATA_SIZE / writer->hdr.block_align) {
-        num_samples = MAX_DATA_SIZE / writer->hdr.block_align - writer->hdr.num_samples;
+int wav_reader_read_i16(WavReader* reader, int num_samples, int16_t* samples) {
+    struct ReadTarget target = {kSampleFormatI16, samples, NULL, NULL};
+    return wav_reader_read(reader, &target, num_samples);
+}
+
+int wav_reader_read_i32(WavReader* reader, int num_samples, int32_t* samples) {
+    struct ReadTarget target = {kSampleFormatI32, samples, NULL, NULL};
+    return wav_reader_read(reader, &target, num_samples);
+}
+
+int wav_reader_read_i24(WavReader* reader, int num_samples, uint8_t* samples) {
+    struct ReadTarget target = {kSampleFormatI24, samples, NULL, NULL};
+    return wav_reader_read(reader, &target, num_samples);
+}
+
+int wav_reader_read_planar_f32(WavReader* reader, int num_samples, float* const* channels) {
+    struct ReadTarget target = {kSampleFormatF32, NULL, (void* const*)channels, NULL};
+    return wav_reader_read(reader, &target, num_samples);
+}
+
+int wav_reader_read_planar_i16(WavReader* reader, int num_samples, int16_t* const* channels) {
+    struct ReadTarget target = {kSampleFormatI16, NULL, (void* const*)channels, NULL};
+    return wav_reader_read(reader, &target, num_samples);
+}
+
+int wav_reader_read_planar_i32(WavReader* reader, int num_samples, int32_t* const* channels) {
+    struct ReadTarget target = {kSampleFormatI32, NULL, (void* const*)channels, NULL};
+    return wav_reader_read(reader, &target, num_samples);
+}
+
+int wav_reader_read_at_f32(WavReader* reader, int64_t frame_offset, int num_samples,
+                           float* samples) {
+    struct ReadTarget target = {kSampleFormatF32, samples, NULL, NULL};
+    return wav_reader_read_at(reader, frame_offset, &target, num_samples);
+}
+
+int wav_reader_read_at_i16(WavReader* reader, int64_t frame_offset, int num_samples,
+                           int16_t* samples) {
+    struct ReadTarget target = {kSampleFormatI16, samples, NULL, NULL};
+    return wav_reader_read_at(reader, frame_offset, &target, num_samples);
+}
+
+int wav_reader_read_at_i32(WavReader* reader, int64_t frame_offset, int num_samples,
+                           int32_t* samples) {
+    struct ReadTarget target = {kSampleFormatI32, samples, NULL, NULL};
+    return wav_reader_read_at(reader, frame_offset, &target, num_samples);
+}
+
+int wav_reader_set_channels(WavReader* reader, const int* channels, int num_channels) {
+    if (channels == NULL || num_channels == 0) {
+        free(reader->mix_matrix);
+        reader->mix_matrix = NULL;
+        reader->num_mix_channels = 0;
+        reader->num_read_channels = 0;
+        return reader->resampler != NULL ? wav_reader_init_resampler(reader, wav_reader_tell(reader))
+               : 0;
     }
 
-    int out_bits_per_sample = writer->hdr.bytes_per_sample * 8;
+    if (num_channels < 0 || num_channels > MAX_NUM_CHANNELS) {
+        return -1;
+    }
 
-    if (compare_format(writer->hdr.format, writer->hdr.bytes_per_sample * 8, format) == 0) {
-        size_t write = fwrite(samples_buf, writer->hdr.block_align, num_samples, writer->fp);
-        assert(write == num_samples);
-        writer->hdr.num_samples += write;
-        return write;
+    for (int i = 0; i < num_channels; i++) {
+        if (channels[i] < 0 || channels[i] >= reader->hdr.num_channels) {
+            return -1;
+        }
+    }
+
+    free(reader->mix_matrix);
+    reader->mix_matrix = NULL;
+    reader->num_mix_channels = 0;
+    memcpy(reader->channel_map, channels, num_channels * sizeof(int));
+    reader->num_read_channels = num_channels;
+
+    // resampler keeps history of the read channels only
+    if (reader->resampler != NULL) {
+        return wav_reader_init_resampler(reader, wav_reader_tell(reader));
+    }
+
+    return 0;
+}
+
+int wav_reader_set_channel_mask(WavReader* reader, const uint8_t* mask) {
+    int channels[MAX_NUM_CHANNELS];
+    int num_channels = 0;
+
+    for (int c = 0; c < reader->hdr.num_channels; c++) {
+        if (mask[c / 8] & (1 << (c % 8))) {
+            channels[num_channels++] = c;
+        }
+    }
+
+    if (num_channels == 0) {
+        return -1;
+    }
+
+    return wav_reader_set_channels(reader, channels, num_channels);
+}
+
+int wav_reader_set_mix_matrix(WavReader* reader, const float* matrix, int num_out) {
+    if (matrix == NULL || num_out == 0) {
+        return wav_reader_set_channels(reader, NULL, 0);
+    }
+
+    if (num_out < 0 || num_out > MAX_NUM_CHANNELS) {
+        return -1;
+    }
+
+    // channels without weight in any row are neither read nor converted
+    int num_channels = reader->hdr.num_channels;
+    int map[MAX_NUM_CHANNELS];
+    int num_inputs = 0;
+
+    for (int c = 0; c < num_channels; c++) {
+        for (int o = 0; o < num_out; o++) {
+            if (matrix[o * num_channels + c] != 0.f) {
+                map[num_inputs++] = c;
+                break;
+            }
+        }
+    }
+
+    float* weights = (float*)malloc((size_t)num_out * (num_inputs > 0 ? num_inputs : 1)
+                                    * sizeof(float));
+
+    if (weights == NULL) {
+        return -1;
+    }
+
+    for (int o = 0; o < num_out; o++) {
+        for (int k = 0; k < num_inputs; k++) {
+            weights[o * num_inputs + k] = matrix[o * num_channels + map[k]];
+        }
+    }
+
+    free(reader->mix_matrix);
+    reader->mix_matrix = weights;
+    reader->num_mix_channels = num_out;
+    reader->num_mix_inputs = num_inputs;
+    memcpy(reader->mix_map, map, num_inputs * sizeof(int));
+    reader->num_read_channels = 0;
+
+    if (reader->resampler != NULL) {
+        return wav_reader_init_resampler(reader, wav_reader_tell(reader));
+    }
+
+    return 0;
+}
+
+int wav_reader_get_num_read_channels(WavReader* reader) {
+    if (reader->num_mix_channels > 0) {
+        return reader->num_mix_channels;
+    }
+
+    return reader->num_read_channels > 0 ? reader->num_read_channels : reader->hdr.num_channels;
+}
+
+// deinterleave count frames from src_format to per channel arrays of format
+static void deinterleave_samples(SampleFormat src_format, const void* src, int num_channels,
+                                 int count, SampleFormat format, void* const* dst, int offset) {
+    if (src_format == kSampleFormatF32) {
+        if (format == kSampleFormatF32) {
+            deinterleave_f32_to_f32((const float*)src, num_channels, count, dst, offset);
+        } else if (format == kSampleFormatI16) {
+            deinterleave_f32_to_i16((const float*)src, num_channels, count, dst, offset);
+        } else {
+            deinterleave_f32_to_i32((const float*)src, num_channels, count, dst, offset);
+        }
+    } else if (src_format == kSampleFormatI16) {
+        if (format == kSampleFormatF32) {
+            deinterleave_i16_to_f32((const int16_t*)src, num_channels, count, dst, offset);
+        } else if (format == kSampleFormatI16) {
+            deinterleave_i16_to_i16((const int16_t*)src, num_channels, count, dst, offset);
+        } else {
+            deinterleave_i16_to_i32((const int16_t*)src, num_channels, count, dst, offset);
+        }
+    } else {
+        if (format == kSampleFormatF32) {
+            deinterleave_i32_to_f32((const int32_t*)src, num_channels, count, dst, offset);
+        } else if (format == kSampleFormatI16) {
+            deinterleave_i32_to_i16((const int32_t*)src, num_channels, count, dst, offset);
+        } else {
+            deinterleave_i32_to_i32((const int32_t*)src, num_channels, count, dst, offset);
+        }
+    }
+}
+
+// interleave count frames from per channel arrays of format to dst_format
+static void interleave_samples(SampleFormat format, const void* const* src, int offset,
+                               int num_channels, int count, SampleFormat dst_format, void* dst) {
+    if (dst_format == kSampleFormatF32) {
+        if (format == kSampleFormatF32) {
+            interleave_f32_to_f32(src, offset, num_channels, count, (float*)dst);
+        } else if (format == kSampleFormatI16) {
+            interleave_i16_to_f32(src, offset, num_channels, count, (float*)dst);
+        } else {
+            interleave_i32_to_f32(src, offset, num_channels, count, (float*)dst);
+        }
+    } else if (dst_format == kSampleFormatI16) {
+        if (format == kSampleFormatF32) {
+            interleave_f32_to_i16(src, offset, num_channels, count, (int16_t*)dst);
+        } else if (format == kSampleFormatI16) {
+            interleave_i16_to_i16(src, offset, num_channels, count, (int16_t*)dst);
+        } else {
+            interleave_i32_to_i16(src, offset, num_channels, count, (int16_t*)dst);
+        }
+    } else {
+        if (format == kSampleFormatF32) {
+            interleave_f32_to_i32(src, offset, num_channels, count, (int32_t*)dst);
+        } else if (format == kSampleFormatI16) {
+            interleave_i16_to_i32(src, offset, num_channels, count, (int32_t*)dst);
+        } else {
+            interleave_i32_to_i32(src, offset, num_channels, count, (int32_t*)dst);
+        }
+    }
+}
+
+// gather channels map[0, num_map) of count frames from src_format to dst[k] with stride
+static void wav_reader_gather(const WavReader* reader, const int* map, int num_map,
+                              SampleFormat src_format, const void* src, int count,
+                              SampleFormat format, void* const* dst, int stride, int offset) {
+    int num_channels = reader->hdr.num_channels;
+
+    if (src_format == kSampleFormatF32) {
+        if (format == kSampleFormatF32) {
+            gather_f32_to_f32((const float*)src, num_channels, count, map, num_map, dst, stride, offset);
+        } else if (format == kSampleFormatI16) {
+            gather_f32_to_i16((const float*)src, num_channels, count, map, num_map, dst, stride, offset);
+        } else {
+            gather_f32_to_i32((const float*)src, num_channels, count, map, num_map, dst, stride, offset);
+        }
+    } else if (src_format == kSampleFormatI16) {
+        if (format == kSampleFormatF32) {
+            gather_i16_to_f32((const int16_t*)src, num_channels, count, map, num_map, dst, stride, offset);
+        } else if (format == kSampleFormatI16) {
+            gather_i16_to_i16((const int16_t*)src, num_channels, count, map, num_map, dst, stride, offset);
+        } else {
+            gather_i16_to_i32((const int16_t*)src, num_channels, count, map, num_map, dst, stride, offset);
+        }
+    } else {
+        if (format == kSampleFormatF32) {
+            gather_i32_to_f32((const int32_t*)src, num_channels, count, map, num_map, dst, stride, offset);
+        } else if (format == kSampleFormatI16) {
+            gather_i32_to_i16((const int32_t*)src, num_channels, count, map, num_map, dst, stride, offset);
+        } else {
+            gather_i32_to_i32((const int32_t*)src, num_channels, count, map, num_map, dst, stride, offset);
+        }
+    }
+}
+
+// returns non-zero if float samples are quantized with rounding or dither for target
+static int wav_reader_dithers(const WavReader* reader, const struct ReadTarget* target) {
+    return reader->dither_mode != kDitherModeTruncate && target->format != kSampleFormatF32;
+}
+
+// quantize count interleaved float frames of num_channels to target from frame done,
+//    planar targets are staged in int32 tiles and deinterleaved
+static void wav_reader_quantize(const WavReader* reader, const struct ReadTarget* target,
+                                const float* src, int num_channels, int count, int done) {
+    if (target->channels == NULL) {
+        int bytes_per_sample = sample_format_get_bytes_per_sample(target->format);
+        quantize_samples(reader->dither_mode, target->dither_error, src, num_channels, count,
+                         target->format,
+                         (char*)target->samples + (long)done * num_channels * bytes_per_sample);
+    } else {
+        int32_t tile[STAGE_TILE_SAMPLES];
+        int tile_samples = STAGE_TILE_SAMPLES / num_channels;
+
+        for (int t = 0; t < count; t += tile_samples) {
+            int n = count - t < tile_samples ? count - t : tile_samples;
+            quantize_samples(reader->dither_mode, target->dither_error,
+                             src + (long)t * num_channels, num_channels, n, target->format, tile);
+            deinterleave_samples(target->format, tile, num_channels, n, target->format,
+                                 target->channels, done + t);
+        }
+    }
+}
+
+// mix count frames of src_format samples to target from frame done, tile by tile only
+//    channels with a weight are gathered to planar float and mixed into the output
+static void wav_reader_mix(const WavReader* reader, const struct ReadTarget* target,
+                           SampleFormat src_format, const void* src, int count, int done) {
+    float in_tile[MIX_TILE_SAMPLES];
+    float out_tile[MIX_TILE_SAMPLES];
+    void* in[MAX_NUM_CHANNELS];
+    void* out[MAX_NUM_CHANNELS];
+    int num_inputs = reader->num_mix_inputs;
+    int num_out = reader->num_mix_channels;
+    int frame_size = reader->hdr.num_channels * sample_format_get_bytes_per_sample(src_format);
+    int bytes_per_sample = sample_format_get_bytes_per_sample(target->format);
+    int tile_frames = MIX_TILE_SAMPLES / (num_inputs > num_out ? num_inputs : num_out);
+
+    // float planar or mono output is written by the mix kernel directly
+    int direct = target->format == kSampleFormatF32 && (target->channels != NULL || num_out == 1);
+
+    for (int k = 0; k < num_inputs; k++) {
+        in[k] = in_tile + k * tile_frames;
+    }
+
+    for (int t = 0; t < count; t += tile_frames) {
+        int n = count - t < tile_frames ? count - t : tile_frames;
+
+        for (int o = 0; o < num_out; o++) {
+            if (!direct) {
+                out[o] = out_tile + o * tile_frames;
+            } else if (target->channels != NULL) {
+                out[o] = (float*)target->channels[o] + done + t;
+            } else {
+                out[o] = (float*)target->samples + done + t;
+            }
+        }
+
+        wav_reader_gather(reader, reader->mix_map, num_inputs, src_format,
+                          (const char*)src + (long)t * frame_size, n, kSampleFormatF32,
+                          in, 1, 0);
+        mix_f32((const float* const*)in, num_inputs, n, reader->mix_matrix, num_out,
+                (float* const*)out);
+
+        if (direct) {
+            continue;
+        } else if (wav_reader_dithers(reader, target)) {
+            // input tile is free again, holds the interleaved mix for quantization
+            interleave_samples(kSampleFormatF32, (const void* const*)out, 0, num_out, n,
+                               kSampleFormatF32, in_tile);
+            wav_reader_quantize(reader, target, in_tile, num_out, n, done + t);
+        } else if (target->channels != NULL) {
+            for (int o = 0; o < num_out; o++) {
+                convert_samples(kSampleFormatF32, out[o], n, target->format,
+                                (char*)target->channels[o] + (long)(done + t) * bytes_per_sample);
+            }
+        } else {
+            interleave_samples(kSampleFormatF32, (const void* const*)out, 0, num_out, n,
+                               target->format, (char*)target->samples
+                               + (long)(done + t) * num_out * bytes_per_sample);
+        }
+    }
+}
+
+// (de)interleave or gather count frames of src_format samples to target, from frame done
+static void wav_reader_scatter(const WavReader* reader, const struct ReadTarget* target,
+                               SampleFormat src_format, const void* src, int count, int done) {
+    if (reader->num_mix_channels > 0) {
+        wav_reader_mix(reader, target, src_format, src, count, done);
+    } else if (target->channels != NULL) {
+        if (reader->num_read_channels > 0) {
+            wav_reader_gather(reader, reader->channel_map, reader->num_read_channels,
+                              src_format, src, count, target->format, target->channels, 1, done);
+        } else {
+            deinterleave_samples(src_format, src, reader->hdr.num_channels, count,
+                                 target->format, target->channels, done);
+        }
+    } else {
+        int bytes_per_sample = sample_format_get_bytes_per_sample(target->format);
+        void* dst[MAX_NUM_CHANNELS];
+
+        for (int k = 0; k < reader->num_read_channels; k++) {
+            dst[k] = (char*)target->samples + k * bytes_per_sample;
+        }
+
+        wav_reader_gather(reader, reader->channel_map, reader->num_read_channels, src_format,
+                          src, count, target->format, dst, reader->num_read_channels, done);
+    }
+}
+
+// write count frames of interleaved file samples src to target, starting at frame done
+static void wav_reader_emit(const WavReader* reader, const struct ReadTarget* target,
+                            const void* src, int count, int done) {
+    SampleFormat file_format = wav_header_get_sample_format(&reader->hdr);
+    int num_channels = reader->hdr.num_channels;
+
+    int dither = file_format == kSampleFormatF32 && wav_reader_dithers(reader, target);
+
+    if (target->channels == NULL && reader->num_read_channels == 0
+            && reader->num_mix_channels == 0) {
+        int bytes_per_sample = sample_format_get_bytes_per_sample(target->format);
+        void* dst = (char*)target->samples + (long)done * num_channels * bytes_per_sample;
+
+        if (dither) {
+            quantize_samples(reader->dither_mode, target->dither_error, (const float*)src,
+                             num_channels, count, target->format, dst);
+        } else {
+            convert_samples(file_format, src, count * num_channels, target->format, dst);
+        }
+    } else if (dither && reader->num_mix_channels == 0) {
+        // quantize whole frames in target format, then select channels without convertion
+        int32_t tile[STAGE_TILE_SAMPLES];
+        int tile_samples = STAGE_TILE_SAMPLES / num_channels;
+
+        for (int t = 0; t < count; t += tile_samples) {
+            int n = count - t < tile_samples ? count - t : tile_samples;
+            quantize_samples(reader->dither_mode, target->dither_error,
+                             (const float*)src + (long)t * num_channels, num_channels, n,
+                             target->format, tile);
+            wav_reader_scatter(reader, target, target->format, tile, n, done + t);
+        }
+    } else if (file_format == kSampleFormatI24) {
+        int32_t tile[STAGE_TILE_SAMPLES];
+        int tile_samples = STAGE_TILE_SAMPLES / num_channels;
+
+        for (int t = 0; t < count; t += tile_samples) {
+            int n = count - t < tile_samples ? count - t : tile_samples;
+            convert_i24_to_i32((const uint8_t*)src + (long)t * reader->hdr.block_align,
+                               n * num_channels, tile);
+            wav_reader_scatter(reader, target, kSampleFormatI32, tile, n, done + t);
+        }
+    } else {
+        wav_reader_scatter(reader, target, file_format, src, count, done);
+    }
+}
+
+// clear bits below valid_bits_per_sample of int32 samples read
+static void wav_reader_mask_valid_bits(const WavReader* reader, const struct ReadTarget* target,
+                                       int num_samples) {
+    int valid_bits = reader->hdr.valid_bits_per_sample;
+
+    if (target->format != kSampleFormatI32 || reader->hdr.format == kWavFormatFloat
+            || valid_bits >= reader->hdr.bytes_per_sample * 8) {
+        return;
+    }
+
+    int32_t mask = (int32_t)(~0u << (32 - valid_bits));
+    int num_channels = wav_reader_get_num_read_channels((WavReader*)reader);
+
+    if (target->channels != NULL) {
+        for (int c = 0; c < num_channels; c++) {
+            int32_t* samples = (int32_t*)target->channels[c];
+
+            for (int i = 0; i < num_samples; i++) {
+                samples[i] &= mask;
+            }
+        }
+    } else {
+        int32_t* samples = (int32_t*)target->samples;
+
+        for (long i = 0; i < (long)num_samples * num_channels; i++) {
+            samples[i] &= mask;
+        }
+    }
+}
+
+static int wav_reader_read_block(const WavReader* reader, int64_t frame_offset,
+                                 const struct ReadTarget* target, int num_samples);
+
+// stateless read of num_samples frames starting at frame_offset, safe to call from many threads
+static int wav_reader_read_at(const WavReader* reader, int64_t frame_offset,
+                              const struct ReadTarget* target, int num_samples) {
+    if (frame_offset < 0 || frame_offset > reader->hdr.num_samples || num_samples < 0) {
+        return -1;
+    }
+
+    // packed 24 bit samples are only returned interleaved with all channels
+    if (target->format == kSampleFormatI24 && (target->channels != NULL
+            || reader->num_read_channels > 0 || reader->num_mix_channels > 0)) {
+        return -1;
+    }
+
+    if (num_samples > reader->hdr.num_samples - frame_offset) {
+        num_samples = reader->hdr.num_samples - frame_offset;
+    }
+
+    int ret = wav_reader_read_block(reader, frame_offset, target, num_samples);
+    wav_reader_mask_valid_bits(reader, target, ret);
+    return ret;
+}
+
+static int wav_reader_read_block(const WavReader* reader, int64_t frame_offset,
+                                 const struct ReadTarget* target, int num_samples) {
+    int block_align = reader->hdr.block_align;
+    off_t offset = reader->hdr.data_offset + frame_offset * block_align;
+    int copy = target->channels == NULL && reader->num_read_channels == 0
+               && reader->num_mix_channels == 0
+               && compare_format(reader->hdr.format, reader->hdr.bytes_per_sample * 8,
+                                 target->format) == 0;
+
+    if (reader->data != NULL) {
+        // mapped file, read or convert in place without intermediate buffer
+        const char* src = reader->data + frame_offset * block_align;
+
+        if (copy) {
+            memcpy(target->samples, src, (size_t)num_samples * block_align);
+        } else {
+            wav_reader_emit(reader, target, src, num_samples, 0);
+        }
+
+        return num_samples;
+    }
+
+    if (copy) {
+        long read = wav_source_read(reader->src, target->samples, (size_t)num_samples * block_align,
+                               offset);
+        assert(read <= (long)num_samples * block_align);
+        return read / block_align;
     } else {
         char tmp[DEFAULT_PACKET_SIZE];
         int ret = 0;
 
         while (ret < num_samples) {
-            int request = DEFAULT_PACKET_SIZE / writer->hdr.block_align;
+            int request = DEFAULT_PACKET_SIZE / block_align;
 
             if (request > num_samples - ret) {
                 request = num_samples - ret;
             }
 
-            if (writer->hdr.format == kWavFormatFloat) {    // i32/i16 -> f32
-                if (format == kSampleFormatI32) {   // i32 -> f32
-                    convert_i32_to_f32((int32_t*)samples_buf + ret * writer->hdr.num_channels,
-                                       request * writer->hdr.num_channels,
-                                       (float*)tmp);
-                } else {    // i16 -> f32
-                    convert_i16_to_f32((int16_t*)samples_buf + ret * writer->hdr.num_channels,
-                                       request * writer->hdr.num_channels,
-                                       (float*)tmp);
-                }
-            } else if (out_bits_per_sample == 32) {    // f32/i16 -> i32
-                if (format == kSampleFormatF32) {   // f32 -> i32
-                    convert_f32_to_i32((float*)samples_buf + ret * writer->hdr.num_channels,
-                                       request * writer->hdr.num_channels,
-                                       (int32_t*)tmp);
-                } else {    // i16 -> i32
-                    convert_i16_to_i32((int16_t*)samples_buf + ret * writer->hdr.num_channels,
-                                       request * writer->hdr.num_channels,
-                                       (int32_t*)tmp);
-                }
-            } else if (out_bits_per_sample == 16) {    // f32/i32 -> i16
-                if (format == kSampleFormatF32) {   // f32 -> i16
-                    convert_f32_to_i16((float*)samples_buf + ret * writer->hdr.num_channels,
-                                       request * writer->hdr.num_channels,
-                                       (int16_t*)tmp);
-                } else {    // i32 -> i16
-                    convert_i32_to_i16((int32_t*)samples_buf + ret * writer->hdr.num_channels,
-                                       request * writer->hdr.num_channels,
-                                       (int16_t*)tmp);
-                }
+            long read = wav_source_read(reader->src, tmp, (size_t)request * block_align, offset);
+            int read_samples = read / block_align;
+            assert(read_samples <= request);
+
+            if (read_samples == 0) {
+                break;
             }
 
-            size_t write_samples = fwrite(tmp, writer->hdr.block_align, request, writer->fp);
-            assert(write_samples == request);
-            writer->hdr.num_samples += write_samples;
-            ret += write_samples;
+            offset += (off_t)read_samples * block_align;
+            wav_reader_emit(reader, target, tmp, read_samples, ret);
+            ret += read_samples;
+
+            if (read_samples < request) {
+                break;
+            }
         }
 
         return ret;
     }
 }
+
+// append input frames at file rate to the resampler, zeros outside the data chunk
+//    file samples are converted and deinterleaved straight into the resampler history
+static int wav_reader_fill_resampler(WavReader* reader) {
+    float* channels[MAX_NUM_CHANNELS];
+    int num_channels = wav_reader_get_num_read_channels(reader);
+    int max_frames = 0;
+    int64_t position = resampler_get_input(reader->resampler, channels, &max_frames);
+    int count = max_frames;
+    int ret = 0;
+
+    if (max_frames <= 0) {
+        return -1;
+    }
+
+    if (position < 0) {
+        count = -position < max_frames ? (int)-position : max_frames;
+    } else if (position < reader->hdr.num_samples) {
+        struct ReadTarget target = {kSampleFormatF32, NULL, (void* const*)channels, NULL};
+
+        if (count > reader->hdr.num_samples - position) {
+            count = (int)(reader->hdr.num_samples - position);
+        }
+
+        ret = wav_reader_read_block(reader, position, &target, count);
+
+        if (ret < count && reader->hdr.streaming) {
+            // end of stream reached, length is known from now on
+            reader->hdr.num_samples = position + ret;
+            reader->hdr.streaming = 0;
+        }
+    }
+
+    for (int c = 0; c < num_channels; c++) {
+        memset(channels[c] + ret, 0, (size_t)(count - ret) * sizeof(float));
+    }
+
+    resampler_commit_input(reader->resampler, count);
+    return 0;
+}
+
+// read num_samples frames at output rate, float output is written by the fir kernels
+//    directly, other formats go through a float tile
+static int wav_reader_read_resampled(WavReader* reader, const struct ReadTarget* target,
+                                     int num_samples) {
+    int num_channels = wav_reader_get_num_read_channels(reader);
+    int bytes_per_sample = sample_format_get_bytes_per_sample(target->format);
+    float tile[STAGE_TILE_SAMPLES];
+    float* dst[MAX_NUM_CHANNELS];
+    int done = 0;
+
+    if (num_samples < 0 || (target->format == kSampleFormatI24 && target->channels != NULL)) {
+        return -1;
+    }
+
+    while (done < num_samples) {
+        int64_t left = wav_reader_get_length(reader) - resampler_tell(reader->resampler);
+        int request = num_samples - done;
+        int stride = num_channels;
+        int ret = 0;
+
+        if (left <= 0) {
+            break;
+        }
+
+        request = left < request ? (int)left : request;
+
+        if (target->format == kSampleFormatF32) {
+            for (int c = 0; c < num_channels; c++) {
+                if (target->channels != NULL) {
+                    dst[c] = (float*)target->channels[c] + done;
+                } else {
+                    dst[c] = (float*)target->samples + (long)done * num_channels + c;
+                }
+            }
+
+            stride = target->channels != NULL ? 1 : num_channels;
+            ret = resampler_process(reader->resampler, request, dst, stride);
+        } else {
+            int tile_samples = STAGE_TILE_SAMPLES / num_channels;
+
+            for (int c = 0; c < num_channels; c++) {
+                dst[c] = tile + c;
+            }
+
+            request = request < tile_samples ? request : tile_samples;
+            ret = resampler_process(reader->resampler, request, dst, stride);
+
+            if (wav_reader_dithers(reader, target)) {
+                wav_reader_quantize(reader, target, tile, num_channels, ret, done);
+            } else if (target->channels != NULL) {
+                deinterleave_samples(kSampleFormatF32, tile, num_channels, ret, target->format,
+                                     target->channels, done);
+            } else {
+                convert_samples(kSampleFormatF32, tile, ret * num_channels, target->format,
+                                (char*)target->samples + (long)done * num_channels
+                                * bytes_per_sample);
+            }
+        }
+
+        done += ret;
+
+        if (ret < request && wav_reader_fill_resampler(reader) != 0) {
+            break;
+        }
+    }
+
+    return done;
+}
+
+int wav_reader_get_num_channels(WavReader* reader) {
+    return reader->hdr.num_channels;
+}
+
+int wav_reader_get_sample_rate(WavReader* reader) {
+    return reader->hdr.sample_rate;
+}
+
+int wav_reader_get_bits_per_sample(WavReader* reader) {
+    return reader->hdr.bytes_per_sample * 8;
+}
+
+int wav_reader_get_block_align(WavReader* reader) {
+    return reader->hdr.block_align;
+}
+
+int wav_reader_get_valid_bits_per_sample(WavReader* reader) {
+    return reader->hdr.valid_bits_per_sample;
+}
+
+SampleFormat wav_reader_get_sample_format(WavReader* reader) {
+    return wav_header_get_sample_format(&reader->hdr);
+}
+
+int64_t wav_reader_get_num_samples(WavReader* reader) {
+    return reader->hdr.streaming ? -1 : wav_reader_get_length(reader);
+}
+
+/* wav writer */
+
+struct WavAsync;
+struct WavMemory;
+struct WavRing;
+
+struct WavWriter {
+    struct WavHeader hdr;
+    struct WavIo io;
+    FILE* fp;                   // NULL for user io
+    struct WavMemory* mem;      // NULL unless opened by wav_writer_open_memory
+    int preallocated;
+    int positional;             // written by wav_writer_write_at_*, stream position is stale
+    struct WavAsync* async;     // NULL unless opened by wav_writer_open_async
+    struct WavRing* ring;       // NULL unless opened by wav_writer_open_ring
+    DitherMode dither_mode;     // float to integer convertion of writes
+    float dither_error[MAX_NUM_CHANNELS];   // noise shaping error of stream writes
+    WavPeaks* peaks;            // index of stream writes, NULL if none
+    int64_t checkpoint_samples; // frames between header checkpoints, 0 if disabled
+    int64_t next_checkpoint;    // num_samples of the next header checkpoint
+};
+
+static long file_write(void* ctx, const void* buf, size_t size) {
+    return (long)fwrite(buf, 1, size, (FILE*)ctx);
+}
+
+static int64_t file_seek(void* ctx, int64_t offset, int whence) {
+    if (fseeko((FILE*)ctx, offset, whence) != 0) {
+        return -1;
+    }
+
+    return ftello((FILE*)ctx);
+}
+
+#define DEFAULT_MEMORY_CAPACITY (64 * 1024)
+
+// wav file built in memory, caller arena of fixed capacity or buffer grown by realloc
+struct WavMemory {
+    char* data;
+    size_t size;
+    size_t capacity;
+    size_t position;
+    int growable;
+};
+
+// write whole buffer at position or nothing, a full arena fails the write
+static long memory_write(void* ctx, const void* buf, size_t size) {
+    struct WavMemory* mem = (struct WavMemory*)ctx;
+
+    if (size > mem->capacity - mem->position) {
+        size_t capacity = mem->capacity;
+
+        while (mem->growable && size > capacity - mem->position) {
+            capacity *= 2;
+        }
+
+        char* data = mem->growable ? (char*)realloc(mem->data, capacity) : NULL;
+
+        if (data == NULL) {
+            return -1;
+        }
+
+        mem->data = data;
+        mem->capacity = capacity;
+    }
+
+    memcpy(mem->data + mem->position, buf, size);
+    mem->position += size;
+    mem->size = mem->position > mem->size ? mem->position : mem->size;
+    return (long)size;
+}
+
+static int64_t memory_seek(void* ctx, int64_t offset, int whence) {
+    struct WavMemory* mem = (struct WavMemory*)ctx;
+    int64_t position = offset;
+
+    if (whence == SEEK_CUR) {
+        position += (int64_t)mem->position;
+    } else if (whence == SEEK_END) {
+        position += (int64_t)mem->size;
+    }
+
+    if (position < 0 || position > (int64_t)mem->size) {
+        return -1;
+    }
+
+    mem->position = (size_t)position;
+    return position;
+}
+
+// create writer on fp or user io, num_samples -1 if unknown
+static WavWriter* wav_writer_create(FILE* fp, const struct WavIo* io, int num_channels,
+                                    int sample_rate, SampleFormat format, int64_t num_samples) {
+    WavWriter* writer = (WavWriter*)malloc(sizeof(WavWriter));
+
+    if (writer == NULL) {
+        return NULL;
+    }
+
+    writer->io = *io;
+    writer->fp = fp;
+    writer->mem = NULL;
+
+    int bits_per_sample = sample_format_get_bytes_per_sample(format) * 8;
+    writer->hdr.format = format == kSampleFormatF32 ? kWavFormatFloat : kWavFormatPcm;
+    writer->hdr.num_channels = num_channels;
+    writer->hdr.sample_rate = sample_rate;
+    writer->hdr.bytes_per_sample = bits_per_sample / 8;
+    writer->hdr.block_align = num_channels * bits_per_sample / 8;
+    writer->hdr.valid_bits_per_sample = bits_per_sample;
+    writer->hdr.num_samples = 0;
+    writer->hdr.data_offset = -1;
+    writer->preallocated = 0;
+    writer->positional = 0;
+    writer->async = NULL;
+    writer->ring = NULL;
+    writer->dither_mode = kDitherModeTruncate;
+    memset(writer->dither_error, 0, sizeof(writer->dither_error));
+    writer->peaks = NULL;
+    writer->checkpoint_samples = 0;
+    writer->next_checkpoint = 0;
+
+    int64_t data_size = num_samples >= 0 ? num_samples * writer->hdr.block_align : -1;
+    int write_success = wav_header_write(&writer->hdr, &writer->io, data_size);
+
+    if (write_success != 0) {
+        free(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+WavWriter* wav_writer_open(const char* filename, int num_channels, int sample_rate,
+                           SampleFormat format) {
+    FILE* fp = fopen(filename, "wb");
+
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    struct WavIo io = {NULL, file_write, file_seek, fp};
+    int64_t num_samples = 0;
+
+    if (ftello(fp) < 0) {
+        // pipe, sizes can not be patched on close
+        io.seek = NULL;
+        num_samples = -1;
+    }
+
+    WavWriter* writer = wav_writer_create(fp, &io, num_channels, sample_rate, format, num_samples);
+
+    if (writer == NULL) {
+        fclose(fp);
+    }
+
+    return writer;
+}
+
+WavWriter* wav_writer_open_io(const WavIo* io, int num_channels, int sample_rate,
+                              SampleFormat format, int64_t num_samples) {
+    if (io == NULL || io->write == NULL) {
+        return NULL;
+    }
+
+    return wav_writer_create(NULL, io, num_channels, sample_rate, format, num_samples);
+}
+
+WavWriter* wav_writer_open_memory(void* buffer, size_t capacity, int num_channels,
+                                  int sample_rate, SampleFormat format) {
+    struct WavMemory* mem = (struct WavMemory*)calloc(1, sizeof(struct WavMemory));
+
+    if (mem == NULL) {
+        return NULL;
+    }
+
+    mem->data = (char*)buffer;
+    mem->capacity = capacity;
+
+    if (buffer == NULL) {
+        mem->capacity = capacity > 0 ? capacity : DEFAULT_MEMORY_CAPACITY;
+        mem->data = (char*)malloc(mem->capacity);
+        mem->growable = 1;
+    }
+
+    struct WavIo io = {NULL, memory_write, memory_seek, mem};
+    WavWriter* writer = NULL;
+
+    if (mem->data != NULL) {
+        writer = wav_writer_create(NULL, &io, num_channels, sample_rate, format, 0);
+    }
+
+    if (writer == NULL) {
+        if (mem->growable) {
+            free(mem->data);
+        }
+
+        free(mem);
+        return NULL;
+    }
+
+    writer->mem = mem;
+    return writer;
+}
+
+void* wav_writer_close_memory(WavWriter* writer, size_t* size) {
+    if (writer == NULL || writer->mem == NULL) {
+        return NULL;
+    }
+
+    // close patches the header sizes in place, the buffer is detached from the writer
+    struct WavMemory* mem = writer->mem;
+    writer->mem = NULL;
+    wav_writer_close(writer);
+
+    void* data = mem->data;
+
+    if (size != NULL) {
+        *size = mem->size;
+    }
+
+    free(mem);
+    return data;
+}
+
+static int wav_async_stop(WavWriter* writer);
+static void wav_ring_stop(WavWriter* writer);
+
+int wav_writer_close(WavWriter* writer) {
+    int ret = 0;
+
+    if (writer != NULL) {
+        if (writer->async != NULL) {
+            ret = wav_async_stop(writer);
+        }
+
+        if (writer->ring != NULL) {
+            wav_ring_stop(writer);
+        }
+
+        if (writer->positional) {
+            fseeko(writer->fp, writer->hdr.data_offset
+                   + writer->hdr.num_samples * writer->hdr.block_align, SEEK_SET);
+        }
+
+        // chunks are word aligned, odd sized data chunk is followed by a pad byte
+        if ((writer->hdr.num_samples * writer->hdr.block_align) & 1) {
+            wav_io_write(&writer->io, "", 1);
+        }
+
+        if (writer->preallocated) {
+            // release reserved blocks beyond the written data, on failure they stay
+            //   allocated but the header still describes the data size
+            fflush(writer->fp);
+            int truncated = ftruncate(fileno(writer->fp), ftello(writer->fp));
+            (void)truncated;
+        }
+
+        wav_header_write_end(&writer->hdr, &writer->io);
+
+        if (writer->fp != NULL && fclose(writer->fp) != 0) {
+            ret = -1;
+        }
+
+        if (writer->mem != NULL) {
+            if (writer->mem->growable) {
+                free(writer->mem->data);
+            }
+
+            free(writer->mem);
+        }
+
+        free(writer);
+    }
+
+    return ret;
+}
+
+int wav_writer_get_num_channels(WavWriter* writer) {
+    return writer->hdr.num_channels;
+}
+
+int wav_writer_preallocate(WavWriter* writer, int64_t num_samples) {
+    off_t size = (off_t)num_samples * writer->hdr.block_align;
+
+    if (writer->fp == NULL) {
+        return -1;
+    }
+
+    fflush(writer->fp);
+
+    if (fallocate(fileno(writer->fp), 0, writer->hdr.data_offset, size) != 0) {
+        return -1;
+    }
+
+    writer->preallocated = 1;
+    return 0;
+}
+
+static long wav_writer_write(WavWriter* writer, SampleFormat format,
+                             int num_samples, const void* samples_buf);
+
+int wav_writer_write_f32(WavWriter* writer, int num_samples, const float* samples) {
+    return wav_writer_write(writer, kSampleFormatF32, num_samples, samples);
+}
+
+int wav_writer_write_i16(WavWriter* writer, int num_samples, const int16_t* samples) {
+    return wav_writer_write(writer, kSampleFormatI16, num_samples, samples);
+}
+
+int wav_writer_write_i32(WavWriter* writer, int num_samples, const int32_t* samples) {
+    return wav_writer_write(writer, kSampleFormatI32, num_samples, samples);
+}
+
+int wav_writer_write_i24(WavWriter* writer, int num_samples, const uint8_t* samples) {
+    return wav_writer_write(writer, kSampleFormatI24, num_samples, samples);
+}
+
+// convert count frames of format to file format, float samples of integer files are
+//    quantized with the dither mode of writer, noise shaped with dither_error if not NULL
+static void wav_writer_convert(const WavWriter* writer, float* dither_error, SampleFormat format,
+                               const void* src, int count, void* dst) {
+    SampleFormat file_format = wav_header_get_sample_format(&writer->hdr);
+    int num_channels = writer->hdr.num_channels;
+
+    if (writer->dither_mode != kDitherModeTruncate && format == kSampleFormatF32
+            && file_format != kSampleFormatF32) {
+        quantize_samples(writer->dither_mode, dither_error, (const float*)src, num_channels,
+                         count, file_format, dst);
+    } else {
+        convert_samples(format, src, count * num_channels, file_format, dst);
+    }
+}
+
+int wav_writer_set_dither_mode(WavWriter* writer, DitherMode mode) {
+    if (mode < kDitherModeTruncate || mode > kDitherModeShaped) {
+        return -1;
+    }
+
+    writer->dither_mode = mode;
+    return 0;
+}
+
+int wav_writer_set_peaks(WavWriter* writer, WavPeaks* peaks) {
+    if (peaks != NULL && (wav_peaks_get_num_channels(peaks) != writer->hdr.num_channels
+                          || writer->hdr.num_samples != 0)) {
+        return -1;
+    }
+
+    writer->peaks = peaks;
+    return 0;
+}
+
+// index count frames of file format written to the data chunk
+static void wav_writer_index(WavWriter* writer, const void* samples, int count) {
+    SampleFormat file_format = wav_header_get_sample_format(&writer->hdr);
+    int num_channels = writer->hdr.num_channels;
+
+    if (file_format == kSampleFormatF32) {
+        wav_peaks_add_f32(writer->peaks, count, (const float*)samples);
+    } else {
+        float tile[STAGE_TILE_SAMPLES];
+        int tile_samples = STAGE_TILE_SAMPLES / num_channels;
+
+        for (int t = 0; t < count; t += tile_samples) {
+            int n = count - t < tile_samples ? count - t : tile_samples;
+            convert_samples(file_format, (const char*)samples + (long)t * writer->hdr.block_align,
+                            n * num_channels, kSampleFormatF32, tile);
+            wav_peaks_add_f32(writer->peaks, n, tile);
+        }
+    }
+}
+
+static void wav_writer_checkpoint(WavWriter* writer);
+
+// convert and write samples to file on the calling thread
+static long wav_writer_write_file(WavWriter* writer, SampleFormat format,
+                                  int num_samples, const void* samples_buf) {
+    if (compare_format(writer->hdr.format, writer->hdr.bytes_per_sample * 8, format) == 0) {
+        long write = wav_io_write(&writer->io, samples_buf, (size_t)num_samples
+                                  * writer->hdr.block_align) / writer->hdr.block_align;
+        writer->hdr.num_samples += write;
+
+        if (writer->peaks != NULL && write > 0) {
+            wav_writer_index(writer, samples_buf, (int)write);
+        }
+
+        if (writer->checkpoint_samples > 0 && writer->hdr.num_samples >= writer->next_checkpoint) {
+            wav_writer_checkpoint(writer);
+        }
+
+        return write;
+    } else {
+        char tmp[DEFAULT_PACKET_SIZE];
+        int num_channels = writer->hdr.num_channels;
+        int frame_size = num_channels * sample_format_get_bytes_per_sample(format);
+        int ret = 0;
+
+        while (ret < num_samples) {
+            int request = DEFAULT_PACKET_SIZE / writer->hdr.block_align;
+
+            if (request > num_samples - ret) {
+                request = num_samples - ret;
+            }
+
+            wav_writer_convert(writer, writer->dither_error, format,
+                               (const char*)samples_buf + (long)ret * frame_size, request, tmp);
+
+            long write_samples = wav_io_write(&writer->io, tmp, (size_t)request
+                                              * writer->hdr.block_align) / writer->hdr.block_align;
+            writer->hdr.num_samples += write_samples;
+            ret += write_samples;
+
+            if (writer->peaks != NULL && write_samples > 0) {
+                wav_writer_index(writer, tmp, (int)write_samples);
+            }
+
+            // io full or failed, e.g. memory arena exhausted
+            if (write_samples < request) {
+                break;
+            }
+        }
+
+        if (writer->checkpoint_samples > 0 && writer->hdr.num_samples >= writer->next_checkpoint) {
+            wav_writer_checkpoint(writer);
+        }
+
+        return ret;
+    }
+}
+
+// positional write, retry on short write until size bytes, returns bytes written
+static long pwrite_full(int fd, const void* buf, size_t size, off_t offset) {
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t ret = pwrite(fd, (const char*)buf + done, size - done, offset + done);
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (ret <= 0) {
+            break;
+        }
+
+        done += ret;
+    }
+
+    return (long)done;
+}
+
+int wav_writer_set_checkpoint(WavWriter* writer, double seconds, int64_t bytes) {
+    int64_t samples = 0;
+
+    if (writer->fp == NULL || seconds < 0. || bytes < 0) {
+        return -1;
+    }
+
+    if (seconds > 0.) {
+        samples = (int64_t)(seconds * writer->hdr.sample_rate);
+        samples = samples > 0 ? samples : 1;
+    }
+
+    if (bytes > 0) {
+        int64_t byte_samples = bytes / writer->hdr.block_align;
+        byte_samples = byte_samples > 0 ? byte_samples : 1;
+        samples = samples > 0 && samples < byte_samples ? samples : byte_samples;
+    }
+
+    writer->checkpoint_samples = samples;
+    writer->next_checkpoint = writer->hdr.num_samples + samples;
+    return 0;
+}
+
+// rewrite the header for the data already handed to the file, a positional write leaves
+//    stream position and stdio buffer alone, nothing is flushed or synced
+static void wav_writer_checkpoint(WavWriter* writer) {
+    int block_align = writer->hdr.block_align;
+    // bytes still in the stdio buffer are not in the file, the header never claims them
+    int64_t data_size = writer->hdr.num_samples * block_align - (int64_t)__fpending(writer->fp);
+    char buf[WAV_HEADER_SIZE];
+
+    writer->next_checkpoint = writer->hdr.num_samples + writer->checkpoint_samples;
+    data_size -= data_size % block_align;
+
+    // header reached the file before any data, it is not rewritten by a later flush
+    if (data_size > 0 && !writer->positional
+            && wav_header_build(&writer->hdr, data_size, buf) == 0) {
+        pwrite_full(fileno(writer->fp), buf, sizeof(buf), 0);
+    }
+}
+
+// convert and write samples at frame_offset without touching the stream position
+static long wav_writer_write_at(WavWriter* writer, int64_t frame_offset, SampleFormat format,
+                                int num_samples, const void* samples_buf) {
+    if (writer->fp == NULL || writer->io.seek == NULL || writer->async != NULL
+            || writer->ring != NULL || frame_offset < 0 || num_samples < 0) {
+        return -1;
+    }
+
+    if (!__atomic_load_n(&writer->positional, __ATOMIC_ACQUIRE)) {
+        // header must reach the file before data is written behind the stream
+        fflush(writer->fp);
+        __atomic_store_n(&writer->positional, 1, __ATOMIC_RELEASE);
+    }
+
+    int fd = fileno(writer->fp);
+    int block_align = writer->hdr.block_align;
+    off_t offset = writer->hdr.data_offset + frame_offset * block_align;
+    long ret = 0;
+
+    if (compare_format(writer->hdr.format, writer->hdr.bytes_per_sample * 8, format) == 0) {
+        ret = pwrite_full(fd, samples_buf, (size_t)num_samples * block_align, offset) / block_align;
+    } else {
+        char tmp[DEFAULT_PACKET_SIZE];
+        int num_channels = writer->hdr.num_channels;
+        int frame_size = num_channels * sample_format_get_bytes_per_sample(format);
+
+        while (ret < num_samples) {
+            int request = DEFAULT_PACKET_SIZE / block_align;
+
+            if (request > num_samples - ret) {
+                request = num_samples - ret;
+            }
+
+            // concurrent positional writes share no noise shaping state
+            wav_writer_convert(writer, NULL, format, (const char*)samples_buf + ret * frame_size,
+                               request, tmp);
+
+            long write_samples = pwrite_full(fd, tmp, (size_t)request * block_align,
+                                             offset + (off_t)ret * block_align) / block_align;
+            ret += write_samples;
+
+            if (write_samples < request) {
+                break;
+            }
+        }
+    }
+
+    // data chunk ends at the furthest frame written by any thread
+    int64_t end = frame_offset + ret;
+    int64_t num_written = __atomic_load_n(&writer->hdr.num_samples, __ATOMIC_RELAXED);
+
+    while (num_written < end
+            && !__atomic_compare_exchange_n(&writer->hdr.num_samples, &num_written, end, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+
+    return ret;
+}
+
+int wav_writer_write_at_f32(WavWriter* writer, int64_t frame_offset, int num_samples,
+                            const float* samples) {
+    return wav_writer_write_at(writer, frame_offset, kSampleFormatF32, num_samples, samples);
+}
+
+int wav_writer_write_at_i16(WavWriter* writer, int64_t frame_offset, int num_samples,
+                            const int16_t* samples) {
+    return wav_writer_write_at(writer, frame_offset, kSampleFormatI16, num_samples, samples);
+}
+
+int wav_writer_write_at_i32(WavWriter* writer, int64_t frame_offset, int num_samples,
+                            const int32_t* samples) {
+    return wav_writer_write_at(writer, frame_offset, kSampleFormatI32, num_samples, samples);
+}
+
+// interleave count frames from per channel arrays of format to file format
+static void wav_writer_interleave(WavWriter* writer, SampleFormat format,
+                                  const void* const* src, int offset, int count, void* dst) {
+    const struct WavHeader* hdr = &writer->hdr;
+    SampleFormat file_format = wav_header_get_sample_format(hdr);
+    int num_channels = hdr->num_channels;
+
+    if (writer->dither_mode != kDitherModeTruncate && format == kSampleFormatF32
+            && file_format != kSampleFormatF32) {
+        // quantization runs on interleaved frames, noise shaping follows each channel
+        float tile[STAGE_TILE_SAMPLES];
+        int tile_samples = STAGE_TILE_SAMPLES / num_channels;
+
+        for (int t = 0; t < count; t += tile_samples) {
+            int n = count - t < tile_samples ? count - t : tile_samples;
+            interleave_f32_to_f32(src, offset + t, num_channels, n, tile);
+            quantize_samples(writer->dither_mode, writer->dither_error, tile, num_channels, n,
+                             file_format, (char*)dst + (long)t * hdr->block_align);
+        }
+    } else if (file_format == kSampleFormatI24) {
+        int32_t tile[STAGE_TILE_SAMPLES];
+        int tile_samples = STAGE_TILE_SAMPLES / num_channels;
+
+        for (int t = 0; t < count; t += tile_samples) {
+            int n = count - t < tile_samples ? count - t : tile_samples;
+            interleave_samples(format, src, offset + t, num_channels, n, kSampleFormatI32, tile);
+            convert_i32_to_i24(tile, n * num_channels, (uint8_t*)dst + (long)t * hdr->block_align);
+        }
+    } else {
+        interleave_samples(format, src, offset, num_channels, count, file_format, dst);
+    }
+}
+
+static long wav_writer_write_planar_file(WavWriter* writer, SampleFormat format,
+                                         int num_samples, const void* const* channels) {
+    char tmp[DEFAULT_PACKET_SIZE];
+    int ret = 0;
+
+    while (ret < num_samples) {
+        int request = DEFAULT_PACKET_SIZE / writer->hdr.block_align;
+
+        if (request > num_samples - ret) {
+            request = num_samples - ret;
+        }
+
+        wav_writer_interleave(writer, format, channels, ret, request, tmp);
+
+        long write_samples = wav_io_write(&writer->io, tmp, (size_t)request
+                                          * writer->hdr.block_align) / writer->hdr.block_align;
+        writer->hdr.num_samples += write_samples;
+        ret += write_samples;
+
+        if (writer->peaks != NULL && write_samples > 0) {
+            wav_writer_index(writer, tmp, (int)write_samples);
+        }
+
+        if (write_samples < request) {
+            break;
+        }
+    }
+
+    if (writer->checkpoint_samples > 0 && writer->hdr.num_samples >= writer->next_checkpoint) {
+        wav_writer_checkpoint(writer);
+    }
+
+    return ret;
+}
+
+static long wav_writer_write_planar(WavWriter* writer, SampleFormat format,
+                                    int num_samples, const void* const* channels);
+
+int wav_writer_write_planar_f32(WavWriter* writer, int num_samples, const float* const* channels) {
+    return wav_writer_write_planar(writer, kSampleFormatF32, num_samples,
+                                   (const void* const*)channels);
+}
+
+int wav_writer_write_planar_i16(WavWriter* writer, int num_samples, const int16_t* const* channels) {
+    return wav_writer_write_planar(writer, kSampleFormatI16, num_samples,
+                                   (const void* const*)channels);
+}
+
+int wav_writer_write_planar_i32(WavWriter* writer, int num_samples, const int32_t* const* channels) {
+    return wav_writer_write_planar(writer, kSampleFormatI32, num_samples,
+                                   (const void* const*)channels);
+}
+
+static long wav_async_submit(WavWriter* writer, SampleFormat format, int num_samples,
+                             const void* samples_buf, const void* const* channels);
+static long wav_ring_push(WavWriter* writer, SampleFormat format, int num_samples,
+                          const void* samples_buf, const void* const* channels);
+
+static long wav_writer_write(WavWriter* writer, SampleFormat format,
+                             int num_samples, const void* samples_buf) {
+    if (writer->ring != NULL) {
+        return wav_ring_push(writer, format, num_samples, samples_buf, NULL);
+    } else if (writer->async != NULL) {
+        return wav_async_submit(writer, format, num_samples, samples_buf, NULL);
+    }
+
+    return wav_writer_write_file(writer, format, num_samples, samples_buf);
+}
+
+static long wav_writer_write_planar(WavWriter* writer, SampleFormat format,
+                                    int num_samples, const void* const* channels) {
+    if (writer->ring != NULL) {
+        return wav_ring_push(writer, format, num_samples, NULL, channels);
+    } else if (writer->async != NULL) {
+        return wav_async_submit(writer, format, num_samples, NULL, channels);
+    }
+
+    return wav_writer_write_planar_file(writer, format, num_samples, channels);
+}
+
+/* async wav writer */
+
+struct WavAsyncBuffer {
+    SampleFormat format;
+    int num_samples;
+    char* data;
+};
+
+struct WavAsync {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond_queued;     // signaled when a buffer is queued or on stop
+    pthread_cond_t cond_written;    // signaled when io thread finished a buffer
+    struct WavAsyncBuffer* buffers;
+    int num_buffers;
+    int buffer_samples;
+    int blocking;
+    int tail;           // oldest queued buffer, written by io thread
+    int num_queued;     // buffers [tail, tail + num_queued) wait for io thread
+    int filling;        // buffer filled by caller, -1 if none
+    int stop;
+    int max_queued;
+    int64_t overrun_samples;
+    int64_t failed_samples;     // frames the io thread could not write to the file
+};
+
+static void* wav_async_run(void* arg) {
+    WavWriter* writer = (WavWriter*)arg;
+    struct WavAsync* async = writer->async;
+
+    pthread_mutex_lock(&async->lock);
+
+    for (;;) {
+        while (async->num_queued == 0 && !async->stop) {
+            pthread_cond_wait(&async->cond_queued, &async->lock);
+        }
+
+        if (async->num_queued == 0) {
+            break;
+        }
+
+        struct WavAsyncBuffer* buffer = &async->buffers[async->tail];
+        pthread_mutex_unlock(&async->lock);
+
+        long written = wav_writer_write_file(writer, buffer->format, buffer->num_samples,
+                                             buffer->data);
+
+        pthread_mutex_lock(&async->lock);
+
+        // stdio buffers a short write and reports it only through the error flag
+        if (writer->fp != NULL && ferror(writer->fp)) {
+            async->failed_samples += buffer->num_samples;
+        } else if (written < buffer->num_samples) {
+            async->failed_samples += buffer->num_samples - (written > 0 ? written : 0);
+        }
+
+        async->tail = (async->tail + 1) % async->num_buffers;
+        async->num_queued--;
+        pthread_cond_broadcast(&async->cond_written);
+    }
+
+    pthread_mutex_unlock(&async->lock);
+    return NULL;
+}
+
+// hand the buffer being filled to io thread
+static void wav_async_queue_filling(struct WavAsync* async) {
+    pthread_mutex_lock(&async->lock);
+    async->num_queued++;
+    async->filling = -1;
+
+    if (async->num_queued > async->max_queued) {
+        async->max_queued = async->num_queued;
+    }
+
+    pthread_cond_signal(&async->cond_queued);
+    pthread_mutex_unlock(&async->lock);
+}
+
+// copy samples into buffers for io thread, convertion and write happen on io thread
+static long wav_async_submit(WavWriter* writer, SampleFormat format, int num_samples,
+                             const void* samples_buf, const void* const* channels) {
+    struct WavAsync* async = writer->async;
+    int num_channels = writer->hdr.num_channels;
+    int frame_size = num_channels * sample_format_get_bytes_per_sample(format);
+    int ret = 0;
+
+    while (ret < num_samples) {
+        if (async->filling < 0) {
+            pthread_mutex_lock(&async->lock);
+
+            while (async->num_queued == async->num_buffers && async->blocking) {
+                pthread_cond_wait(&async->cond_written, &async->lock);
+            }
+
+            if (async->num_queued == async->num_buffers) {
+                // all buffers wait for io, drop the rest instead of stalling caller
+                async->overrun_samples += num_samples - ret;
+                pthread_mutex_unlock(&async->lock);
+                break;
+            }
+
+            async->filling = (async->tail + async->num_queued) % async->num_buffers;
+            async->buffers[async->filling].format = format;
+            async->buffers[async->filling].num_samples = 0;
+            pthread_mutex_unlock(&async->lock);
+        }
+
+        struct WavAsyncBuffer* buffer = &async->buffers[async->filling];
+
+        if (buffer->format != format) {
+            if (buffer->num_samples > 0) {
+                wav_async_queue_filling(async);
+                continue;
+            }
+
+            buffer->format = format;
+        }
+
+        int request = async->buffer_samples - buffer->num_samples;
+
+        if (request > num_samples - ret) {
+            request = num_samples - ret;
+        }
+
+        char* dst = buffer->data + (long)buffer->num_samples * frame_size;
+
+        if (channels == NULL) {
+            memcpy(dst, (const char*)samples_buf + (long)ret * frame_size, (size_t)request * frame_size);
+        } else if (format == kSampleFormatF32) {
+            interleave_f32_to_f32(channels, ret, num_channels, request, (float*)dst);
+        } else if (format == kSampleFormatI16) {
+            interleave_i16_to_i16(channels, ret, num_channels, request, (int16_t*)dst);
+        } else {
+            interleave_i32_to_i32(channels, ret, num_channels, request, (int32_t*)dst);
+        }
+
+        buffer->num_samples += request;
+        ret += request;
+
+        if (buffer->num_samples == async->buffer_samples) {
+            wav_async_queue_filling(async);
+        }
+    }
+
+    return ret;
+}
+
+static void wav_ring_wait(struct WavRing* ring);
+
+int wav_writer_flush(WavWriter* writer) {
+    struct WavAsync* async = writer->async;
+    int failed = 0;
+
+    if (writer->ring != NULL) {
+        wav_ring_wait(writer->ring);
+    }
+
+    if (async != NULL) {
+        if (async->filling >= 0 && async->buffers[async->filling].num_samples > 0) {
+            wav_async_queue_filling(async);
+        }
+
+        pthread_mutex_lock(&async->lock);
+
+        while (async->num_queued > 0) {
+            pthread_cond_wait(&async->cond_written, &async->lock);
+        }
+
+        failed = async->failed_samples > 0;
+        pthread_mutex_unlock(&async->lock);
+    }
+
+    if (writer->fp == NULL) {
+        return failed ? -1 : 0;
+    }
+
+    return fflush(writer->fp) == 0 && !failed ? 0 : -1;
+}
+
+static void wav_async_free(struct WavAsync* async) {
+    for (int i = 0; i < async->num_buffers; i++) {
+        free(async->buffers[i].data);
+    }
+
+    free(async->buffers);
+    pthread_cond_destroy(&async->cond_written);
+    pthread_cond_destroy(&async->cond_queued);
+    pthread_mutex_destroy(&async->lock);
+    free(async);
+}
+
+static int wav_async_stop(WavWriter* writer) {
+    struct WavAsync* async = writer->async;
+    int ret = wav_writer_flush(writer);
+
+    pthread_mutex_lock(&async->lock);
+    async->stop = 1;
+    pthread_cond_signal(&async->cond_queued);
+    pthread_mutex_unlock(&async->lock);
+    pthread_join(async->thread, NULL);
+
+    wav_async_free(async);
+    writer->async = NULL;
+    return ret;
+}
+
+WavWriter* wav_writer_open_async(const char* filename, int num_channels, int sample_rate,
+                                 SampleFormat format, int num_buffers, int buffer_samples,
+                                 int blocking) {
+    if (num_buffers < 2 || buffer_samples < 1) {
+        return NULL;
+    }
+
+    WavWriter* writer = wav_writer_open(filename, num_channels, sample_rate, format);
+
+    if (writer == NULL) {
+        return NULL;
+    }
+
+    struct WavAsync* async = (struct WavAsync*)calloc(1, sizeof(struct WavAsync));
+
+    if (async == NULL) {
+        wav_writer_close(writer);
+        return NULL;
+    }
+
+    pthread_mutex_init(&async->lock, NULL);
+    pthread_cond_init(&async->cond_queued, NULL);
+    pthread_cond_init(&async->cond_written, NULL);
+    async->num_buffers = num_buffers;
+    async->buffer_samples = buffer_samples;
+    async->blocking = blocking;
+    async->filling = -1;
+    async->buffers = (struct WavAsyncBuffer*)calloc(num_buffers, sizeof(struct WavAsyncBuffer));
+
+    // large enough for any input format, all are at most 4 bytes per sample
+    size_t buffer_size = (size_t)buffer_samples * num_channels * sizeof(int32_t);
+
+    for (int i = 0; async->buffers != NULL && i < num_buffers; i++) {
+        async->buffers[i].data = (char*)malloc(buffer_size);
+
+        if (async->buffers[i].data == NULL) {
+            wav_async_free(async);
+            wav_writer_close(writer);
+            return NULL;
+        }
+    }
+
+    if (async->buffers == NULL) {
+        wav_async_free(async);
+        wav_writer_close(writer);
+        return NULL;
+    }
+
+    writer->async = async;
+
+    if (pthread_create(&async->thread, NULL, wav_async_run, writer) != 0) {
+        writer->async = NULL;
+        wav_async_free(async);
+        wav_writer_close(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+void wav_writer_get_async_stats(WavWriter* writer, int64_t* overrun_samples, int* max_queued,
+                                int64_t* failed_samples) {
+    struct WavAsync* async = writer->async;
+    int64_t overrun = 0;
+    int64_t failed = 0;
+    int queued = 0;
+
+    if (async != NULL) {
+        pthread_mutex_lock(&async->lock);
+        overrun = async->overrun_samples;
+        failed = async->failed_samples;
+        queued = async->max_queued;
+        pthread_mutex_unlock(&async->lock);
+    }
+
+    if (failed_samples != NULL) {
+        *failed_samples = failed;
+    }
+
+    if (overrun_samples != NULL) {
+        *overrun_samples = overrun;
+    }
+
+    if (max_queued != NULL) {
+        *max_queued = queued;
+    }
+}
+
+/* real-time ring writer */
+
+#define RING_CACHE_LINE     64
+#define RING_MIN_PERIOD_NS  1000000L    // drain thread polls at least every 1 ms
+#define RING_MAX_PERIOD_NS  50000000L   // and at most every 50 ms
+
+// single producer single consumer ring of frames, positions count frames since open
+//    and are only advanced by their owner thread, the cache line of each stays local
+struct WavRing {
+    pthread_t thread;
+    SampleFormat format;    // sample format of frames in the ring
+    int frame_size;
+    int64_t capacity;       // frames, power of two
+    char* data;
+    long period_ns;         // poll period of the drain thread
+    int stop;
+    char pad0[RING_CACHE_LINE];
+    uint64_t write_pos;     // producer owned
+    int64_t overrun_samples;
+    int64_t max_fill;
+    char pad1[RING_CACHE_LINE];
+    uint64_t read_pos;      // drain thread owned
+    char pad2[RING_CACHE_LINE];
+};
+
+// write frames queued in the ring to file, returns number of frames drained
+static int64_t wav_ring_drain(WavWriter* writer) {
+    struct WavRing* ring = writer->ring;
+    uint64_t read_pos = ring->read_pos;
+    uint64_t write_pos = __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE);
+    uint64_t drained = write_pos - read_pos;
+
+    // at most two contiguous segments, up to the end of the ring and from its start
+    while (read_pos < write_pos) {
+        int64_t index = (int64_t)(read_pos & (ring->capacity - 1));
+        int64_t count = ring->capacity - index;
+        count = count < (int64_t)(write_pos - read_pos) ? count : (int64_t)(write_pos - read_pos);
+        count = count < INT32_MAX ? count : INT32_MAX;
+
+        // frames failing to reach the file are dropped, the header keeps the written size
+        wav_writer_write_file(writer, ring->format, (int)count, ring->data + index * ring->frame_size);
+        read_pos += count;
+        __atomic_store_n(&ring->read_pos, read_pos, __ATOMIC_RELEASE);
+    }
+
+    return (int64_t)drained;
+}
+
+static void* wav_ring_run(void* arg) {
+    WavWriter* writer = (WavWriter*)arg;
+    struct WavRing* ring = writer->ring;
+    struct timespec period = {0, ring->period_ns};
+
+    while (!__atomic_load_n(&ring->stop, __ATOMIC_ACQUIRE)) {
+        if (wav_ring_drain(writer) == 0) {
+            nanosleep(&period, NULL);
+        }
+    }
+
+    // frames pushed before stop
+    wav_ring_drain(writer);
+    return NULL;
+}
+
+// copy frames into the ring without locks, allocation or system calls, frames not
+//    fitting are dropped and counted as overrun
+static long wav_ring_push(WavWriter* writer, SampleFormat format, int num_samples,
+                          const void* samples_buf, const void* const* channels) {
+    struct WavRing* ring = writer->ring;
+    int num_channels = writer->hdr.num_channels;
+    int src_frame_size = num_channels * sample_format_get_bytes_per_sample(format);
+    uint64_t write_pos = ring->write_pos;
+    uint64_t read_pos = __atomic_load_n(&ring->read_pos, __ATOMIC_ACQUIRE);
+    int64_t space = ring->capacity - (int64_t)(write_pos - read_pos);
+    int accepted = num_samples < space ? num_samples : (int)space;
+    int done = 0;
+
+    while (done < accepted) {
+        int64_t index = (int64_t)(write_pos & (ring->capacity - 1));
+        int count = ring->capacity - index < accepted - done ? (int)(ring->capacity - index)
+                    : accepted - done;
+        char* dst = ring->data + index * ring->frame_size;
+
+        if (channels != NULL) {
+            interleave_samples(format, channels, done, num_channels, count, ring->format, dst);
+        } else {
+            convert_samples(format, (const char*)samples_buf + (long)done * src_frame_size,
+                            count * num_channels, ring->format, dst);
+        }
+
+        write_pos += count;
+        done += count;
+    }
+
+    __atomic_store_n(&ring->write_pos, write_pos, __ATOMIC_RELEASE);
+
+    // counters are written by the producer only, relaxed stores are read by any thread
+    if (accepted < num_samples) {
+        __atomic_store_n(&ring->overrun_samples, ring->overrun_samples + num_samples - accepted,
+                         __ATOMIC_RELAXED);
+    }
+
+    int64_t fill = (int64_t)(write_pos - read_pos);
+
+    if (fill > ring->max_fill) {
+        __atomic_store_n(&ring->max_fill, fill, __ATOMIC_RELAXED);
+    }
+
+    return accepted;
+}
+
+// wait until the drain thread wrote every frame pushed so far
+static void wav_ring_wait(struct WavRing* ring) {
+    struct timespec period = {0, ring->period_ns};
+    uint64_t write_pos = __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE);
+
+    while (__atomic_load_n(&ring->read_pos, __ATOMIC_ACQUIRE) < write_pos) {
+        nanosleep(&period, NULL);
+    }
+}
+
+static void wav_ring_free(struct WavRing* ring) {
+    free(ring->data);
+    free(ring);
+}
+
+static void wav_ring_stop(WavWriter* writer) {
+    struct WavRing* ring = writer->ring;
+
+    __atomic_store_n(&ring->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(ring->thread, NULL);
+
+    wav_ring_free(ring);
+    writer->ring = NULL;
+}
+
+WavWriter* wav_writer_open_ring(const char* filename, int num_channels, int sample_rate,
+                                SampleFormat format, SampleFormat ring_format,
+                                int ring_samples) {
+    if (ring_samples < 1 || ring_format == kSampleFormatI24) {
+        return NULL;
+    }
+
+    WavWriter* writer = wav_writer_open(filename, num_channels, sample_rate, format);
+
+    if (writer == NULL) {
+        return NULL;
+    }
+
+    struct WavRing* ring = (struct WavRing*)calloc(1, sizeof(struct WavRing));
+    int64_t capacity = 1;
+
+    while (capacity < ring_samples) {
+        capacity *= 2;
+    }
+
+    if (ring != NULL) {
+        ring->format = ring_format;
+        ring->frame_size = num_channels * sample_format_get_bytes_per_sample(ring_format);
+        ring->capacity = capacity;
+        ring->data = (char*)malloc((size_t)capacity * ring->frame_size);
+    }
+
+    if (ring == NULL || ring->data == NULL) {
+        free(ring);
+        wav_writer_close(writer);
+        return NULL;
+    }
+
+    // touch every page now, the first push must not fault in fresh memory
+    memset(ring->data, 0, (size_t)capacity * ring->frame_size);
+
+    // poll a quarter of the ring duration, the ring is drained well before it fills
+    long period_ns = (long)(capacity * 250000000LL / sample_rate);
+    period_ns = period_ns > RING_MIN_PERIOD_NS ? period_ns : RING_MIN_PERIOD_NS;
+    ring->period_ns = period_ns < RING_MAX_PERIOD_NS ? period_ns : RING_MAX_PERIOD_NS;
+
+    writer->ring = ring;
+
+    if (pthread_create(&ring->thread, NULL, wav_ring_run, writer) != 0) {
+        writer->ring = NULL;
+        wav_ring_free(ring);
+        wav_writer_close(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+void wav_writer_get_ring_stats(WavWriter* writer, int64_t* overrun_samples,
+                               int64_t* max_fill_samples) {
+    struct WavRing* ring = writer->ring;
+
+    if (overrun_samples != NULL) {
+        *overrun_samples = ring != NULL ? __atomic_load_n(&ring->overrun_samples,
+                                                          __ATOMIC_RELAXED) : 0;
+    }
+
+    if (max_fill_samples != NULL) {
+        *max_fill_samples = ring != NULL ? __atomic_load_n(&ring->max_fill, __ATOMIC_RELAXED) : 0;
+    }
+}
+
+/* header repair */
+
+// a chunk header at offset, printable id and a size inside the file, e.g. LIST after data
+static int wav_repair_is_chunk(int fd, int64_t offset, int64_t file_size) {
+    uint8_t chunk[8];
+    uint32_t chunk_size;
+
+    if (offset + 8 > file_size || pread_full(fd, chunk, sizeof(chunk), offset) != sizeof(chunk)) {
+        return 0;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        if (chunk[i] < 0x20 || chunk[i] > 0x7E) {
+            return 0;
+        }
+    }
+
+    memcpy(&chunk_size, chunk + 4, sizeof(chunk_size));
+    return chunk_size <= file_size - offset - 8;
+}
+
+int64_t wav_repair(const char* filename, int use_checkpoint, int dry_run) {
+    int fd = open(filename, dry_run ? O_RDONLY : O_RDWR);
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct WavSource src;
+    struct WavHeader header;
+    int64_t num_samples = -1;
+
+    memset(&header, 0, sizeof(header));
+    memset(&src, 0, sizeof(src));
+    src.refs = 1;
+    src.fd = fd;
+    pthread_mutex_init(&src.io_lock, NULL);
+
+    // a data size of 0, 0xFFFFFFFF or past the end of file reads as the whole file
+    int64_t file_size = wav_source_get_size(&src);
+
+    if (file_size >= 0 && wav_header_read(&header, &src) == 0) {
+        int64_t file_samples = (file_size - header.data_offset) / header.block_align;
+        int64_t data_end = header.data_offset + header.num_samples * header.block_align;
+        num_samples = header.num_samples;
+
+        // a shorter size not followed by a chunk is a checkpoint, frames written after it
+        //    are recovered unless use_checkpoint keeps it (e.g. preallocated files)
+        if (!use_checkpoint && num_samples < file_samples
+                && !wav_repair_is_chunk(fd, data_end + (data_end & 1), file_size)) {
+            num_samples = file_samples;
+        }
+    }
+
+    uint32_t ids[4] = {0, 0, 0, 0};
+    uint32_t fmt_size = 0;
+    int64_t data_size = num_samples * header.block_align;
+
+    if (num_samples >= 0 && !dry_run
+            && (pread_full(fd, ids, sizeof(ids), 0) != sizeof(ids)
+                || pread_full(fd, &fmt_size, sizeof(fmt_size), WAV_HEADER_SIZE - 8
+                              - sizeof(struct FmtSubchunk) - sizeof(uint32_t)) != sizeof(uint32_t))) {
+        num_samples = -1;
+    }
+
+    int64_t riff_size = header.data_offset - 8 + data_size + (data_size & 1);
+
+    // a riff size covering chunks after the data in the file is kept
+    if (ids[0] == ID_RIFF && ids[1] != RIFF_SIZE_MAX && ids[1] > riff_size
+            && ids[1] <= file_size - 8) {
+        riff_size = ids[1];
+    }
+
+    if (num_samples >= 0 && !dry_run) {
+        char buf[WAV_HEADER_SIZE];
+
+        if (header.data_offset == WAV_HEADER_SIZE && (ids[3] == ID_JUNK || ids[3] == ID_DS64)
+                && fmt_size == sizeof(struct FmtSubchunk)) {
+            // layout of this writer, the whole header is rebuilt and may switch to RF64
+            if (wav_header_build(&header, data_size, buf) != 0) {
+                num_samples = -1;
+            } else if (memcmp(buf, &ids[0], sizeof(uint32_t)) == 0) {
+                put_u32(buf + 4, (uint32_t)riff_size);
+            }
+
+            if (num_samples >= 0 && pwrite_full(fd, buf, sizeof(buf), 0) != sizeof(buf)) {
+                num_samples = -1;
+            }
+        } else if (ids[0] == ID_RIFF && riff_size <= RIFF_SIZE_MAX) {
+            // other layouts keep their chunks, only the two 32 bit sizes are patched
+            uint32_t riff_size32 = (uint32_t)riff_size;
+            uint32_t data_size32 = (uint32_t)data_size;
+
+            if (pwrite_full(fd, &riff_size32, sizeof(riff_size32), 4) != sizeof(riff_size32)
+                    || pwrite_full(fd, &data_size32, sizeof(data_size32),
+                                   header.data_offset - 4) != sizeof(data_size32)) {
+                num_samples = -1;
+            }
+        } else {
+            num_samples = -1;
+        }
+    }
+
+    pthread_mutex_destroy(&src.io_lock);
+    close(fd);
+    return num_samples;
+}
+
+/* sample copy */
+
+#define COPY_BUFFER_SIZE    (1 << 20)   // bytes per read/write of copies converting samples
+#define COPY_CHUNK_SIZE     (1 << 30)   // bytes per copy_file_range/sendfile call
+
+// copy size bytes between files inside the kernel, copy_file_range shares extents or
+//    copies server side where the filesystem can, sendfile covers the rest (e.g. cross
+//    filesystem), out_fd offset is left at an unspecified position
+//    returns bytes copied
+static int64_t copy_range(int in_fd, int64_t in_offset, int out_fd, int64_t out_offset,
+                          int64_t size) {
+    loff_t off_in = in_offset;
+    loff_t off_out = out_offset;
+    int use_sendfile = 0;
+    int64_t done = 0;
+
+    while (done < size) {
+        size_t request = size - done < COPY_CHUNK_SIZE ? (size_t)(size - done) : COPY_CHUNK_SIZE;
+        ssize_t ret = 0;
+
+        if (!use_sendfile) {
+            ret = copy_file_range(in_fd, &off_in, out_fd, &off_out, request, 0);
+
+            if (ret < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL
+                            || errno == EOPNOTSUPP)) {
+                // sendfile writes at the file offset, pipes have none
+                if (lseek(out_fd, off_out, SEEK_SET) != off_out && errno != ESPIPE) {
+                    break;
+                }
+
+                use_sendfile = 1;
+                continue;
+            }
+        } else {
+            ret = sendfile(out_fd, in_fd, &off_in, request);
+            off_out += ret > 0 ? ret : 0;
+        }
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (ret <= 0) {
+            break;
+        }
+
+        done += ret;
+    }
+
+    return done;
+}
+
+// frames of reader move as stored: a plain file read in format, all channels, no mixing
+//    or resampling
+static int wav_reader_can_copy(const WavReader* reader, SampleFormat format) {
+    const struct WavHeader* hdr = &reader->hdr;
+
+    return reader->src->fd >= 0 && reader->src->io.read == NULL && reader->src->mem == NULL
+           && reader->num_read_channels == 0 && reader->num_mix_channels == 0
+           && reader->resampler == NULL && !hdr->streaming
+           && format == wav_header_get_sample_format(hdr)
+           && sample_format_get_bytes_per_sample(format) == hdr->bytes_per_sample;
+}
+
+// frames in format append to the file of writer as they are
+static int wav_writer_can_append(const WavWriter* writer, SampleFormat format) {
+    const struct WavHeader* hdr = &writer->hdr;
+
+    return writer->fp != NULL && writer->async == NULL && writer->ring == NULL
+           && writer->peaks == NULL && !writer->positional
+           && format == wav_header_get_sample_format(hdr)
+           && sample_format_get_bytes_per_sample(format) == hdr->bytes_per_sample;
+}
+
+// raw frames of reader can move to writer without convertion or userspace copy
+static int wav_writer_can_copy(const WavWriter* writer, const WavReader* reader) {
+    SampleFormat format = wav_header_get_sample_format(&reader->hdr);
+
+    return reader->hdr.num_channels == writer->hdr.num_channels
+           && wav_reader_can_copy(reader, format) && wav_writer_can_append(writer, format);
+}
+
+// append count frames at in_offset of in_fd to writer inside the kernel
+//    returns frames appended, -1 on failure
+static int64_t wav_writer_append_range(WavWriter* writer, int in_fd, int64_t in_offset,
+                                       int64_t count) {
+    struct WavHeader* hdr = &writer->hdr;
+
+    // data buffered by stdio goes first, the stream continues after the copied frames
+    if (fflush(writer->fp) != 0) {
+        return -1;
+    }
+
+    int64_t out_offset = hdr->data_offset + hdr->num_samples * hdr->block_align;
+    int64_t copied = copy_range(in_fd, in_offset, fileno(writer->fp), out_offset,
+                                count * hdr->block_align) / hdr->block_align;
+
+    // a partial frame at a failure is overwritten by the next write
+    hdr->num_samples += copied;
+    fseeko(writer->fp, hdr->data_offset + hdr->num_samples * hdr->block_align, SEEK_SET);
+
+    if (writer->checkpoint_samples > 0 && hdr->num_samples >= writer->next_checkpoint) {
+        wav_writer_checkpoint(writer);
+    }
+
+    return copied;
+}
+
+// copy frames through a buffer in the sample format of reader, writer converts
+static int64_t wav_writer_copy_buffered(WavWriter* writer, WavReader* reader,
+                                        int64_t num_samples) {
+    SampleFormat format = wav_header_get_sample_format(&reader->hdr);
+    int num_channels = wav_reader_get_num_read_channels(reader);
+    int64_t done = 0;
+
+    if (reader->num_mix_channels > 0 || reader->resampler != NULL) {
+        format = kSampleFormatF32;
+    }
+
+    int frame_size = num_channels * sample_format_get_bytes_per_sample(format);
+    int buffer_samples = COPY_BUFFER_SIZE / frame_size;
+    void* buf = malloc(COPY_BUFFER_SIZE);
+
+    if (buf == NULL || num_channels != writer->hdr.num_channels) {
+        free(buf);
+        return -1;
+    }
+
+    while (num_samples < 0 || done < num_samples) {
+        int request = buffer_samples;
+
+        if (num_samples >= 0 && num_samples - done < request) {
+            request = (int)(num_samples - done);
+        }
+
+        int ret = 0;
+
+        if (format == kSampleFormatF32) {
+            ret = wav_reader_read_f32(reader, request, (float*)buf);
+        } else if (format == kSampleFormatI16) {
+            ret = wav_reader_read_i16(reader, request, (int16_t*)buf);
+        } else if (format == kSampleFormatI24) {
+            ret = wav_reader_read_i24(reader, request, (uint8_t*)buf);
+        } else {
+            ret = wav_reader_read_i32(reader, request, (int32_t*)buf);
+        }
+
+        if (ret <= 0) {
+            break;
+        }
+
+        long write = wav_writer_write(writer, format, ret, buf);
+        done += write;
+
+        if (write < ret) {
+            break;
+        }
+    }
+
+    free(buf);
+    return done;
+}
+
+int64_t wav_writer_copy_samples(WavWriter* writer, WavReader* reader, int64_t num_samples) {
+    if (!wav_writer_can_copy(writer, reader)) {
+        return wav_writer_copy_buffered(writer, reader, num_samples);
+    }
+
+    int64_t position = wav_reader_tell(reader);
+    int64_t count = reader->num_samples_left;
+
+    if (num_samples >= 0 && num_samples < count) {
+        count = num_samples;
+    }
+
+    int64_t copied = wav_writer_append_range(writer, reader->src->fd, reader->hdr.data_offset
+                                             + position * reader->hdr.block_align, count);
+    copied = copied > 0 ? copied : 0;
+
+    if (copied > 0) {
+        wav_reader_seek(reader, position + copied, SEEK_SET);
+    }
+
+    // frames the kernel did not copy (e.g. EBADF, EPERM) go through a buffer
+    if (copied < count) {
+        int64_t rest = wav_writer_copy_buffered(writer, reader, count - copied);
+
+        if (rest < 0) {
+            return copied > 0 ? copied : -1;
+        }
+
+        copied += rest;
+    }
+
+    return copied;
+}
+
+static long write_full(int fd, const void* buf, size_t size) {
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t ret = write(fd, (const char*)buf + done, size - done);
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (ret <= 0) {
+            break;
+        }
+
+        done += ret;
+    }
+
+    return done;
+}
+
+int64_t wav_writer_write_fd(WavWriter* writer, int fd, SampleFormat format, int64_t num_samples) {
+    int frame_size = writer->hdr.num_channels * sample_format_get_bytes_per_sample(format);
+    int64_t offset = lseek(fd, 0, SEEK_CUR);
+    int64_t done = 0;
+    struct stat st;
+
+    if (frame_size <= 0) {
+        return -1;
+    }
+
+    // whole frames of regular files move inside the kernel
+    if (wav_writer_can_append(writer, format) && offset >= 0 && fstat(fd, &st) == 0
+            && S_ISREG(st.st_mode)) {
+        int64_t count = st.st_size > offset ? (st.st_size - offset) / frame_size : 0;
+
+        if (num_samples >= 0 && num_samples < count) {
+            count = num_samples;
+        }
+
+        done = wav_writer_append_range(writer, fd, offset, count);
+
+        if (done < 0 || lseek(fd, offset + done * frame_size, SEEK_SET) < 0) {
+            return -1;
+        }
+    }
+
+    // pipes, convertion and frames the kernel did not copy go through a buffer
+    int buffer_samples = COPY_BUFFER_SIZE / frame_size;
+    char* buf = (char*)malloc((size_t)buffer_samples * frame_size);
+    size_t fill = 0;
+    int failed = buf == NULL;
+
+    while (!failed && (num_samples < 0 || done < num_samples)) {
+        int request = buffer_samples;
+
+        if (num_samples >= 0 && num_samples - done < request) {
+            request = (int)(num_samples - done);
+        }
+
+        ssize_t ret = read(fd, buf + fill, (size_t)request * frame_size - fill);
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+
+        // a partial frame at end of file is dropped
+        if (ret <= 0) {
+            failed = ret < 0;
+            break;
+        }
+
+        fill += ret;
+        int count = (int)(fill / frame_size);
+
+        if (count > 0) {
+            long write = wav_writer_write(writer, format, count, buf);
+            done += write > 0 ? write : 0;
+
+            if (write < count) {
+                failed = 1;
+                break;
+            }
+
+            fill -= (size_t)count * frame_size;
+            memmove(buf, buf + (size_t)count * frame_size, fill);
+        }
+    }
+
+    free(buf);
+    return failed && done == 0 ? -1 : done;
+}
+
+int64_t wav_reader_read_fd(WavReader* reader, int fd, SampleFormat format, int64_t num_samples) {
+    int frame_size = wav_reader_get_num_read_channels(reader)
+                     * sample_format_get_bytes_per_sample(format);
+    int64_t done = 0;
+
+    if (frame_size <= 0) {
+        return -1;
+    }
+
+    if (wav_reader_can_copy(reader, format)) {
+        int64_t position = wav_reader_tell(reader);
+        int64_t count = reader->num_samples_left;
+        // pipes have no offset, sendfile writes them in order
+        int64_t offset = lseek(fd, 0, SEEK_CUR);
+
+        if (num_samples >= 0 && num_samples < count) {
+            count = num_samples;
+        }
+
+        int64_t copied = copy_range(reader->src->fd, reader->hdr.data_offset
+                                    + position * frame_size, fd, offset >= 0 ? offset : 0,
+                                    count * frame_size);
+
+        if (offset >= 0 && lseek(fd, offset + copied, SEEK_SET) < 0) {
+            return -1;
+        }
+
+        done = copied / frame_size;
+        wav_reader_seek(reader, position + done, SEEK_SET);
+
+        if (done == count || copied % frame_size != 0) {
+            return done;
+        }
+    }
+
+    // convertion and frames the kernel did not copy go through a buffer
+    int buffer_samples = COPY_BUFFER_SIZE / frame_size;
+    void* buf = malloc((size_t)buffer_samples * frame_size);
+    struct ReadTarget target = {format, buf, NULL, NULL};
+    int failed = buf == NULL;
+
+    while (!failed && (num_samples < 0 || done < num_samples)) {
+        int request = buffer_samples;
+
+        if (num_samples >= 0 && num_samples - done < request) {
+            request = (int)(num_samples - done);
+        }
+
+        int ret = wav_reader_read(reader, &target, request);
+
+        if (ret <= 0) {
+            failed = ret < 0;
+            break;
+        }
+
+        long write = write_full(fd, buf, (size_t)ret * frame_size) / frame_size;
+        done += write;
+
+        if (write < ret) {
+            failed = 1;
+            break;
+        }
+    }
+
+    free(buf);
+    return failed && done == 0 ? -1 : done;
+}
@@ -1,15 +1,25 @@
 #ifndef WAV_FILE
 #define WAV_FILE
 
+#include <stddef.h>
 #include <stdint.h>
 
 typedef enum {
     kSampleFormatInvalid = -1,
     kSampleFormatF32 = 0,
     kSampleFormatI16 = 1,
-    kSampleFormatI32 = 2
+    kSampleFormatI32 = 2,
+    kSampleFormatI24 = 3  // packed 3 bytes little endian
 } SampleFormat;
 
+// float to integer sample convertion of reads and writes
+typedef enum {
+    kDitherModeTruncate = 0,  // truncate toward zero, default
+    kDitherModeRound = 1,     // round to nearest
+    kDitherModeTpdf = 2,      // triangular dither of +-1 lsb, error is independent of signal
+    kDitherModeShaped = 3     // tpdf dither with first order noise shaping towards nyquist
+} DitherMode;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -21,6 +31,8 @@ static inline const char* sample_format_get_str(SampleFormat format) {
         return "i16";
     } else if (format == kSampleFormatI32) {
         return "i32";
+    } else if (format == kSampleFormatI24) {
+        return "i24";
     }
 
     return "invalid";
@@ -33,6 +45,8 @@ static inline int sample_format_get_bytes_per_sample(SampleFormat format) {
         return sizeof(int16_t);
     } else if (format == kSampleFormatI32) {
         return sizeof(int32_t);
+    } else if (format == kSampleFormatI24) {
+        return 3;
     }
 
     return -1;
@@ -44,26 +58,127 @@ static inline int sample_format_get_bytes_per_sample(SampleFormat format) {
 
 typedef struct WavReader WavReader;
 typedef struct WavWriter WavWriter;
+typedef struct WavPeaks WavPeaks;   // waveform overview index of wav_peaks.h
+
+/** User supplied io for streams, ctx is passed back to every callback
+ *    read/write return the number of bytes transferred, 0 at end of stream, -1 on error
+ *    seek moves to offset from whence (SEEK_SET/SEEK_CUR/SEEK_END) and returns the new
+ *    position or -1, seek is NULL for non-seekable streams (pipes, sockets)
+ */
+typedef struct WavIo {
+    long (*read)(void* ctx, void* buf, size_t size);
+    long (*write)(void* ctx, const void* buf, size_t size);
+    int64_t (*seek)(void* ctx, int64_t offset, int whence);
+    void* ctx;
+} WavIo;
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 /** WAV Reader
- *    - support float32/int16/int32 wav format
+ *    - support float32/int16/int24/int32 wav format
+ *    - support RIFF and RF64/BW64 (64 bit sizes) files
  *    - support max 256 channels
  *    - support max 48000*256 sample rate
- *    - read multi-channel samples in interleaved mode
+ *    - read multi-channel samples in interleaved or planar mode
+ *    - resample to another sample rate while reading
  */
 
+// filename may also be a pipe or character device (e.g. /dev/stdin), read as a stream
 WavReader* wav_reader_open(const char* filename);
 void wav_reader_close(WavReader* reader);
 
+// Open wav stream through io callbacks, io is copied and ctx must outlive the reader
+//    without seek samples are read front to back, a data size of 0 or 0xFFFFFFFF
+//    means unknown length and samples are read until end of stream
+WavReader* wav_reader_open_io(const WavIo* io);
+
+// Open wav file with the whole file memory mapped, reads are served from the
+//   mapping without syscalls, format convertion reads directly from the mapping
+WavReader* wav_reader_open_mmap(const char* filename);
+
+// Open wav file held in memory, header is parsed in place and reads or convertion are
+//    served straight from data without copies or syscalls, data must outlive the reader
+WavReader* wav_reader_open_memory(const void* data, size_t size);
+
+// Resample reads to sample_rate, 0 or the file rate reads at file rate, returns 0 on success
+//    polyphase windowed sinc resampler fused with format convertion, state carries
+//    across reads, num_samples, seek and tell then count frames at sample_rate,
+//    read position moves to the frame at the same time, read_at stays at file rate
+int wav_reader_set_output_rate(WavReader* reader, int sample_rate);
+
+// Select float to integer convertion of int16/int24/int32 reads from float files, mixing
+//    or resampling, rounding or dither instead of truncation, returns 0 on success
+int wav_reader_set_dither_mode(WavReader* reader, DitherMode mode);
+
+// Returns read-only pointer to the data chunk (interleaved samples in file format)
+//    size is set to the data chunk size in bytes
+//    only available for reader opened by wav_reader_open_mmap or wav_reader_open_memory,
+//    otherwise returns NULL
+const void* wav_reader_get_data(WavReader* reader, int64_t* size);
+
 // Returns the number of samples read interleaved
 //    if return number less than num_samples, check if reach file end
 //    if read format is different with file format, format convertion will be auto triggerred
 int wav_reader_read_f32(WavReader* reader, int num_samples, float* samples);
 int wav_reader_read_i16(WavReader* reader, int num_samples, int16_t* samples);
+int wav_reader_read_i32(WavReader* reader, int num_samples, int32_t* samples);
+
+// Returns the number of samples read as packed 24 bit, 3 bytes per sample
+//    only reads all channels interleaved, -1 if channels are selected
+int wav_reader_read_i24(WavReader* reader, int num_samples, uint8_t* samples);
+
+// Read num_samples frames (-1 to the end) from the read position to file descriptor fd
+//    as raw interleaved samples in format, returns the number of frames read, -1 on failure
+//    a file reader read in its own format with all channels, no mixing or resampling
+//    moves the sample payload inside the kernel (copy_file_range, sendfile also to pipes)
+int64_t wav_reader_read_fd(WavReader* reader, int fd, SampleFormat format, int64_t num_samples);
+
+// Select channels returned by subsequent reads, channels[k] is the file channel
+//    returned as channel k, unselected channels are neither converted nor returned
+//    channels NULL or num_channels 0 selects all channels, returns 0 on success
+int wav_reader_set_channels(WavReader* reader, const int* channels, int num_channels);
+
+// Select channels by bit mask, bit (c % 8) of mask[c / 8] selects channel c
+int wav_reader_set_channel_mask(WavReader* reader, const uint8_t* mask);
+
+// Mix file channels into num_out channels returned by subsequent reads, e.g. 8 -> 2 or
+//    N -> mono, read channel o is the sum of matrix[o * num_channels + c] * channel c
+//    channels of zero weight are neither read nor converted, mixing runs fused with
+//    format convertion, matrix NULL stops mixing, replaces channel selection and
+//    channel selection replaces it, returns 0 on success
+int wav_reader_set_mix_matrix(WavReader* reader, const float* matrix, int num_out);
+
+// return number of channels in each frame returned by reads
+int wav_reader_get_num_read_channels(WavReader* reader);
+
+// Returns the number of samples read in planar mode, channels[c] receives samples of channel c
+//    format convertion is fused with deinterleave, each sample is touched once
+int wav_reader_read_planar_f32(WavReader* reader, int num_samples, float* const* channels);
+int wav_reader_read_planar_i16(WavReader* reader, int num_samples, int16_t* const* channels);
+int wav_reader_read_planar_i32(WavReader* reader, int num_samples, int32_t* const* channels);
+
+// Move read position to frame_offset relative to whence (SEEK_SET/SEEK_CUR/SEEK_END)
+//    returns 0 on success, -1 if target position is out of data range
+int wav_reader_seek(WavReader* reader, int64_t frame_offset, int whence);
+
+// return current read position in frames
+int64_t wav_reader_tell(WavReader* reader);
+
+// Returns the number of samples read from frame_offset, -1 if frame_offset is out of range
+//    read position is neither used nor updated, safe to call concurrently on one reader
+int wav_reader_read_at_f32(WavReader* reader, int64_t frame_offset, int num_samples,
+                           float* samples);
+int wav_reader_read_at_i16(WavReader* reader, int64_t frame_offset, int num_samples,
+                           int16_t* samples);
+int wav_reader_read_at_i32(WavReader* reader, int64_t frame_offset, int num_samples,
+                           int32_t* samples);
+
+// Returns a new reader sharing the opened file (and mapping) with reader, with its
+//    own read position at start, give each thread a cursor instead of reopening
+//    the opened file is released when the last of them is closed
+WavReader* wav_reader_dup(WavReader* reader);
 
 int wav_reader_get_num_channels(WavReader* reader);
 int wav_reader_get_sample_rate(WavReader* reader);
@@ -74,26 +189,105 @@ int wav_reader_get_block_align(WavReader* reader);
 
 // valid_bits_per_sample equals bits_per_sample in most case, only if
 //   file format is int32, valid_bits in most case is 20/24.
+//   int32 reads clear the bits below valid_bits_per_sample
 int wav_reader_get_valid_bits_per_sample(WavReader* reader);
 
 // return sample format
 SampleFormat wav_reader_get_sample_format(WavReader* reader);
 
-// return number of samples in each channel
-int wav_reader_get_num_samples(WavReader* reader);
+// return number of samples in each channel, -1 if the stream length is unknown
+//    until a read reaches its end
+int64_t wav_reader_get_num_samples(WavReader* reader);
 
 
 /** WAV Writer
- *    - support float32/int16 wav format
+ *    - support float32/int16/int24/int32 wav format
+ *    - switch from RIFF to RF64 automatically when file exceeds 4 GB
  *    - support max 256 channels
  *    - support max 48000*256 sample rate
- *    - write multi-channel samples in interleaved mode
+ *    - write multi-channel samples in interleaved or planar mode
  */
 
-// bits_per_sample must be 16 (int16) or 32 (float32)
+// format is the sample format stored in file (f32/i16/i24/i32)
+//    filename may be a pipe, the header then marks unknown length
 WavWriter* wav_writer_open(const char* filename, int num_channels, int sample_rate,
                            SampleFormat format);
-void wav_writer_close(WavWriter* writer);
+// returns 0 on success, -1 if an async writer lost samples or the file failed to close
+int wav_writer_close(WavWriter* writer);
+
+int wav_writer_get_num_channels(WavWriter* writer);
+
+// Open wav writer on io callbacks, io is copied and ctx must outlive the writer
+//    num_samples is the number of frames to be written, stored in the header up front,
+//    or -1 if unknown; with seek the header is corrected on close, without seek
+//    a stream of unknown length has data size 0xFFFFFFFF
+WavWriter* wav_writer_open_io(const WavIo* io, int num_channels, int sample_rate,
+                              SampleFormat format, int64_t num_samples);
+
+// Open wav writer building the file in memory, in buffer of capacity bytes supplied by
+//    caller (arena) or, if buffer is NULL, in an internal buffer grown as needed with
+//    capacity as initial size (0 for default), writes beyond a full arena fail
+WavWriter* wav_writer_open_memory(void* buffer, size_t capacity, int num_channels,
+                                  int sample_rate, SampleFormat format);
+
+// Close writer opened by wav_writer_open_memory, header sizes are patched in place
+//    returns the wav file bytes without copy and sets size, internal buffer is owned by
+//    caller and released by free(), wav_writer_close discards it
+void* wav_writer_close_memory(WavWriter* writer, size_t* size);
+
+// Open wav writer with a background io thread, writes copy samples into one of
+//    num_buffers preallocated buffers of buffer_samples, convertion and file write
+//    run on the io thread
+//    when all buffers wait for io, writes block if blocking is non-zero, otherwise
+//    samples not accepted are dropped and counted as overrun
+WavWriter* wav_writer_open_async(const char* filename, int num_channels, int sample_rate,
+                                 SampleFormat format, int num_buffers, int buffer_samples,
+                                 int blocking);
+
+// Wait until all written samples reach the file, returns 0 on success, -1 if the file
+//    or the io thread of an async writer failed to write samples
+int wav_writer_flush(WavWriter* writer);
+
+// Reserve disk space for num_samples to avoid fragmentation, unused space is
+//    released on close, returns 0 on success
+int wav_writer_preallocate(WavWriter* writer, int64_t num_samples);
+
+// Report async writer backpressure, samples dropped on overrun, the maximum number
+//    of buffers waiting for io and samples lost to failed or short writes of the io thread
+void wav_writer_get_async_stats(WavWriter* writer, int64_t* overrun_samples, int* max_queued,
+                                int64_t* failed_samples);
+
+// Open wav writer for real-time threads (audio callbacks), writes copy frames into a
+//    preallocated lock-free single producer / single consumer ring of ring_samples frames
+//    without locks, allocation or system calls, convertion to ring_format (f32/i16/i32)
+//    is the only work, a drain thread converts to file format and writes
+//    frames not fitting into the ring are dropped and counted as overrun
+//    writes must come from one thread at a time, flush waits for the drain
+WavWriter* wav_writer_open_ring(const char* filename, int num_channels, int sample_rate,
+                                SampleFormat format, SampleFormat ring_format,
+                                int ring_samples);
+
+// Report ring writer counters, frames dropped on overrun and the high water mark of
+//    frames waiting in the ring
+void wav_writer_get_ring_stats(WavWriter* writer, int64_t* overrun_samples,
+                               int64_t* max_fill_samples);
+
+// Select float to integer convertion of float samples written to int16/int24/int32
+//    files, rounding or dither instead of truncation, returns 0 on success
+int wav_writer_set_dither_mode(WavWriter* writer, DitherMode mode);
+
+// Rewrite riff and data sizes of the header every seconds of audio or bytes of data
+//    written by stream writes (0 disables either), a crash then leaves a file readable up
+//    to the last checkpoint, header is patched by positional write covering the data
+//    already handed to the file, stream position is kept and nothing is flushed or synced
+//    only for writers of files, returns 0 on success
+int wav_writer_set_checkpoint(WavWriter* writer, double seconds, int64_t bytes);
+
+// Index every frame written by stream writes (write_*, write_planar_*, also from the io
+//    thread of async writers) as stored in the file, positional writes are not indexed
+//    call before the first write, peaks must outlive writer and not be queried while
+//    writes run, NULL detaches, returns 0 on success
+int wav_writer_set_peaks(WavWriter* writer, WavPeaks* peaks);
 
 // Returns the number of samples written success
 //    if return number less than num_samples, check if reach file end
@@ -101,6 +295,46 @@ void wav_writer_close(WavWriter* writer);
 int wav_writer_write_f32(WavWriter* writer, int num_samples, const float* samples);
 int wav_writer_write_i16(WavWriter* writer, int num_samples, const int16_t* samples);
 int wav_writer_write_i32(WavWriter* writer, int num_samples, const int32_t* samples);
+int wav_writer_write_i24(WavWriter* writer, int num_samples, const uint8_t* samples);
+
+// Returns the number of samples written at frame_offset of the data chunk, -1 on failure
+//    write position is neither used nor updated, safe to call concurrently on one writer
+//    only for writers of seekable files without io thread, do not mix with writes above
+//    data size is the end of the furthest write, preallocate it to avoid fragmentation
+int wav_writer_write_at_f32(WavWriter* writer, int64_t frame_offset, int num_samples,
+                            const float* samples);
+int wav_writer_write_at_i16(WavWriter* writer, int64_t frame_offset, int num_samples,
+                            const int16_t* samples);
+int wav_writer_write_at_i32(WavWriter* writer, int64_t frame_offset, int num_samples,
+                            const int32_t* samples);
+
+// Returns the number of samples written in planar mode, channels[c] holds samples of channel c
+//    format convertion is fused with interleave, each sample is touched once
+int wav_writer_write_planar_f32(WavWriter* writer, int num_samples, const float* const* channels);
+int wav_writer_write_planar_i16(WavWriter* writer, int num_samples, const int16_t* const* channels);
+int wav_writer_write_planar_i32(WavWriter* writer, int num_samples, const int32_t* const* channels);
+
+// Copy num_samples frames (-1 to the end) from the read position of reader to writer,
+//    returns the number of frames copied, -1 on failure
+//    a file reader with the channels and sample format of writer and no channel selection,
+//    mixing or resampling moves the sample payload inside the kernel (copy_file_range,
+//    sendfile), otherwise frames are read and written through format convertion
+int64_t wav_writer_copy_samples(WavWriter* writer, WavReader* reader, int64_t num_samples);
+
+// Write num_samples frames (-1 to end of file) of raw interleaved samples in format read
+//    from file descriptor fd at its offset, returns the number of frames written, -1 on failure
+//    a trailing partial frame is dropped, whole frames of regular files in the file format
+//    of writer move inside the kernel, pipes and other formats go through large buffers
+int64_t wav_writer_write_fd(WavWriter* writer, int fd, SampleFormat format, int64_t num_samples);
+
+// Repair the header of a wav file left unfinished by a crashed writer, riff and data sizes
+//    are rewritten in place, a data size of 0, 0xFFFFFFFF or past the end of file becomes
+//    the whole frames in the file, a shorter size followed by another chunk is kept, a
+//    shorter one followed by samples (the last checkpoint) becomes the whole frames, or
+//    with use_checkpoint is kept (e.g. preallocated files), sample data is not touched,
+//    dry_run only reports
+//    returns number of frames of the repaired file, -1 on failure
+int64_t wav_repair(const char* filename, int use_checkpoint, int dry_run);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,449 @@
+#include "wav_peaks.h"
+#include "wav_convert.h"
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NUM_CHANNELS    256
+#define MAX_SAMPLE_RATE     (48000 * 256)
+
+#define PEAKS_TILE_FRAMES   1024    // deinterleave tile of wav_peaks_add_f32
+#define PEAKS_READ_FRAMES   4096    // frames per read of wav_peaks_build
+#define PEAKS_MIN_BINS      64
+
+#define FOUR_CC(a, b, c, d) ((((uint32_t)a) << 0) | \
+                             (((uint32_t)b) << 8) | \
+                             (((uint32_t)c) << 16) | \
+                             (((uint32_t)d) << 24))
+
+#define ID_PEAKS FOUR_CC('W', 'P', 'K', '1')
+
+static const int default_bin_frames[] = {256, 4096, 65536};
+
+struct PeaksLevel {
+    int bin_frames;
+    int fill;           // frames in the last bin, 0 if it is complete
+    WavPeak* bins;      // num_channels peaks per bin
+    int64_t num_bins;
+    int64_t max_bins;
+    double* sum_sq;     // sum of squares of the last bin of each channel
+};
+
+struct WavPeaks {
+    int num_channels;
+    int sample_rate;
+    int64_t num_samples;
+    int num_levels;
+    int failed;         // out of memory, later frames are not indexed
+    struct PeaksLevel levels[WAV_PEAKS_MAX_LEVELS];
+    float* planar;      // deinterleave tile of wav_peaks_add_f32
+};
+
+// sidecar file header, followed by the bins of each level
+struct PeaksFileHeader {
+    uint32_t id;
+    uint32_t num_channels;
+    uint32_t sample_rate;
+    uint32_t num_levels;
+    int64_t num_samples;
+    uint32_t bin_frames[WAV_PEAKS_MAX_LEVELS];
+};
+
+WavPeaks* wav_peaks_create(int num_channels, int sample_rate, const int* bin_frames,
+                           int num_levels) {
+    if (bin_frames == NULL) {
+        bin_frames = default_bin_frames;
+        num_levels = sizeof(default_bin_frames) / sizeof(default_bin_frames[0]);
+    }
+
+    if (num_channels <= 0 || num_channels > MAX_NUM_CHANNELS || sample_rate <= 0
+            || sample_rate > MAX_SAMPLE_RATE || num_levels <= 0
+            || num_levels > WAV_PEAKS_MAX_LEVELS) {
+        return NULL;
+    }
+
+    for (int l = 0; l < num_levels; l++) {
+        if (bin_frames[l] <= 0 || (l > 0 && bin_frames[l] % bin_frames[l - 1] != 0)) {
+            return NULL;
+        }
+    }
+
+    WavPeaks* peaks = (WavPeaks*)calloc(1, sizeof(WavPeaks));
+
+    if (peaks == NULL) {
+        return NULL;
+    }
+
+    peaks->num_channels = num_channels;
+    peaks->sample_rate = sample_rate;
+    peaks->num_levels = num_levels;
+
+    for (int l = 0; l < num_levels; l++) {
+        peaks->levels[l].bin_frames = bin_frames[l];
+        peaks->levels[l].sum_sq = (double*)calloc(num_channels, sizeof(double));
+
+        if (peaks->levels[l].sum_sq == NULL) {
+            wav_peaks_destroy(peaks);
+            return NULL;
+        }
+    }
+
+    return peaks;
+}
+
+void wav_peaks_destroy(WavPeaks* peaks) {
+    if (peaks != NULL) {
+        for (int l = 0; l < peaks->num_levels; l++) {
+            free(peaks->levels[l].bins);
+            free(peaks->levels[l].sum_sq);
+        }
+
+        free(peaks->planar);
+        free(peaks);
+    }
+}
+
+static int peaks_level_reserve(struct PeaksLevel* level, int num_channels, int64_t num_bins) {
+    if (num_bins > level->max_bins) {
+        int64_t max_bins = level->max_bins > 0 ? level->max_bins : PEAKS_MIN_BINS;
+
+        while (max_bins < num_bins) {
+            max_bins *= 2;
+        }
+
+        WavPeak* bins = (WavPeak*)realloc(level->bins, (size_t)max_bins * num_channels
+                                          * sizeof(WavPeak));
+
+        if (bins == NULL) {
+            return -1;
+        }
+
+        level->bins = bins;
+        level->max_bins = max_bins;
+    }
+
+    return 0;
+}
+
+void wav_peaks_add_planar_f32(WavPeaks* peaks, int num_samples, const float* const* channels) {
+    int num_channels = peaks->num_channels;
+    int bin_frames = peaks->levels[0].bin_frames;
+
+    // spans never cross a level 0 bin, so neither a bin of the coarser levels
+    for (int i = 0; i < num_samples && !peaks->failed;) {
+        int len = bin_frames - peaks->levels[0].fill;
+        len = len < num_samples - i ? len : num_samples - i;
+
+        for (int l = 0; l < peaks->num_levels; l++) {
+            struct PeaksLevel* level = &peaks->levels[l];
+
+            if (level->fill == 0) {
+                if (peaks_level_reserve(level, num_channels, level->num_bins + 1) != 0) {
+                    peaks->failed = 1;
+                    return;
+                }
+
+                WavPeak* bin = level->bins + level->num_bins * num_channels;
+
+                for (int c = 0; c < num_channels; c++) {
+                    bin[c].min = FLT_MAX;
+                    bin[c].max = -FLT_MAX;
+                    level->sum_sq[c] = 0.;
+                }
+
+                level->num_bins++;
+            }
+
+            level->fill += len;
+        }
+
+        for (int c = 0; c < num_channels; c++) {
+            float lo = FLT_MAX;
+            float hi = -FLT_MAX;
+            double sum_sq = 0.;
+            minmax_f32(channels[c] + i, len, &lo, &hi, &sum_sq);
+
+            for (int l = 0; l < peaks->num_levels; l++) {
+                struct PeaksLevel* level = &peaks->levels[l];
+                WavPeak* bin = level->bins + (level->num_bins - 1) * num_channels + c;
+                bin->min = lo < bin->min ? lo : bin->min;
+                bin->max = hi > bin->max ? hi : bin->max;
+                level->sum_sq[c] += sum_sq;
+                bin->rms = (float)sqrt(level->sum_sq[c] / level->fill);
+            }
+        }
+
+        for (int l = 0; l < peaks->num_levels; l++) {
+            struct PeaksLevel* level = &peaks->levels[l];
+            level->fill = level->fill < level->bin_frames ? level->fill : 0;
+        }
+
+        peaks->num_samples += len;
+        i += len;
+    }
+}
+
+void wav_peaks_add_f32(WavPeaks* peaks, int num_samples, const float* samples) {
+    int num_channels = peaks->num_channels;
+    float* channels[MAX_NUM_CHANNELS];
+
+    if (peaks->planar == NULL) {
+        peaks->planar = (float*)malloc((size_t)num_channels * PEAKS_TILE_FRAMES * sizeof(float));
+
+        if (peaks->planar == NULL) {
+            peaks->failed = 1;
+            return;
+        }
+    }
+
+    for (int c = 0; c < num_channels; c++) {
+        channels[c] = peaks->planar + (long)c * PEAKS_TILE_FRAMES;
+    }
+
+    for (int t = 0; t < num_samples; t += PEAKS_TILE_FRAMES) {
+        int n = num_samples - t < PEAKS_TILE_FRAMES ? num_samples - t : PEAKS_TILE_FRAMES;
+        deinterleave_f32_to_f32(samples + (long)t * num_channels, num_channels, n,
+                                (void* const*)channels, 0);
+        wav_peaks_add_planar_f32(peaks, n, (const float* const*)channels);
+    }
+}
+
+WavPeaks* wav_peaks_build(WavReader* reader, const int* bin_frames, int num_levels) {
+    int num_channels = wav_reader_get_num_read_channels(reader);
+    WavPeaks* peaks = wav_peaks_create(num_channels, wav_reader_get_sample_rate(reader),
+                                       bin_frames, num_levels);
+    float* buf = (float*)malloc((size_t)num_channels * PEAKS_READ_FRAMES * sizeof(float));
+    float* channels[MAX_NUM_CHANNELS];
+    int ret = 0;
+
+    if (peaks == NULL || buf == NULL) {
+        wav_peaks_destroy(peaks);
+        free(buf);
+        return NULL;
+    }
+
+    for (int c = 0; c < num_channels; c++) {
+        channels[c] = buf + (long)c * PEAKS_READ_FRAMES;
+    }
+
+    while ((ret = wav_reader_read_planar_f32(reader, PEAKS_READ_FRAMES, channels)) > 0) {
+        wav_peaks_add_planar_f32(peaks, ret, (const float* const*)channels);
+    }
+
+    free(buf);
+
+    if (ret < 0 || peaks->failed) {
+        wav_peaks_destroy(peaks);
+        return NULL;
+    }
+
+    return peaks;
+}
+
+int wav_peaks_save(const WavPeaks* peaks, const char* filename) {
+    struct PeaksFileHeader header;
+
+    if (peaks->failed) {
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.id = ID_PEAKS;
+    header.num_channels = peaks->num_channels;
+    header.sample_rate = peaks->sample_rate;
+    header.num_levels = peaks->num_levels;
+    header.num_samples = peaks->num_samples;
+
+    for (int l = 0; l < peaks->num_levels; l++) {
+        header.bin_frames[l] = peaks->levels[l].bin_frames;
+    }
+
+    FILE* fp = fopen(filename, "wb");
+
+    if (fp == NULL) {
+        return -1;
+    }
+
+    int ret = fwrite(&header, sizeof(header), 1, fp) == 1 ? 0 : -1;
+
+    for (int l = 0; ret == 0 && l < peaks->num_levels; l++) {
+        const struct PeaksLevel* level = &peaks->levels[l];
+        size_t count = (size_t)level->num_bins * peaks->num_channels;
+        ret = fwrite(level->bins, sizeof(WavPeak), count, fp) == count ? 0 : -1;
+    }
+
+    if (fclose(fp) != 0) {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+WavPeaks* wav_peaks_load(const char* filename) {
+    struct PeaksFileHeader header;
+    int bin_frames[WAV_PEAKS_MAX_LEVELS];
+    FILE* fp = fopen(filename, "rb");
+
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 || header.id != ID_PEAKS
+            || header.num_levels == 0 || header.num_levels > WAV_PEAKS_MAX_LEVELS
+            || header.num_samples < 0) {
+        fclose(fp);
+        return NULL;
+    }
+
+    for (uint32_t l = 0; l < header.num_levels; l++) {
+        bin_frames[l] = header.bin_frames[l] <= INT32_MAX ? (int)header.bin_frames[l] : -1;
+    }
+
+    WavPeaks* peaks = wav_peaks_create((int)header.num_channels, (int)header.sample_rate,
+                                       bin_frames, (int)header.num_levels);
+    int ret = peaks != NULL ? 0 : -1;
+
+    for (int l = 0; ret == 0 && l < peaks->num_levels; l++) {
+        struct PeaksLevel* level = &peaks->levels[l];
+        int64_t num_bins = (header.num_samples + level->bin_frames - 1) / level->bin_frames;
+        size_t count = (size_t)num_bins * peaks->num_channels;
+
+        if (num_bins > 0 && (peaks_level_reserve(level, peaks->num_channels, num_bins) != 0
+                             || fread(level->bins, sizeof(WavPeak), count, fp) != count)) {
+            ret = -1;
+            break;
+        }
+
+        level->num_bins = num_bins;
+        level->fill = (int)(header.num_samples % level->bin_frames);
+    }
+
+    fclose(fp);
+
+    if (ret != 0) {
+        wav_peaks_destroy(peaks);
+        return NULL;
+    }
+
+    // sums of the last bins are restored from rms, a loaded index may grow further
+    for (int l = 0; l < peaks->num_levels; l++) {
+        struct PeaksLevel* level = &peaks->levels[l];
+
+        for (int c = 0; level->fill > 0 && c < peaks->num_channels; c++) {
+            double rms = level->bins[(level->num_bins - 1) * peaks->num_channels + c].rms;
+            level->sum_sq[c] = rms * rms * level->fill;
+        }
+    }
+
+    peaks->num_samples = header.num_samples;
+    return peaks;
+}
+
+int wav_peaks_get_num_channels(const WavPeaks* peaks) {
+    return peaks->num_channels;
+}
+
+int wav_peaks_get_sample_rate(const WavPeaks* peaks) {
+    return peaks->sample_rate;
+}
+
+int64_t wav_peaks_get_num_samples(const WavPeaks* peaks) {
+    return peaks->num_samples;
+}
+
+int wav_peaks_get_num_levels(const WavPeaks* peaks) {
+    return peaks->num_levels;
+}
+
+int wav_peaks_get_bin_frames(const WavPeaks* peaks, int level) {
+    if (level < 0 || level >= peaks->num_levels) {
+        return -1;
+    }
+
+    return peaks->levels[level].bin_frames;
+}
+
+int64_t wav_peaks_get_num_bins(const WavPeaks* peaks, int level) {
+    if (level < 0 || level >= peaks->num_levels) {
+        return -1;
+    }
+
+    return peaks->levels[level].num_bins;
+}
+
+int wav_peaks_get_bins(const WavPeaks* peaks, int level, int channel, int64_t first_bin,
+                       int num_bins, WavPeak* bins) {
+    if (level < 0 || level >= peaks->num_levels || channel < 0
+            || channel >= peaks->num_channels || first_bin < 0 || num_bins < 0) {
+        return -1;
+    }
+
+    const struct PeaksLevel* l = &peaks->levels[level];
+    int64_t available = l->num_bins - first_bin;
+    int count = available < num_bins ? (available > 0 ? (int)available : 0) : num_bins;
+
+    for (int i = 0; i < count; i++) {
+        bins[i] = l->bins[(first_bin + i) * peaks->num_channels + channel];
+    }
+
+    return count;
+}
+
+int wav_peaks_query(const WavPeaks* peaks, int channel, int64_t begin, int64_t end,
+                    int num_bins, WavPeak* bins) {
+    if (channel < 0 || channel >= peaks->num_channels || begin < 0 || end < begin
+            || num_bins <= 0) {
+        return -1;
+    }
+
+    int64_t length = end - begin;
+    int64_t span = length / num_bins;
+    int64_t rem = length % num_bins;
+    int k = 0;
+
+    // coarsest level whose bins fit in a span
+    while (k + 1 < peaks->num_levels && peaks->levels[k + 1].bin_frames <= span) {
+        k++;
+    }
+
+    const struct PeaksLevel* level = &peaks->levels[k];
+    int64_t bin_frames = level->bin_frames;
+
+    for (int i = 0; i < num_bins; i++) {
+        int64_t first = begin + span * i + rem * i / num_bins;
+        int64_t last = begin + span * (i + 1) + rem * (i + 1) / num_bins;
+        // spans narrower than a frame show the bin of their first frame
+        int64_t b0 = first / bin_frames;
+        int64_t b1 = last > first ? (last + bin_frames - 1) / bin_frames : b0 + 1;
+        float lo = FLT_MAX;
+        float hi = -FLT_MAX;
+        double sum_sq = 0.;
+        int64_t frames = 0;
+
+        b1 = b1 < level->num_bins ? b1 : level->num_bins;
+
+        for (int64_t b = b0; b < b1; b++) {
+            const WavPeak* bin = level->bins + b * peaks->num_channels + channel;
+            int64_t n = peaks->num_samples - b * bin_frames;
+            n = n < bin_frames ? n : bin_frames;
+            lo = bin->min < lo ? bin->min : lo;
+            hi = bin->max > hi ? bin->max : hi;
+            sum_sq += (double)bin->rms * bin->rms * n;
+            frames += n;
+        }
+
+        if (frames > 0) {
+            bins[i].min = lo;
+            bins[i].max = hi;
+            bins[i].rms = (float)sqrt(sum_sq / frames);
+        } else {
+            bins[i].min = 0.f;
+            bins[i].max = 0.f;
+            bins[i].rms = 0.f;
+        }
+    }
+
+    return num_bins;
+}
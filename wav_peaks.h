@@ -0,0 +1,73 @@
+#ifndef WAV_PEAKS
+#define WAV_PEAKS
+
+#include "wav_file.h"
+#include <stdint.h>
+
+/** Waveform overview index, a min/max/rms pyramid of every channel
+ *    - level 0 bins cover bin_frames[0] frames, every next level a multiple of the
+ *      previous one, default 256/4096/65536 frames per bin
+ *    - built from a reader in one pass, or incrementally from the frames a writer writes
+ *    - saved as a sidecar file, queries at any zoom read the index only
+ *    - sidecar stores host byte order floats, little endian on supported platforms
+ */
+
+#define WAV_PEAKS_MAX_LEVELS 8
+
+typedef struct WavPeak {
+    float min;
+    float max;
+    float rms;
+} WavPeak;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// bin_frames holds frames per bin of num_levels levels, each a multiple of the previous,
+//    or NULL for the default levels, returns NULL on invalid arguments
+WavPeaks* wav_peaks_create(int num_channels, int sample_rate, const int* bin_frames,
+                           int num_levels);
+void wav_peaks_destroy(WavPeaks* peaks);
+
+// Append num_samples frames of interleaved or planar samples to the index
+void wav_peaks_add_f32(WavPeaks* peaks, int num_samples, const float* samples);
+void wav_peaks_add_planar_f32(WavPeaks* peaks, int num_samples, const float* const* channels);
+
+// Build the index of reader from its read position to the end, channel selection,
+//    mixing and output rate apply, read position is at the end afterwards
+//    returns NULL on failure
+WavPeaks* wav_peaks_build(WavReader* reader, const int* bin_frames, int num_levels);
+
+// Save index to a sidecar file or load it, e.g. "take.wav.peaks", returns 0 / NULL on failure
+int wav_peaks_save(const WavPeaks* peaks, const char* filename);
+WavPeaks* wav_peaks_load(const char* filename);
+
+int wav_peaks_get_num_channels(const WavPeaks* peaks);
+int wav_peaks_get_sample_rate(const WavPeaks* peaks);
+int64_t wav_peaks_get_num_samples(const WavPeaks* peaks);
+int wav_peaks_get_num_levels(const WavPeaks* peaks);
+
+// return frames per bin of level, -1 if level is out of range
+int wav_peaks_get_bin_frames(const WavPeaks* peaks, int level);
+
+// return bins of level, the last one covers the frames after the last full bin
+int64_t wav_peaks_get_num_bins(const WavPeaks* peaks, int level);
+
+// Copy bins [first_bin, first_bin + num_bins) of channel at level to bins
+//    returns number of bins copied, -1 on invalid arguments
+int wav_peaks_get_bins(const WavPeaks* peaks, int level, int channel, int64_t first_bin,
+                       int num_bins, WavPeak* bins);
+
+// Overview of frames [begin, end) of channel in num_bins equal spans (e.g. pixels)
+//    each span combines the bins of the coarsest level not wider than the span, so it
+//    is exact on bin boundaries and rounds out to whole bins otherwise, spans beyond
+//    the indexed frames are zero, returns num_bins, -1 on invalid arguments
+int wav_peaks_query(const WavPeaks* peaks, int channel, int64_t begin, int64_t end,
+                    int num_bins, WavPeak* bins);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WAV_PEAKS
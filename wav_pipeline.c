@@ -0,0 +1,637 @@
+#include "wav_pipeline.h"
+#include "wav_convert.h"
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NUM_CHANNELS    256
+#define MAX_STAGES          32
+
+#define PIPELINE_TILE_BYTES (16 * 1024)     // float tile of the widest stage, stays in L1
+#define PIPELINE_MIN_TILE   16
+#define PIPELINE_RUN_BYTES  (256 * 1024)    // frames per read/write of wav_pipeline_run
+
+enum {
+    kStageGain,
+    kStageClip,
+    kStageGainClip,     // gain then clip at full scale, one saturating kernel
+    kStageMap,
+    kStageMix
+};
+
+struct PipelineStage;
+
+// float frames of src to dst, dst is src for stages working in place
+typedef void (*StageRun)(WavPipeline* pipeline, const struct PipelineStage* stage,
+                         const float* src, int count, float* dst);
+
+struct PipelineStage {
+    int type;
+    int num_in;
+    int num_out;
+    float limit;
+    float* coefs;       // gains of num_in channels, or num_out x num_in mix matrix
+    int* map;
+    StageRun run;       // picked at build
+    int in_place;
+};
+
+struct WavPipeline {
+    int num_channels;
+    SampleFormat in_format;
+    SampleFormat out_format;
+    DitherMode dither_mode;
+    int num_stages;
+    struct PipelineStage stages[MAX_STAGES];
+    int built;
+    int integer;        // integer in/out with gains only, no float tiles
+    int tile_frames;
+    float* tiles[2];    // ping pong float tiles, or int32 staging of packed 24 bit
+    float* planar[2];   // deinterleaved tiles of mixing
+    void (*input)(const void* src, int count, float* dst);
+    void (*output)(const float* src, int num_channels, int count, int mode, float* error,
+                   void* dst);
+    float dither_error[MAX_NUM_CHANNELS];   // noise shaping error carried across blocks
+};
+
+WavPipeline* wav_pipeline_create(int num_channels, SampleFormat in_format,
+                                 SampleFormat out_format) {
+    if (num_channels <= 0 || num_channels > MAX_NUM_CHANNELS
+            || sample_format_get_bytes_per_sample(in_format) == 0
+            || sample_format_get_bytes_per_sample(out_format) == 0) {
+        return NULL;
+    }
+
+    WavPipeline* pipeline = (WavPipeline*)calloc(1, sizeof(WavPipeline));
+
+    if (pipeline == NULL) {
+        return NULL;
+    }
+
+    pipeline->num_channels = num_channels;
+    pipeline->in_format = in_format;
+    pipeline->out_format = out_format;
+    pipeline->dither_mode = kDitherModeTruncate;
+    return pipeline;
+}
+
+void wav_pipeline_destroy(WavPipeline* pipeline) {
+    if (pipeline != NULL) {
+        for (int s = 0; s < pipeline->num_stages; s++) {
+            free(pipeline->stages[s].coefs);
+            free(pipeline->stages[s].map);
+        }
+
+        free(pipeline->tiles[0]);
+        free(pipeline->tiles[1]);
+        free(pipeline->planar[0]);
+        free(pipeline->planar[1]);
+        free(pipeline);
+    }
+}
+
+int wav_pipeline_get_num_in_channels(const WavPipeline* pipeline) {
+    return pipeline->num_channels;
+}
+
+int wav_pipeline_get_num_out_channels(const WavPipeline* pipeline) {
+    return pipeline->num_stages > 0 ? pipeline->stages[pipeline->num_stages - 1].num_out
+           : pipeline->num_channels;
+}
+
+// append a stage of type over the current channels, NULL if no more stages can be added
+static struct PipelineStage* wav_pipeline_append(WavPipeline* pipeline, int type, int num_out) {
+    if (pipeline->built || pipeline->num_stages == MAX_STAGES || num_out <= 0
+            || num_out > MAX_NUM_CHANNELS) {
+        return NULL;
+    }
+
+    struct PipelineStage* stage = &pipeline->stages[pipeline->num_stages];
+    memset(stage, 0, sizeof(*stage));
+    stage->type = type;
+    stage->num_in = wav_pipeline_get_num_out_channels(pipeline);
+    stage->num_out = num_out;
+    return stage;
+}
+
+int wav_pipeline_add_gain(WavPipeline* pipeline, const float* gains) {
+    int num_channels = wav_pipeline_get_num_out_channels(pipeline);
+    struct PipelineStage* stage = wav_pipeline_append(pipeline, kStageGain, num_channels);
+
+    if (stage == NULL || gains == NULL) {
+        return -1;
+    }
+
+    stage->coefs = (float*)malloc((size_t)num_channels * sizeof(float));
+
+    if (stage->coefs == NULL) {
+        return -1;
+    }
+
+    memcpy(stage->coefs, gains, (size_t)num_channels * sizeof(float));
+    pipeline->num_stages++;
+    return 0;
+}
+
+int wav_pipeline_add_clip(WavPipeline* pipeline, float limit) {
+    int num_channels = wav_pipeline_get_num_out_channels(pipeline);
+    struct PipelineStage* stage = wav_pipeline_append(pipeline, kStageClip, num_channels);
+
+    if (stage == NULL || !(limit >= 0.f)) {
+        return -1;
+    }
+
+    stage->limit = limit;
+    pipeline->num_stages++;
+    return 0;
+}
+
+int wav_pipeline_add_channel_map(WavPipeline* pipeline, const int* map, int num_out) {
+    int num_channels = wav_pipeline_get_num_out_channels(pipeline);
+    struct PipelineStage* stage = wav_pipeline_append(pipeline, kStageMap, num_out);
+
+    if (stage == NULL || map == NULL) {
+        return -1;
+    }
+
+    for (int k = 0; k < num_out; k++) {
+        if (map[k] < -1 || map[k] >= num_channels) {
+            return -1;
+        }
+    }
+
+    stage->map = (int*)malloc((size_t)num_out * sizeof(int));
+
+    if (stage->map == NULL) {
+        return -1;
+    }
+
+    memcpy(stage->map, map, (size_t)num_out * sizeof(int));
+    pipeline->num_stages++;
+    return 0;
+}
+
+int wav_pipeline_add_mix(WavPipeline* pipeline, const float* matrix, int num_out) {
+    int num_channels = wav_pipeline_get_num_out_channels(pipeline);
+    struct PipelineStage* stage = wav_pipeline_append(pipeline, kStageMix, num_out);
+
+    if (stage == NULL || matrix == NULL) {
+        return -1;
+    }
+
+    size_t size = (size_t)num_out * num_channels * sizeof(float);
+    stage->coefs = (float*)malloc(size);
+
+    if (stage->coefs == NULL) {
+        return -1;
+    }
+
+    memcpy(stage->coefs, matrix, size);
+    pipeline->num_stages++;
+    return 0;
+}
+
+int wav_pipeline_set_dither_mode(WavPipeline* pipeline, DitherMode mode) {
+    if (pipeline->built || mode < kDitherModeTruncate || mode > kDitherModeShaped) {
+        return -1;
+    }
+
+    pipeline->dither_mode = mode;
+    return 0;
+}
+
+/* stage kernels */
+
+static void stage_gain(WavPipeline* pipeline, const struct PipelineStage* stage,
+                       const float* src, int count, float* dst) {
+    int num_channels = stage->num_in;
+    const float* gains = stage->coefs;
+    (void)pipeline;
+
+    for (long i = 0; i < (long)count * num_channels; i += num_channels) {
+        for (int c = 0; c < num_channels; c++) {
+            dst[i + c] = src[i + c] * gains[c];
+        }
+    }
+}
+
+// saturating gain kernel works in place, src is copied first when it is another tile
+static void stage_gain_clip(WavPipeline* pipeline, const struct PipelineStage* stage,
+                            const float* src, int count, float* dst) {
+    (void)pipeline;
+
+    if (dst != src) {
+        memcpy(dst, src, (size_t)count * stage->num_in * sizeof(float));
+    }
+
+    gain_f32(dst, stage->num_in, count, stage->coefs);
+}
+
+static void stage_clip(WavPipeline* pipeline, const struct PipelineStage* stage,
+                       const float* src, int count, float* dst) {
+    float limit = stage->limit;
+    (void)pipeline;
+
+    for (long i = 0; i < (long)count * stage->num_in; i++) {
+        float v = src[i] < limit ? src[i] : limit;
+        dst[i] = v > -limit ? v : -limit;
+    }
+}
+
+static void stage_map(WavPipeline* pipeline, const struct PipelineStage* stage,
+                      const float* src, int count, float* dst) {
+    int num_in = stage->num_in;
+    int num_out = stage->num_out;
+    const int* map = stage->map;
+    (void)pipeline;
+
+    for (int i = 0; i < count; i++) {
+        for (int k = 0; k < num_out; k++) {
+            dst[(long)i * num_out + k] = map[k] >= 0 ? src[(long)i * num_in + map[k]] : 0.f;
+        }
+    }
+}
+
+// matrix kernel runs on channel arrays, the tile is deinterleaved around it
+static void stage_mix(WavPipeline* pipeline, const struct PipelineStage* stage,
+                      const float* src, int count, float* dst) {
+    int tile_frames = pipeline->tile_frames;
+    float* in[MAX_NUM_CHANNELS];
+    float* out[MAX_NUM_CHANNELS];
+
+    for (int c = 0; c < stage->num_in; c++) {
+        in[c] = pipeline->planar[0] + (long)c * tile_frames;
+    }
+
+    for (int o = 0; o < stage->num_out; o++) {
+        out[o] = pipeline->planar[1] + (long)o * tile_frames;
+    }
+
+    deinterleave_f32_to_f32(src, stage->num_in, count, (void* const*)in, 0);
+    mix_f32((const float* const*)in, stage->num_in, count, stage->coefs, stage->num_out, out);
+    interleave_f32_to_f32((const void* const*)out, 0, stage->num_out, count, dst);
+}
+
+/* input and output convertion */
+
+static void input_f32(const void* src, int count, float* dst) {
+    memcpy(dst, src, (size_t)count * sizeof(float));
+}
+
+static void input_i16(const void* src, int count, float* dst) {
+    convert_i16_to_f32((const int16_t*)src, count, dst);
+}
+
+static void input_i24(const void* src, int count, float* dst) {
+    convert_i24_to_f32((const uint8_t*)src, count, dst);
+}
+
+static void input_i32(const void* src, int count, float* dst) {
+    convert_i32_to_f32((const int32_t*)src, count, dst);
+}
+
+static void output_f32(const float* src, int num_channels, int count, int mode, float* error,
+                       void* dst) {
+    (void)mode;
+    (void)error;
+    memcpy(dst, src, (size_t)count * num_channels * sizeof(float));
+}
+
+static void output_i16(const float* src, int num_channels, int count, int mode, float* error,
+                       void* dst) {
+    (void)mode;
+    (void)error;
+    convert_f32_to_i16(src, count * num_channels, (int16_t*)dst);
+}
+
+static void output_i24(const float* src, int num_channels, int count, int mode, float* error,
+                       void* dst) {
+    (void)mode;
+    (void)error;
+    convert_f32_to_i24(src, count * num_channels, (uint8_t*)dst);
+}
+
+static void output_i32(const float* src, int num_channels, int count, int mode, float* error,
+                       void* dst) {
+    (void)mode;
+    (void)error;
+    convert_f32_to_i32(src, count * num_channels, (int32_t*)dst);
+}
+
+static void quantize_i16(const float* src, int num_channels, int count, int mode, float* error,
+                         void* dst) {
+    quantize_f32_to_i16(src, num_channels, count, mode, error, (int16_t*)dst);
+}
+
+static void quantize_i24(const float* src, int num_channels, int count, int mode, float* error,
+                         void* dst) {
+    quantize_f32_to_i24(src, num_channels, count, mode, error, (uint8_t*)dst);
+}
+
+static void quantize_i32(const float* src, int num_channels, int count, int mode, float* error,
+                         void* dst) {
+    quantize_f32_to_i32(src, num_channels, count, mode, 32, error, (int32_t*)dst);
+}
+
+/* build */
+
+// fold consecutive gains, fuse gain and clip at full scale
+static void wav_pipeline_fuse(WavPipeline* pipeline) {
+    int n = 0;
+
+    for (int s = 0; s < pipeline->num_stages; s++) {
+        struct PipelineStage* stage = &pipeline->stages[s];
+        struct PipelineStage* prev = n > 0 ? &pipeline->stages[n - 1] : NULL;
+
+        if (prev != NULL && prev->type == kStageGain && stage->type == kStageGain) {
+            for (int c = 0; c < stage->num_in; c++) {
+                prev->coefs[c] *= stage->coefs[c];
+            }
+
+            free(stage->coefs);
+            continue;
+        }
+
+        if (prev != NULL && prev->type == kStageGain && stage->type == kStageClip
+                && stage->limit == 1.f) {
+            prev->type = kStageGainClip;
+            continue;
+        }
+
+        if (n != s) {
+            pipeline->stages[n] = *stage;
+        }
+
+        n++;
+    }
+
+    pipeline->num_stages = n;
+}
+
+// gains on integer samples of the same in and out format need no float tiles
+static int wav_pipeline_is_integer(const WavPipeline* pipeline) {
+    if (pipeline->in_format != pipeline->out_format || pipeline->in_format == kSampleFormatF32
+            || pipeline->num_stages > 1) {
+        return 0;
+    }
+
+    if (pipeline->num_stages == 1) {
+        const struct PipelineStage* stage = &pipeline->stages[0];
+
+        // integer gain kernels saturate at full scale
+        return stage->type == kStageGainClip || stage->type == kStageGain
+               || (stage->type == kStageClip && stage->limit >= 1.f);
+    }
+
+    return 1;
+}
+
+static int wav_pipeline_build(WavPipeline* pipeline) {
+    if (pipeline->built) {
+        return 0;
+    }
+
+    wav_pipeline_fuse(pipeline);
+    pipeline->integer = wav_pipeline_is_integer(pipeline);
+
+    int max_channels = pipeline->num_channels;
+    int num_mix_channels = 0;
+
+    for (int s = 0; s < pipeline->num_stages; s++) {
+        struct PipelineStage* stage = &pipeline->stages[s];
+        max_channels = stage->num_out > max_channels ? stage->num_out : max_channels;
+
+        if (stage->type == kStageGain) {
+            stage->run = stage_gain;
+            stage->in_place = 1;
+        } else if (stage->type == kStageGainClip) {
+            stage->run = stage_gain_clip;
+            stage->in_place = 1;
+        } else if (stage->type == kStageClip) {
+            stage->run = stage_clip;
+            stage->in_place = 1;
+        } else if (stage->type == kStageMap) {
+            stage->run = stage_map;
+        } else {
+            stage->run = stage_mix;
+            num_mix_channels = stage->num_in > num_mix_channels ? stage->num_in
+                               : num_mix_channels;
+            num_mix_channels = stage->num_out > num_mix_channels ? stage->num_out
+                               : num_mix_channels;
+        }
+    }
+
+    if (pipeline->in_format == kSampleFormatF32) {
+        pipeline->input = input_f32;
+    } else if (pipeline->in_format == kSampleFormatI16) {
+        pipeline->input = input_i16;
+    } else if (pipeline->in_format == kSampleFormatI24) {
+        pipeline->input = input_i24;
+    } else {
+        pipeline->input = input_i32;
+    }
+
+    int quantize = pipeline->dither_mode != kDitherModeTruncate;
+
+    if (pipeline->out_format == kSampleFormatF32) {
+        pipeline->output = output_f32;
+    } else if (pipeline->out_format == kSampleFormatI16) {
+        pipeline->output = quantize ? quantize_i16 : output_i16;
+    } else if (pipeline->out_format == kSampleFormatI24) {
+        pipeline->output = quantize ? quantize_i24 : output_i24;
+    } else {
+        pipeline->output = quantize ? quantize_i32 : output_i32;
+    }
+
+    int tile_frames = PIPELINE_TILE_BYTES / (max_channels * (int)sizeof(float));
+    pipeline->tile_frames = tile_frames > PIPELINE_MIN_TILE ? tile_frames : PIPELINE_MIN_TILE;
+
+    size_t tile_size = (size_t)pipeline->tile_frames * max_channels * sizeof(float);
+    size_t planar_size = (size_t)pipeline->tile_frames * num_mix_channels * sizeof(float);
+    // a failed build may be retried
+    free(pipeline->tiles[0]);
+    free(pipeline->tiles[1]);
+    free(pipeline->planar[0]);
+    free(pipeline->planar[1]);
+    pipeline->planar[0] = NULL;
+    pipeline->planar[1] = NULL;
+    pipeline->tiles[0] = (float*)malloc(tile_size);
+    pipeline->tiles[1] = (float*)malloc(tile_size);
+
+    if (num_mix_channels > 0) {
+        pipeline->planar[0] = (float*)malloc(planar_size);
+        pipeline->planar[1] = (float*)malloc(planar_size);
+    }
+
+    if (pipeline->tiles[0] == NULL || pipeline->tiles[1] == NULL
+            || (num_mix_channels > 0 && (pipeline->planar[0] == NULL
+                                         || pipeline->planar[1] == NULL))) {
+        return -1;
+    }
+
+    pipeline->built = 1;
+    return 0;
+}
+
+/* process */
+
+// gains on integer frames, packed 24 bit is staged as int32
+static void wav_pipeline_process_integer(WavPipeline* pipeline, const char* src, int count,
+                                         char* dst) {
+    int num_channels = pipeline->num_channels;
+    const struct PipelineStage* stage = pipeline->num_stages > 0 ? &pipeline->stages[0] : NULL;
+    const float* gains = stage != NULL && stage->type != kStageClip ? stage->coefs : NULL;
+    int frame_size = num_channels * sample_format_get_bytes_per_sample(pipeline->in_format);
+    int32_t* staged = (int32_t*)pipeline->tiles[0];
+
+    for (int t = 0; t < count; t += pipeline->tile_frames) {
+        int n = count - t < pipeline->tile_frames ? count - t : pipeline->tile_frames;
+        const char* in = src + (long)t * frame_size;
+        char* out = dst + (long)t * frame_size;
+
+        if (pipeline->in_format == kSampleFormatI24) {
+            convert_i24_to_i32((const uint8_t*)in, n * num_channels, staged);
+
+            if (gains != NULL) {
+                gain_i32(staged, num_channels, n, gains);
+            }
+
+            convert_i32_to_i24(staged, n * num_channels, (uint8_t*)out);
+            continue;
+        }
+
+        if (out != in) {
+            memmove(out, in, (size_t)n * frame_size);
+        }
+
+        if (gains != NULL && pipeline->in_format == kSampleFormatI16) {
+            gain_i16((int16_t*)out, num_channels, n, gains);
+        } else if (gains != NULL) {
+            gain_i32((int32_t*)out, num_channels, n, gains);
+        }
+    }
+}
+
+int wav_pipeline_process(WavPipeline* pipeline, const void* src, int count, void* dst) {
+    if (count < 0 || wav_pipeline_build(pipeline) != 0) {
+        return -1;
+    }
+
+    if (pipeline->integer) {
+        wav_pipeline_process_integer(pipeline, (const char*)src, count, (char*)dst);
+        return count;
+    }
+
+    int num_in = pipeline->num_channels;
+    int num_out = wav_pipeline_get_num_out_channels(pipeline);
+    int in_size = num_in * sample_format_get_bytes_per_sample(pipeline->in_format);
+    int out_size = num_out * sample_format_get_bytes_per_sample(pipeline->out_format);
+
+    // a tile is read whole before it is written, so dst may trail src
+    for (int t = 0; t < count; t += pipeline->tile_frames) {
+        int n = count - t < pipeline->tile_frames ? count - t : pipeline->tile_frames;
+        float* cur = pipeline->tiles[0];
+        float* next = pipeline->tiles[1];
+
+        pipeline->input((const char*)src + (long)t * in_size, n * num_in, cur);
+
+        for (int s = 0; s < pipeline->num_stages; s++) {
+            const struct PipelineStage* stage = &pipeline->stages[s];
+
+            if (stage->in_place) {
+                stage->run(pipeline, stage, cur, n, cur);
+            } else {
+                stage->run(pipeline, stage, cur, n, next);
+                float* tmp = cur;
+                cur = next;
+                next = tmp;
+            }
+        }
+
+        pipeline->output(cur, num_out, n, pipeline->dither_mode, pipeline->dither_error,
+                         (char*)dst + (long)t * out_size);
+    }
+
+    return count;
+}
+
+static int pipeline_read(WavReader* reader, SampleFormat format, int num_samples, void* buf) {
+    if (format == kSampleFormatF32) {
+        return wav_reader_read_f32(reader, num_samples, (float*)buf);
+    } else if (format == kSampleFormatI16) {
+        return wav_reader_read_i16(reader, num_samples, (int16_t*)buf);
+    } else if (format == kSampleFormatI24) {
+        return wav_reader_read_i24(reader, num_samples, (uint8_t*)buf);
+    } else {
+        return wav_reader_read_i32(reader, num_samples, (int32_t*)buf);
+    }
+}
+
+static int pipeline_write(WavWriter* writer, SampleFormat format, int num_samples,
+                          const void* buf) {
+    if (format == kSampleFormatF32) {
+        return wav_writer_write_f32(writer, num_samples, (const float*)buf);
+    } else if (format == kSampleFormatI16) {
+        return wav_writer_write_i16(writer, num_samples, (const int16_t*)buf);
+    } else if (format == kSampleFormatI24) {
+        return wav_writer_write_i24(writer, num_samples, (const uint8_t*)buf);
+    } else {
+        return wav_writer_write_i32(writer, num_samples, (const int32_t*)buf);
+    }
+}
+
+int64_t wav_pipeline_run(WavPipeline* pipeline, WavReader* reader, WavWriter* writer,
+                         int64_t num_samples) {
+    int num_out = wav_pipeline_get_num_out_channels(pipeline);
+
+    if (wav_pipeline_build(pipeline) != 0
+            || wav_reader_get_num_read_channels(reader) != pipeline->num_channels
+            || wav_writer_get_num_channels(writer) != num_out) {
+        return -1;
+    }
+
+    int in_size = pipeline->num_channels * sample_format_get_bytes_per_sample(pipeline->in_format);
+    int out_size = num_out * sample_format_get_bytes_per_sample(pipeline->out_format);
+    int max_size = in_size > out_size ? in_size : out_size;
+    int buffer_samples = PIPELINE_RUN_BYTES / max_size > 0 ? PIPELINE_RUN_BYTES / max_size : 1;
+    void* in_buf = malloc((size_t)buffer_samples * in_size);
+    // frames shrinking or keeping their size are processed in place
+    void* out_buf = out_size <= in_size ? in_buf : malloc((size_t)buffer_samples * out_size);
+    int64_t done = 0;
+    int failed = in_buf == NULL || out_buf == NULL;
+
+    while (!failed && (num_samples < 0 || done < num_samples)) {
+        int request = buffer_samples;
+
+        if (num_samples >= 0 && num_samples - done < request) {
+            request = (int)(num_samples - done);
+        }
+
+        int ret = pipeline_read(reader, pipeline->in_format, request, in_buf);
+
+        if (ret <= 0) {
+            failed = ret < 0;
+            break;
+        }
+
+        if (wav_pipeline_process(pipeline, in_buf, ret, out_buf) != ret) {
+            failed = 1;
+            break;
+        }
+
+        int write = pipeline_write(writer, pipeline->out_format, ret, out_buf);
+        done += write > 0 ? write : 0;
+
+        if (write < ret) {
+            failed = 1;
+            break;
+        }
+    }
+
+    if (out_buf != in_buf) {
+        free(out_buf);
+    }
+
+    free(in_buf);
+    return failed && done == 0 ? -1 : done;
+}
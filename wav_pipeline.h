@@ -0,0 +1,69 @@
+#ifndef WAV_PIPELINE
+#define WAV_PIPELINE
+
+#include "wav_file.h"
+#include <stdint.h>
+
+/** Block processing pipeline, input convertion -> stages -> output convertion
+ *    - stages are gain, clip, channel map and mixing, applied in the order added
+ *    - frames run through every stage tile by tile, tiles stay in cache so each sample
+ *      is loaded and stored once however many stages there are
+ *    - kernels are picked once when the pipeline is built, at the first process or run:
+ *      consecutive gains fold into one, gain followed by clip at full scale runs as one
+ *      saturating kernel, integer in and out formats with gains only stay integer
+ *      (exact as gain_i16/gain_i32), other chains work in float
+ *    - a pipeline keeps scratch tiles, use one pipeline per thread
+ */
+
+typedef struct WavPipeline WavPipeline;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// frames of num_channels come in as in_format and go out as out_format
+//    returns NULL on invalid arguments
+WavPipeline* wav_pipeline_create(int num_channels, SampleFormat in_format,
+                                 SampleFormat out_format);
+void wav_pipeline_destroy(WavPipeline* pipeline);
+
+// Append a stage over the channels left by the previous stages, returns 0 on success,
+//    -1 on invalid arguments or once the pipeline is built
+// gains[c] scales channel c
+int wav_pipeline_add_gain(WavPipeline* pipeline, const float* gains);
+
+// clip samples to [-limit, limit], full scale is 1
+int wav_pipeline_add_clip(WavPipeline* pipeline, float limit);
+
+// output channel k is channel map[k], -1 for silence
+int wav_pipeline_add_channel_map(WavPipeline* pipeline, const int* map, int num_out);
+
+// output channel o is the sum of matrix[o * num_channels + c] * channel c
+int wav_pipeline_add_mix(WavPipeline* pipeline, const float* matrix, int num_out);
+
+// Select float to integer output convertion as wav_writer_set_dither_mode, default
+//    truncation, returns 0 on success
+int wav_pipeline_set_dither_mode(WavPipeline* pipeline, DitherMode mode);
+
+int wav_pipeline_get_num_in_channels(const WavPipeline* pipeline);
+
+// return number of channels left by the stages
+int wav_pipeline_get_num_out_channels(const WavPipeline* pipeline);
+
+// Process count interleaved frames of src into dst, returns count, -1 on failure
+//    dst may be src if output frames are not larger than input frames
+int wav_pipeline_process(WavPipeline* pipeline, const void* src, int count, void* dst);
+
+// Process num_samples frames (-1 to the end) from reader to writer, returns the number
+//    of frames written, -1 on failure or if reader and writer channels do not match the
+//    pipeline input and output channels
+//    reads are in_format and writes out_format, with the sample formats of the files
+//    reader and writer only move data and every sample is converted once
+int64_t wav_pipeline_run(WavPipeline* pipeline, WavReader* reader, WavWriter* writer,
+                         int64_t num_samples);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WAV_PIPELINE
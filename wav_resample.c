@@ -0,0 +1,234 @@
+#include "wav_resample.h"
+#include "wav_convert.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define RESAMPLE_MAX_PHASES     1024
+#define RESAMPLE_ZERO_CROSSINGS 16
+#define RESAMPLE_MAX_HALF_TAPS  2048
+#define RESAMPLE_ROLLOFF        0.95
+#define RESAMPLE_KAISER_BETA    8.0
+#define RESAMPLE_BLOCK_FRAMES   256     // outputs per kernel call
+#define RESAMPLE_INPUT_FRAMES   4096    // input frames buffered beyond the filter span
+
+struct Resampler {
+    int num_channels;
+    int up;             // out_rate / in_rate reduced to up / down
+    int down;
+    int num_phases;     // up if exact, RESAMPLE_MAX_PHASES otherwise
+    int half_taps;
+    int num_taps;       // 2 * half_taps, multiple of 16
+    float* filters;     // (num_phases + 1) filters of num_taps
+    float* buf;         // per channel input of capacity frames
+    int capacity;
+    int64_t buf_start;  // input frame index of the first buffered frame
+    int buf_len;
+    int64_t position;   // next output frame
+    int64_t base;       // position * down / up
+    int64_t phase;      // position * down % up
+};
+
+static int gcd(int a, int b) {
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+// zeroth order modified bessel function of the first kind
+static double bessel_i0(double x) {
+    double sum = 1.;
+    double term = 1.;
+
+    for (int k = 1; k < 64 && term > sum * 1e-12; k++) {
+        double t = x / (2. * k);
+        term *= t * t;
+        sum += term;
+    }
+
+    return sum;
+}
+
+// filter of fraction q / num_phases, taps k over input frames base - half_taps + 1 + k
+static void design_filter(float* taps, int num_taps, int half_taps, double frac, double cutoff) {
+    double sum = 0.;
+    double norm = bessel_i0(RESAMPLE_KAISER_BETA);
+
+    for (int k = 0; k < num_taps; k++) {
+        double t = frac + half_taps - 1 - k;
+        double x = t / half_taps;
+        double h = 0.;
+
+        if (x > -1. && x < 1.) {
+            double arg = 2. * cutoff * t;
+            double sinc = arg == 0. ? 1. : sin(M_PI * arg) / (M_PI * arg);
+            h = 2. * cutoff * sinc * bessel_i0(RESAMPLE_KAISER_BETA * sqrt(1. - x * x)) / norm;
+        }
+
+        taps[k] = (float)h;
+        sum += h;
+    }
+
+    // unity gain at dc for every phase
+    for (int k = 0; k < num_taps; k++) {
+        taps[k] = (float)(taps[k] / sum);
+    }
+}
+
+Resampler* resampler_create(int num_channels, int in_rate, int out_rate) {
+    if (num_channels <= 0 || in_rate <= 0 || out_rate <= 0) {
+        return NULL;
+    }
+
+    Resampler* rs = (Resampler*)calloc(1, sizeof(Resampler));
+
+    if (rs == NULL) {
+        return NULL;
+    }
+
+    int g = gcd(in_rate, out_rate);
+    rs->num_channels = num_channels;
+    rs->up = out_rate / g;
+    rs->down = in_rate / g;
+    rs->num_phases = rs->up <= RESAMPLE_MAX_PHASES ? rs->up : RESAMPLE_MAX_PHASES;
+
+    // filter stretches over down / up input frames per zero crossing when decimating
+    double scale = rs->up < rs->down ? (double)rs->up / rs->down : 1.;
+    int half_taps = (int)ceil(RESAMPLE_ZERO_CROSSINGS / (scale * RESAMPLE_ROLLOFF));
+    half_taps = half_taps < RESAMPLE_MAX_HALF_TAPS ? half_taps : RESAMPLE_MAX_HALF_TAPS;
+    rs->half_taps = (half_taps + 7) / 8 * 8;
+    rs->num_taps = 2 * rs->half_taps;
+    rs->capacity = rs->num_taps + RESAMPLE_INPUT_FRAMES;
+
+    rs->filters = (float*)malloc((size_t)(rs->num_phases + 1) * rs->num_taps * sizeof(float));
+    rs->buf = (float*)malloc((size_t)num_channels * rs->capacity * sizeof(float));
+
+    if (rs->filters == NULL || rs->buf == NULL) {
+        resampler_destroy(rs);
+        return NULL;
+    }
+
+    for (int q = 0; q <= rs->num_phases; q++) {
+        design_filter(rs->filters + (long)q * rs->num_taps, rs->num_taps, rs->half_taps,
+                      (double)q / rs->num_phases, 0.5 * scale * RESAMPLE_ROLLOFF);
+    }
+
+    resampler_seek(rs, 0);
+    return rs;
+}
+
+void resampler_destroy(Resampler* rs) {
+    if (rs != NULL) {
+        free(rs->filters);
+        free(rs->buf);
+        free(rs);
+    }
+}
+
+int64_t resampler_get_out_length(const Resampler* rs, int64_t in_length) {
+    int64_t q = in_length / rs->down;
+    int64_t r = in_length % rs->down;
+    return q * rs->up + (r * rs->up + rs->down - 1) / rs->down;
+}
+
+int64_t resampler_get_in_position(const Resampler* rs, int64_t position) {
+    return position / rs->up * rs->down + position % rs->up * rs->down / rs->up;
+}
+
+void resampler_seek(Resampler* rs, int64_t position) {
+    rs->position = position;
+    rs->base = resampler_get_in_position(rs, position);
+    rs->phase = position % rs->up * rs->down % rs->up;
+    rs->buf_start = rs->base - rs->half_taps + 1;
+    rs->buf_len = 0;
+}
+
+int64_t resampler_tell(const Resampler* rs) {
+    return rs->position;
+}
+
+int64_t resampler_get_input(Resampler* rs, float** channels, int* max_frames) {
+    // drop frames before the first tap of the next output
+    int64_t first = rs->base - rs->half_taps + 1;
+    int64_t drop = first - rs->buf_start;
+
+    if (drop > 0) {
+        drop = drop < rs->buf_len ? drop : rs->buf_len;
+        rs->buf_len -= (int)drop;
+
+        for (int c = 0; c < rs->num_channels; c++) {
+            float* buf = rs->buf + (long)c * rs->capacity;
+            memmove(buf, buf + drop, (size_t)rs->buf_len * sizeof(float));
+        }
+
+        rs->buf_start = rs->buf_len > 0 ? rs->buf_start + drop : first;
+    }
+
+    for (int c = 0; c < rs->num_channels; c++) {
+        channels[c] = rs->buf + (long)c * rs->capacity + rs->buf_len;
+    }
+
+    *max_frames = rs->capacity - rs->buf_len;
+    return rs->buf_start + rs->buf_len;
+}
+
+void resampler_commit_input(Resampler* rs, int num_frames) {
+    rs->buf_len += num_frames;
+}
+
+int resampler_process(Resampler* rs, int max_frames, float* const* dst, int stride) {
+    int offsets[RESAMPLE_BLOCK_FRAMES];
+    int phases[RESAMPLE_BLOCK_FRAMES];
+    int64_t buf_end = rs->buf_start + rs->buf_len;
+    int step = rs->down / rs->up;
+    int frac_step = rs->down % rs->up;
+    int done = 0;
+
+    while (done < max_frames) {
+        int n = 0;
+
+        // outputs whose last tap, base + half_taps, is buffered
+        while (n < RESAMPLE_BLOCK_FRAMES && done + n < max_frames
+                && rs->base + rs->half_taps < buf_end) {
+            offsets[n] = (int)(rs->base - rs->half_taps + 1 - rs->buf_start);
+
+            if (rs->num_phases == rs->up) {
+                phases[n] = (int)rs->phase;
+            } else {
+                phases[n] = (int)((rs->phase * rs->num_phases + rs->up / 2) / rs->up);
+            }
+
+            rs->base += step;
+            rs->phase += frac_step;
+
+            if (rs->phase >= rs->up) {
+                rs->phase -= rs->up;
+                rs->base++;
+            }
+
+            n++;
+        }
+
+        if (n == 0) {
+            break;
+        }
+
+        for (int c = 0; c < rs->num_channels; c++) {
+            fir_f32(rs->buf + (long)c * rs->capacity, offsets, rs->up == 1 ? NULL : phases, n,
+                    rs->filters, rs->num_taps, dst[c] + (long)done * stride, stride);
+        }
+
+        rs->position += n;
+        done += n;
+    }
+
+    return done;
+}
@@ -0,0 +1,52 @@
+#ifndef WAV_RESAMPLE
+#define WAV_RESAMPLE
+
+#include <stdint.h>
+
+/** Streaming polyphase resampler on planar float samples
+ *    - rates are reduced to an up/down ratio, one kaiser windowed sinc filter per phase,
+ *      ratios of more than 1024 phases use the nearest of 1024 phases
+ *    - cutoff at 0.95 of the lower nyquist frequency, 16 zero crossings each side
+ *    - integer decimation (48k -> 16k) runs a single filter without phase lookup
+ *    - output frame n is input time n * in_rate / out_rate, there is no delay
+ *    - caller appends input frames where asked, state carries across calls
+ */
+
+typedef struct Resampler Resampler;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// returns NULL if a rate is not positive
+Resampler* resampler_create(int num_channels, int in_rate, int out_rate);
+void resampler_destroy(Resampler* rs);
+
+// number of output frames for in_length input frames
+int64_t resampler_get_out_length(const Resampler* rs, int64_t in_length);
+
+// input frame at the time of output frame position, rounded down
+int64_t resampler_get_in_position(const Resampler* rs, int64_t position);
+
+// restart at output frame position, buffered input is dropped
+void resampler_seek(Resampler* rs, int64_t position);
+
+// return next output frame position
+int64_t resampler_tell(const Resampler* rs);
+
+// Returns the index of the next input frame to append, negative before the first frame
+//    channels[c] is set to where frames of channel c go, max_frames to the free space
+int64_t resampler_get_input(Resampler* rs, float** channels, int* max_frames);
+
+// append num_frames frames written to channels of resampler_get_input
+void resampler_commit_input(Resampler* rs, int num_frames);
+
+// Returns the number of output frames computed from buffered input, at most max_frames
+//    channel c of output frame i is written to dst[c][i * stride]
+int resampler_process(Resampler* rs, int max_frames, float* const* dst, int stride);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WAV_RESAMPLE
@@ -0,0 +1,545 @@
+#include "wav_stats.h"
+#include "wav_convert.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define MAX_NUM_CHANNELS    256
+#define MAX_SAMPLE_RATE     (48000 * 256)
+
+#define STATS_TILE_FRAMES   1024    // frames per kernel call, true peak output stays in L1
+#define STATS_READ_FRAMES   4096    // frames per read of wav_stats_measure
+#define TRUE_PEAK_PHASES    4
+#define TRUE_PEAK_TAPS      12      // taps per phase of the bs.1770 filter
+#define TRUE_PEAK_FIR_TAPS  16      // taps padded for the fir kernel
+#define LOUDNESS_GATE_ABS   (-70.)
+#define LOUDNESS_GATE_REL   (-10.)
+
+// ITU-R BS.1770-4 annex 2, phase p output is sum of coefs[p][k] * x[n - k]
+static const float true_peak_coefs[TRUE_PEAK_PHASES][TRUE_PEAK_TAPS] = {
+    {0.0017089843750f, 0.0109863281250f, -0.0196533203125f, 0.0332031250000f,
+     -0.0594482421875f, 0.1373291015625f, 0.9721679687500f, -0.1022949218750f,
+     0.0476074218750f, -0.0266113281250f, 0.0148925781250f, -0.0083007812500f},
+    {-0.0291748046875f, 0.0292968750000f, -0.0517578125000f, 0.0891113281250f,
+     -0.1665039062500f, 0.4650878906250f, 0.7797851562500f, -0.2003173828125f,
+     0.1015625000000f, -0.0582275390625f, 0.0330810546875f, -0.0189208984375f},
+    {-0.0189208984375f, 0.0330810546875f, -0.0582275390625f, 0.1015625000000f,
+     -0.2003173828125f, 0.7797851562500f, 0.4650878906250f, -0.1665039062500f,
+     0.0891113281250f, -0.0517578125000f, 0.0292968750000f, -0.0291748046875f},
+    {-0.0083007812500f, 0.0148925781250f, -0.0266113281250f, 0.0476074218750f,
+     -0.1022949218750f, 0.9721679687500f, 0.1373291015625f, -0.0594482421875f,
+     0.0332031250000f, -0.0196533203125f, 0.0109863281250f, 0.0017089843750f}
+};
+
+struct StatsChannel {
+    float peak;
+    float true_peak;
+    double sum;
+    double sum_sq;
+    int64_t num_clips;
+    double weight;      // loudness weight of the channel
+    double state[4];    // k-weighting biquads, transposed direct form II
+    float history[TRUE_PEAK_TAPS - 1];  // last input frames of the true peak filter
+};
+
+struct WavStats {
+    int num_channels;
+    int sample_rate;
+    int64_t num_samples;
+    double shelf[5];    // b0 b1 b2 a1 a2 of the high shelf, the high pass has b = 1 -2 1
+    double high_pass[2];
+    int block_size;     // frames per 100 ms block
+    int block_fill;     // frames in the current block
+    double block_energy;
+    double* blocks;     // weighted k-weighted energy of each complete 100 ms block
+    int64_t num_blocks;
+    int64_t max_blocks;
+    float filters[TRUE_PEAK_PHASES * TRUE_PEAK_FIR_TAPS];
+    int offsets[TRUE_PEAK_PHASES * STATS_TILE_FRAMES];
+    int phases[TRUE_PEAK_PHASES * STATS_TILE_FRAMES];
+    float* planar;      // deinterleave tile of wav_stats_add_f32
+    struct StatsChannel channels[MAX_NUM_CHANNELS];
+};
+
+WavStats* wav_stats_create(int num_channels, int sample_rate) {
+    if (num_channels <= 0 || num_channels > MAX_NUM_CHANNELS
+            || sample_rate <= 0 || sample_rate > MAX_SAMPLE_RATE) {
+        return NULL;
+    }
+
+    WavStats* stats = (WavStats*)calloc(1, sizeof(WavStats));
+
+    if (stats == NULL) {
+        return NULL;
+    }
+
+    stats->num_channels = num_channels;
+    stats->sample_rate = sample_rate;
+    stats->block_size = sample_rate >= 10 ? sample_rate / 10 : 1;
+
+    // k-weighting of BS.1770 designed for sample_rate, matches the 48 kHz coefficients
+    double k = tan(M_PI * 1681.974450955533 / sample_rate);
+    double q = 0.7071752369554196;
+    double vh = pow(10., 3.999843853973347 / 20.);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1. + k / q + k * k;
+    stats->shelf[0] = (vh + vb * k / q + k * k) / a0;
+    stats->shelf[1] = 2. * (k * k - vh) / a0;
+    stats->shelf[2] = (vh - vb * k / q + k * k) / a0;
+    stats->shelf[3] = 2. * (k * k - 1.) / a0;
+    stats->shelf[4] = (1. - k / q + k * k) / a0;
+
+    k = tan(M_PI * 38.13547087602444 / sample_rate);
+    q = 0.5003270373238773;
+    a0 = 1. + k / q + k * k;
+    stats->high_pass[0] = 2. * (k * k - 1.) / a0;
+    stats->high_pass[1] = (1. - k / q + k * k) / a0;
+
+    for (int c = 0; c < num_channels; c++) {
+        stats->channels[c].weight = 1.;
+
+        if (num_channels == 6) {
+            stats->channels[c].weight = c == 3 ? 0. : c >= 4 ? 1.41 : 1.;
+        }
+    }
+
+    // fir kernel correlates forward, taps are reversed and zero padded
+    for (int p = 0; p < TRUE_PEAK_PHASES; p++) {
+        for (int k = 0; k < TRUE_PEAK_TAPS; k++) {
+            stats->filters[p * TRUE_PEAK_FIR_TAPS + k] = true_peak_coefs[p][TRUE_PEAK_TAPS - 1 - k];
+        }
+    }
+
+    for (int i = 0; i < TRUE_PEAK_PHASES * STATS_TILE_FRAMES; i++) {
+        stats->offsets[i] = i / TRUE_PEAK_PHASES;
+        stats->phases[i] = i % TRUE_PEAK_PHASES;
+    }
+
+    return stats;
+}
+
+void wav_stats_destroy(WavStats* stats) {
+    if (stats != NULL) {
+        free(stats->blocks);
+        free(stats->planar);
+        free(stats);
+    }
+}
+
+// sum of squares of count k-weighted samples, filter state carries across calls
+static double k_weighting(const WavStats* stats, double* state, const float* x, int count) {
+    const double* sh = stats->shelf;
+    double ha1 = stats->high_pass[0];
+    double ha2 = stats->high_pass[1];
+    double s1 = state[0];
+    double s2 = state[1];
+    double t1 = state[2];
+    double t2 = state[3];
+    double energy = 0.;
+
+    for (int i = 0; i < count; i++) {
+        double in = x[i];
+        double y = sh[0] * in + s1;
+        s1 = sh[1] * in - sh[3] * y + s2;
+        s2 = sh[2] * in - sh[4] * y;
+        double w = y + t1;
+        t1 = -2. * y - ha1 * w + t2;
+        t2 = y - ha2 * w;
+        energy += w * w;
+    }
+
+    state[0] = s1;
+    state[1] = s2;
+    state[2] = t1;
+    state[3] = t2;
+    return energy;
+}
+
+static int wav_stats_push_block(WavStats* stats) {
+    if (stats->num_blocks == stats->max_blocks) {
+        int64_t max_blocks = stats->max_blocks > 0 ? stats->max_blocks * 2 : 1024;
+        double* blocks = (double*)realloc(stats->blocks, (size_t)max_blocks * sizeof(double));
+
+        if (blocks == NULL) {
+            return -1;
+        }
+
+        stats->blocks = blocks;
+        stats->max_blocks = max_blocks;
+    }
+
+    stats->blocks[stats->num_blocks++] = stats->block_energy;
+    stats->block_energy = 0.;
+    stats->block_fill = 0;
+    return 0;
+}
+
+// true peak of count frames of one channel, count at most STATS_TILE_FRAMES
+static void wav_stats_true_peak(WavStats* stats, struct StatsChannel* ch, const float* x,
+                                int count) {
+    float buf[TRUE_PEAK_TAPS - 1 + STATS_TILE_FRAMES + TRUE_PEAK_FIR_TAPS - TRUE_PEAK_TAPS];
+    float out[TRUE_PEAK_PHASES * STATS_TILE_FRAMES];
+    int history = TRUE_PEAK_TAPS - 1;
+    double sum = 0.;
+    double sum_sq = 0.;
+    int64_t num_clips = 0;
+
+    memcpy(buf, ch->history, sizeof(ch->history));
+    memcpy(buf + history, x, (size_t)count * sizeof(float));
+    // padded taps have zero weight, keep the frames they read finite
+    memset(buf + history + count, 0, (TRUE_PEAK_FIR_TAPS - TRUE_PEAK_TAPS) * sizeof(float));
+
+    fir_f32(buf, stats->offsets, stats->phases, TRUE_PEAK_PHASES * count, stats->filters,
+            TRUE_PEAK_FIR_TAPS, out, 1);
+    level_f32(out, TRUE_PEAK_PHASES * count, &ch->true_peak, &sum, &sum_sq, &num_clips);
+    memcpy(ch->history, buf + count, sizeof(ch->history));
+}
+
+void wav_stats_add_planar_f32(WavStats* stats, int num_samples, const float* const* channels) {
+    for (int t = 0; t < num_samples; t += STATS_TILE_FRAMES) {
+        int n = num_samples - t < STATS_TILE_FRAMES ? num_samples - t : STATS_TILE_FRAMES;
+
+        for (int c = 0; c < stats->num_channels; c++) {
+            struct StatsChannel* ch = &stats->channels[c];
+            level_f32(channels[c] + t, n, &ch->peak, &ch->sum, &ch->sum_sq, &ch->num_clips);
+            wav_stats_true_peak(stats, ch, channels[c] + t, n);
+        }
+
+        // loudness energy split at 100 ms block boundaries
+        for (int i = 0; i < n;) {
+            int len = stats->block_size - stats->block_fill;
+            len = len < n - i ? len : n - i;
+
+            for (int c = 0; c < stats->num_channels; c++) {
+                struct StatsChannel* ch = &stats->channels[c];
+                double energy = k_weighting(stats, ch->state, channels[c] + t + i, len);
+                stats->block_energy += ch->weight * energy;
+            }
+
+            stats->block_fill += len;
+            i += len;
+
+            if (stats->block_fill == stats->block_size && wav_stats_push_block(stats) != 0) {
+                // out of memory, the block is lost
+                stats->block_energy = 0.;
+                stats->block_fill = 0;
+            }
+        }
+    }
+
+    stats->num_samples += num_samples;
+}
+
+void wav_stats_add_f32(WavStats* stats, int num_samples, const float* samples) {
+    int num_channels = stats->num_channels;
+    float* channels[MAX_NUM_CHANNELS];
+
+    if (stats->planar == NULL) {
+        stats->planar = (float*)malloc((size_t)num_channels * STATS_TILE_FRAMES * sizeof(float));
+
+        if (stats->planar == NULL) {
+            return;
+        }
+    }
+
+    for (int c = 0; c < num_channels; c++) {
+        channels[c] = stats->planar + (long)c * STATS_TILE_FRAMES;
+    }
+
+    for (int t = 0; t < num_samples; t += STATS_TILE_FRAMES) {
+        int n = num_samples - t < STATS_TILE_FRAMES ? num_samples - t : STATS_TILE_FRAMES;
+        deinterleave_f32_to_f32(samples + (long)t * num_channels, num_channels, n,
+                                (void* const*)channels, 0);
+        wav_stats_add_planar_f32(stats, n, (const float* const*)channels);
+    }
+}
+
+void wav_stats_prime_planar_f32(WavStats* stats, int num_samples, const float* const* channels) {
+    int history = TRUE_PEAK_TAPS - 1;
+
+    for (int c = 0; c < stats->num_channels; c++) {
+        struct StatsChannel* ch = &stats->channels[c];
+        k_weighting(stats, ch->state, channels[c], num_samples);
+
+        if (num_samples >= history) {
+            memcpy(ch->history, channels[c] + num_samples - history, sizeof(ch->history));
+        } else {
+            memmove(ch->history, ch->history + num_samples,
+                    (size_t)(history - num_samples) * sizeof(float));
+            memcpy(ch->history + history - num_samples, channels[c],
+                   (size_t)num_samples * sizeof(float));
+        }
+    }
+}
+
+int wav_stats_merge(WavStats* stats, const WavStats* next) {
+    if (stats->num_channels != next->num_channels || stats->sample_rate != next->sample_rate
+            || stats->block_fill != 0) {
+        return -1;
+    }
+
+    if (stats->num_blocks + next->num_blocks > stats->max_blocks) {
+        int64_t max_blocks = stats->num_blocks + next->num_blocks;
+        double* blocks = (double*)realloc(stats->blocks, (size_t)max_blocks * sizeof(double));
+
+        if (blocks == NULL) {
+            return -1;
+        }
+
+        stats->blocks = blocks;
+        stats->max_blocks = max_blocks;
+    }
+
+    if (next->num_blocks > 0) {
+        memcpy(stats->blocks + stats->num_blocks, next->blocks,
+               (size_t)next->num_blocks * sizeof(double));
+    }
+
+    stats->num_blocks += next->num_blocks;
+    stats->block_fill = next->block_fill;
+    stats->block_energy = next->block_energy;
+    stats->num_samples += next->num_samples;
+
+    // filter state continues from the end of next
+    for (int c = 0; c < stats->num_channels; c++) {
+        struct StatsChannel* ch = &stats->channels[c];
+        const struct StatsChannel* other = &next->channels[c];
+        ch->peak = other->peak > ch->peak ? other->peak : ch->peak;
+        ch->true_peak = other->true_peak > ch->true_peak ? other->true_peak : ch->true_peak;
+        ch->sum += other->sum;
+        ch->sum_sq += other->sum_sq;
+        ch->num_clips += other->num_clips;
+        memcpy(ch->state, other->state, sizeof(ch->state));
+        memcpy(ch->history, other->history, sizeof(ch->history));
+    }
+
+    return 0;
+}
+
+int wav_stats_get_num_channels(const WavStats* stats) {
+    return stats->num_channels;
+}
+
+int64_t wav_stats_get_num_samples(const WavStats* stats) {
+    return stats->num_samples;
+}
+
+int wav_stats_get_channel(const WavStats* stats, int channel, WavChannelStats* channel_stats) {
+    if (channel < 0 || channel >= stats->num_channels) {
+        return -1;
+    }
+
+    const struct StatsChannel* ch = &stats->channels[channel];
+    double n = stats->num_samples > 0 ? (double)stats->num_samples : 1.;
+    channel_stats->peak = ch->peak;
+    channel_stats->true_peak = ch->true_peak > ch->peak ? ch->true_peak : ch->peak;
+    channel_stats->rms = sqrt(ch->sum_sq / n);
+    channel_stats->dc = ch->sum / n;
+    channel_stats->num_clips = ch->num_clips;
+    return 0;
+}
+
+double wav_stats_get_loudness(const WavStats* stats) {
+    // 400 ms gating blocks are 4 consecutive 100 ms blocks, 75% overlap
+    int64_t num_gating = stats->num_blocks >= 4 ? stats->num_blocks - 3 : 0;
+    double scale = 1. / (4. * stats->block_size);
+    double abs_threshold = pow(10., (LOUDNESS_GATE_ABS + 0.691) / 10.);
+    double sum = 0.;
+    int64_t count = 0;
+
+    for (int pass = 0; pass < 2; pass++) {
+        double threshold = abs_threshold;
+
+        if (pass == 1) {
+            if (count == 0) {
+                return -HUGE_VAL;
+            }
+
+            // relative gate is 10 LU below the loudness of blocks above the absolute gate
+            double rel_threshold = sum / count * pow(10., LOUDNESS_GATE_REL / 10.);
+            threshold = rel_threshold > abs_threshold ? rel_threshold : abs_threshold;
+            sum = 0.;
+            count = 0;
+        }
+
+        for (int64_t j = 0; j < num_gating; j++) {
+            const double* b = stats->blocks + j;
+            double z = ((b[0] + b[1]) + (b[2] + b[3])) * scale;
+
+            if (z > threshold) {
+                sum += z;
+                count++;
+            }
+        }
+    }
+
+    return count > 0 ? -0.691 + 10. * log10(sum / count) : -HUGE_VAL;
+}
+
+/* measure on threads */
+
+struct StatsJob {
+    WavReader* reader;
+    WavStats* stats;
+    int64_t begin;
+    int64_t end;    // -1 reads to end of stream
+    int64_t warmup;
+    int started;
+    int ret;
+};
+
+// read count frames planar into channels, count -1 reads to the end
+static int wav_stats_read(struct StatsJob* job, int64_t count, float* const* channels, int prime) {
+    int64_t done = 0;
+
+    while (count < 0 || done < count) {
+        int request = STATS_READ_FRAMES;
+
+        if (count >= 0 && count - done < request) {
+            request = (int)(count - done);
+        }
+
+        int ret = wav_reader_read_planar_f32(job->reader, request, channels);
+
+        if (ret <= 0) {
+            break;
+        }
+
+        if (prime) {
+            wav_stats_prime_planar_f32(job->stats, ret, (const float* const*)channels);
+        } else {
+            wav_stats_add_planar_f32(job->stats, ret, (const float* const*)channels);
+        }
+
+        done += ret;
+
+        if (ret < request) {
+            break;
+        }
+    }
+
+    return count < 0 || done == count ? 0 : -1;
+}
+
+static void* wav_stats_job_run(void* arg) {
+    struct StatsJob* job = (struct StatsJob*)arg;
+    int num_channels = wav_stats_get_num_channels(job->stats);
+    float* buf = (float*)malloc((size_t)num_channels * STATS_READ_FRAMES * sizeof(float));
+    float* channels[MAX_NUM_CHANNELS];
+
+    job->ret = -1;
+
+    if (buf == NULL) {
+        return NULL;
+    }
+
+    for (int c = 0; c < num_channels; c++) {
+        channels[c] = buf + (long)c * STATS_READ_FRAMES;
+    }
+
+    // frames before the segment settle the filters, they are counted by the previous job
+    if (wav_reader_seek(job->reader, job->begin - job->warmup, SEEK_SET) == 0
+            && wav_stats_read(job, job->warmup, channels, 1) == 0) {
+        int64_t count = job->end >= 0 ? job->end - job->begin : -1;
+        job->ret = wav_stats_read(job, count, channels, 0);
+    }
+
+    free(buf);
+    return NULL;
+}
+
+WavStats* wav_stats_measure(WavReader* reader, int num_threads) {
+    int num_channels = wav_reader_get_num_read_channels(reader);
+    int sample_rate = wav_reader_get_sample_rate(reader);
+    int64_t begin = wav_reader_tell(reader);
+    int64_t end = wav_reader_get_num_samples(reader);
+    WavStats* stats = wav_stats_create(num_channels, sample_rate);
+
+    if (stats == NULL) {
+        return NULL;
+    }
+
+    int64_t block_size = stats->block_size;
+    int64_t num_blocks = end > begin ? (end - begin) / block_size : 0;
+
+    // streams and short files are measured on the calling thread with reader itself
+    if (num_threads <= 1 || end < 0 || num_blocks < 2 * num_threads) {
+        struct StatsJob job = {reader, stats, begin, -1, 0, 0, 0};
+        float* buf = (float*)malloc((size_t)num_channels * STATS_READ_FRAMES * sizeof(float));
+        float* channels[MAX_NUM_CHANNELS];
+
+        for (int c = 0; buf != NULL && c < num_channels; c++) {
+            channels[c] = buf + (long)c * STATS_READ_FRAMES;
+        }
+
+        if (buf == NULL || wav_stats_read(&job, -1, channels, 0) != 0) {
+            wav_stats_destroy(stats);
+            stats = NULL;
+        }
+
+        free(buf);
+        return stats;
+    }
+
+    struct StatsJob* jobs = (struct StatsJob*)calloc(num_threads, sizeof(struct StatsJob));
+    pthread_t* threads = (pthread_t*)calloc(num_threads, sizeof(pthread_t));
+    int ret = jobs != NULL && threads != NULL ? 0 : -1;
+
+    // segments start at 100 ms block boundaries, the last one takes the remainder
+    for (int k = 0; ret == 0 && k < num_threads; k++) {
+        jobs[k].begin = begin + num_blocks * k / num_threads * block_size;
+        jobs[k].end = k + 1 < num_threads ? begin + num_blocks * (k + 1) / num_threads
+                      * block_size : end;
+        jobs[k].warmup = jobs[k].begin - begin < block_size ? jobs[k].begin - begin : block_size;
+        jobs[k].reader = wav_reader_dup(reader);
+        jobs[k].stats = k == 0 ? stats : wav_stats_create(num_channels, sample_rate);
+
+        if (jobs[k].reader == NULL || jobs[k].stats == NULL) {
+            ret = -1;
+            break;
+        }
+
+        jobs[k].started = pthread_create(&threads[k], NULL, wav_stats_job_run, &jobs[k]) == 0;
+
+        if (!jobs[k].started) {
+            wav_stats_job_run(&jobs[k]);
+        }
+    }
+
+    for (int k = 0; jobs != NULL && k < num_threads; k++) {
+        if (jobs[k].started) {
+            pthread_join(threads[k], NULL);
+        }
+
+        // segments merge in order, a failed one fails the whole measurement
+        if (ret == 0 && (jobs[k].ret != 0
+                         || (k > 0 && wav_stats_merge(stats, jobs[k].stats) != 0))) {
+            ret = -1;
+        }
+
+        if (k > 0) {
+            wav_stats_destroy(jobs[k].stats);
+        }
+
+        if (jobs[k].reader != NULL) {
+            wav_reader_close(jobs[k].reader);
+        }
+    }
+
+    free(jobs);
+    free(threads);
+
+    if (ret != 0) {
+        wav_stats_destroy(stats);
+        return NULL;
+    }
+
+    wav_reader_seek(reader, 0, SEEK_END);
+    return stats;
+}
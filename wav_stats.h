@@ -0,0 +1,69 @@
+#ifndef WAV_STATS
+#define WAV_STATS
+
+#include "wav_file.h"
+#include <stdint.h>
+
+/** Level and loudness statistics in one streaming pass
+ *    - per channel sample peak, true peak, rms, dc offset and clipped samples
+ *    - integrated loudness of EBU R128 / ITU-R BS.1770-4: k-weighting, 400 ms blocks
+ *      every 100 ms, -70 LUFS absolute and -10 LU relative gates
+ *    - true peak on 4x oversampling with the 48 tap filter of BS.1770-4 annex 2,
+ *      never below the sample peak
+ *    - 5.1 files (6 channels, L R C LFE Ls Rs) weight surround by 1.41 and skip LFE,
+ *      other layouts weight every channel by 1
+ *    - segments measured on separate threads merge into the statistics of the whole
+ */
+
+typedef struct WavStats WavStats;
+
+typedef struct WavChannelStats {
+    float peak;         // largest |sample|
+    float true_peak;    // largest |sample| of the 4x oversampled signal
+    double rms;
+    double dc;          // mean sample value
+    int64_t num_clips;  // samples with |sample| >= 1 (full scale)
+} WavChannelStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// returns NULL if num_channels or sample_rate is out of range
+WavStats* wav_stats_create(int num_channels, int sample_rate);
+void wav_stats_destroy(WavStats* stats);
+
+// Add num_samples frames of interleaved or planar samples to the statistics
+void wav_stats_add_f32(WavStats* stats, int num_samples, const float* samples);
+void wav_stats_add_planar_f32(WavStats* stats, int num_samples, const float* const* channels);
+
+// Run the filters over num_samples frames preceding the first added frame without
+//    counting them, a segment then measures as it would within the whole file
+void wav_stats_prime_planar_f32(WavStats* stats, int num_samples, const float* const* channels);
+
+// Append statistics of next, measured over the frames following those added to stats
+//    stats must end on a 100 ms boundary (a multiple of sample_rate / 10 frames),
+//    returns 0 on success
+int wav_stats_merge(WavStats* stats, const WavStats* next);
+
+// Measure reader from its read position to the end, at the file sample rate so reader
+//    must not resample, channel selection and mixing apply
+//    num_threads > 1 splits files of known length over wav_reader_dup cursors,
+//    read position is at the end afterwards, returns NULL on failure
+WavStats* wav_stats_measure(WavReader* reader, int num_threads);
+
+int wav_stats_get_num_channels(const WavStats* stats);
+int64_t wav_stats_get_num_samples(const WavStats* stats);
+
+// returns 0 on success, -1 if channel is out of range
+int wav_stats_get_channel(const WavStats* stats, int channel, WavChannelStats* channel_stats);
+
+// Returns integrated loudness in LUFS, -HUGE_VAL if no block passes the gates
+//    (silence or less than 400 ms)
+double wav_stats_get_loudness(const WavStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WAV_STATS